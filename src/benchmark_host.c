@@ -0,0 +1,85 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by the OpenOCD developers                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "log.h"
+#include "command.h"
+#include "host_benchmark.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+/* "make check" runs the host benchmarks without a server or target:
+ * benchmark_host [save|check <baseline file> [percent]]
+ *
+ * Without arguments the results are checked against the baseline in
+ * testing/. It comes from another machine, so the default threshold is
+ * wide; HOST_BENCHMARK_SLOWER in the environment overrides it. */
+#define BENCHMARK_HOST_SLOWER	"200"	/* percent */
+
+/* referenced by the libraries, nothing else runs here */
+void lockBigLock()
+{
+}
+
+void unlockBigLock()
+{
+}
+
+static int benchmark_host_output(struct command_context_s *context, char *line)
+{
+	fputs(line, stdout);
+
+	return ERROR_OK;
+}
+
+int main(int argc, char *argv[])
+{
+	static char *check_args[] = { "check", HOST_BENCHMARK_BASELINE, BENCHMARK_HOST_SLOWER };
+	command_context_t *cmd_ctx = command_init();
+	char **args = argv + 1;
+	int nargs = argc - 1;
+
+	command_set_output_handler(cmd_ctx, benchmark_host_output, NULL);
+
+	if (log_init(cmd_ctx) != ERROR_OK)
+		return EXIT_FAILURE;
+
+	if (nargs == 0)
+	{
+		if (getenv("HOST_BENCHMARK_SLOWER"))
+			check_args[2] = getenv("HOST_BENCHMARK_SLOWER");
+
+		args = check_args;
+		nargs = 3;
+	}
+
+	switch (host_benchmark(cmd_ctx, args, nargs))
+	{
+		case ERROR_OK:
+			return EXIT_SUCCESS;
+		case ERROR_COMMAND_SYNTAX_ERROR:
+			fprintf(stderr, "usage: %s [save|check <baseline file> [percent]]\n", argv[0]);
+			return EXIT_FAILURE;
+		default:
+			return EXIT_FAILURE;
+	}
+}
@@ -46,6 +46,7 @@ There are some things to notice
 #include "log.h"
 #include "binarybuffer.h"
 #include "types.h"
+#include "time_support.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -254,15 +255,21 @@ void at91sam7_set_flash_mode(flash_bank_t *bank, u8 flashplane, int mode)
 u32 at91sam7_wait_status_busy(flash_bank_t *bank, u8 flashplane, u32 waitbits, int timeout)
 {
 	u32 status;
+	deadline_t deadline;
 	
-	while ((!((status = at91sam7_get_flash_status(bank,flashplane)) & waitbits)) && (timeout-- > 0))
+	deadline_start(&deadline, timeout);
+	while (!((status = at91sam7_get_flash_status(bank,flashplane)) & waitbits))
 	{
 		LOG_DEBUG("status[%i]: 0x%x", flashplane, status);
-		usleep(1000);
+		if (!deadline_wait(&deadline))
+			break;
 	}
 	
 	LOG_DEBUG("status[%i]: 0x%x", flashplane, status);
 
+	if (!(status & waitbits))
+		LOG_ERROR("timeout waiting for flash controller, status register: 0x%x", status);
+
 	if (status & 0x0C)
 	{
 		LOG_ERROR("status register: 0x%x", status);
@@ -281,7 +288,8 @@ u32 at91sam7_wait_status_busy(flash_bank_t *bank, u8 flashplane, u32 waitbits, i
 /* Send one command to the AT91SAM flash controller */
 int at91sam7_flash_command(struct flash_bank_s *bank, u8 flashplane, u8 cmd, u16 pagen) 
 {
-	u32 fcr;
+	u32 fcr, waitbits = MC_FSR_FRDY, status;
+	int timeout = (cmd == EA) ? AT91SAM7_ERASE_ALL_TIMEOUT : AT91SAM7_FLASH_TIMEOUT;
 	at91sam7_flash_bank_t *at91sam7_info = bank->driver_priv;
 	target_t *target = bank->target;
 
@@ -289,17 +297,12 @@ int at91sam7_flash_command(struct flash_bank_s *bank, u8 flashplane, u8 cmd, u16
 	target_write_u32(target, MC_FCR[flashplane], fcr);
 	LOG_DEBUG("Flash command: 0x%x, flashplane: %i, pagenumber:%u", fcr, flashplane, pagen);
 
+	/* Lock bit manipulation on AT91SAM7A3 waits for FC_FSR bit 1, EOL */
 	if ((at91sam7_info->cidr_arch == 0x60)&&((cmd==SLB)|(cmd==CLB)))
-	{
-		/* Lock bit manipulation on AT91SAM7A3 waits for FC_FSR bit 1, EOL */
-		if (at91sam7_wait_status_busy(bank, flashplane, MC_FSR_EOL, 10)&0x0C) 
-		{
-			return ERROR_FLASH_OPERATION_FAILED;
-		}
-		return ERROR_OK;
-	}
+		waitbits = MC_FSR_EOL;
 
-	if (at91sam7_wait_status_busy(bank, flashplane, MC_FSR_FRDY, 10)&0x0C) 
+	status = at91sam7_wait_status_busy(bank, flashplane, waitbits, timeout);
+	if ((status & 0x0C) || !(status & waitbits))
 	{
 		return ERROR_FLASH_OPERATION_FAILED;
 	}
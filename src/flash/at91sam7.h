@@ -87,6 +87,12 @@ typedef struct at91sam7_flash_bank_s
 #define        MC_FSR_FRDY 1
 #define        MC_FSR_EOL 2
 
+/* command timeouts in ms: a page write including its erase and lock bit or
+ * GPNVM changes take up to 6 ms, erase all up to 15 ms (datasheet flash
+ * characteristics), with headroom for slow main clocks */
+#define AT91SAM7_FLASH_TIMEOUT		50
+#define AT91SAM7_ERASE_ALL_TIMEOUT	200
+
 /* AT91SAM7 constants */
 #define RC_FREQ  32000
 
@@ -0,0 +1,401 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by the OpenOCD developers                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "replacements.h"
+
+#include "benchmark.h"
+
+#include "flash.h"
+#include "target.h"
+#include "jtag.h"
+#include "command.h"
+#include "log.h"
+#include "crc32.h"
+#include "time_support.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Throughput and latency of the debug paths, to compare adapters, clock
+ * settings and OpenOCD versions on a given setup. Every benchmark repeats
+ * one operation until the run time is over and reports the latency
+ * distribution of the single operations and the number of JTAG queue
+ * flushes they needed. */
+
+#define BENCHMARK_DEFAULT_MS	1000
+#define BENCHMARK_MAX_SAMPLES	100000
+
+typedef struct benchmark_s
+{
+	char *name;
+	u32 bytes;		/* per operation */
+	int run_ms;
+	long long *samples;	/* us per operation */
+	int num_samples;
+	long long start_us;
+	long long op_start;
+	int flush_start;	/* jtag_flush_count at the start */
+} benchmark_t;
+
+static int benchmark_start(benchmark_t *b, char *name, u32 bytes, int run_ms)
+{
+	b->name = name;
+	b->bytes = bytes;
+	b->run_ms = run_ms;
+	b->num_samples = 0;
+
+	if ((b->samples = malloc(BENCHMARK_MAX_SAMPLES * sizeof(long long))) == NULL)
+		return ERROR_FAIL;
+
+	b->flush_start = jtag_flush_count;
+	b->start_us = monotonic_us();
+
+	return ERROR_OK;
+}
+
+/* returns 0 once the run time is over */
+static int benchmark_next(benchmark_t *b)
+{
+	long long now = monotonic_us();
+
+	if (b->num_samples > 0)
+		b->samples[b->num_samples - 1] = now - b->op_start;
+
+	if ((b->num_samples == BENCHMARK_MAX_SAMPLES) ||
+		((b->num_samples > 0) && (now - b->start_us >= b->run_ms * 1000LL)))
+		return 0;
+
+	b->num_samples++;
+	b->op_start = monotonic_us();
+
+	return 1;
+}
+
+static int benchmark_compare(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* print the results and free the samples; an operation that failed
+ * doesn't count */
+static void benchmark_report(struct command_context_s *cmd_ctx, benchmark_t *b, int failed)
+{
+	long long total = 0;
+	int n = b->num_samples - (failed ? 1 : 0);
+	int flushes = jtag_flush_count - b->flush_start;
+	int i;
+
+	if (n <= 0)
+	{
+		command_print(cmd_ctx, "%s: no operation completed", b->name);
+		free(b->samples);
+		return;
+	}
+
+	for (i = 0; i < n; i++)
+		total += b->samples[i];
+
+	qsort(b->samples, n, sizeof(long long), benchmark_compare);
+
+	if (b->bytes)
+		command_print(cmd_ctx, "%s: %d x %u bytes in %lld ms, %.1f KB/s", b->name, n, b->bytes,
+			total / 1000, total ? ((double)b->bytes * n * 1000000.0) / (total * 1024.0) : 0.0);
+	else
+		command_print(cmd_ctx, "%s: %d operations in %lld ms", b->name, n, total / 1000);
+
+	command_print(cmd_ctx, "latency us: min %lld, median %lld, 90%% %lld, 99%% %lld, max %lld",
+		b->samples[0], b->samples[n / 2], b->samples[(n * 90) / 100], b->samples[(n * 99) / 100], b->samples[n - 1]);
+	command_print(cmd_ctx, "jtag flushes: %d, %.2f per operation", flushes, (double)flushes / n);
+
+	free(b->samples);
+}
+
+static int benchmark_jtag(struct command_context_s *cmd_ctx, char **args, int argc)
+{
+	benchmark_t b;
+	scan_field_t field;
+	int bits = 32;
+	int run_ms = BENCHMARK_DEFAULT_MS;
+	int retval = ERROR_OK;
+	u8 *out, *in;
+	int i;
+
+	if (argc > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	if (argc > 0)
+		bits = strtoul(args[0], NULL, 0);
+	if (argc > 1)
+		run_ms = strtoul(args[1], NULL, 0);
+	if (bits <= 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	out = malloc(CEIL(bits, 8));
+	in = malloc(CEIL(bits, 8));
+	for (i = 0; i < CEIL(bits, 8); i++)
+		out[i] = i;
+
+	memset(&field, 0, sizeof(field));
+	field.num_bits = bits;
+	field.out_value = out;
+	field.in_value = in;
+
+	if (benchmark_start(&b, "jtag", CEIL(bits, 8), run_ms) != ERROR_OK)
+	{
+		free(out);
+		free(in);
+		return ERROR_FAIL;
+	}
+
+	while (benchmark_next(&b))
+	{
+		jtag_add_plain_dr_scan(1, &field, TAP_RTI);
+		if ((retval = jtag_execute_queue()) != ERROR_OK)
+			break;
+	}
+
+	command_print(cmd_ctx, "%d bit DR scans", bits);
+	benchmark_report(cmd_ctx, &b, retval != ERROR_OK);
+
+	free(out);
+	free(in);
+
+	return retval;
+}
+
+static int benchmark_mem(struct command_context_s *cmd_ctx, char **args, int argc)
+{
+	target_t *target = get_current_target(cmd_ctx);
+	benchmark_t b;
+	u32 address, size;
+	int run_ms = BENCHMARK_DEFAULT_MS;
+	int retval = ERROR_OK;
+	u8 *buffer;
+	u32 i;
+
+	if ((argc < 3) || (argc > 4))
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	address = strtoul(args[1], NULL, 0);
+	size = strtoul(args[2], NULL, 0);
+	if (argc > 3)
+		run_ms = strtoul(args[3], NULL, 0);
+	if (size == 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (strcmp(args[0], "bulk") == 0)
+	{
+		if (!target->type->bulk_write_memory || (address % 4) || (size % 4))
+		{
+			command_print(cmd_ctx, "bulk writes need a target with bulk_write_memory and word aligned address and size");
+			return ERROR_OK;
+		}
+	}
+	else if ((strcmp(args[0], "read") != 0) && (strcmp(args[0], "write") != 0))
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if ((buffer = malloc(size)) == NULL)
+		return ERROR_FAIL;
+	for (i = 0; i < size; i++)
+		buffer[i] = i;
+
+	if (benchmark_start(&b, args[0], size, run_ms) != ERROR_OK)
+	{
+		free(buffer);
+		return ERROR_FAIL;
+	}
+
+	while (benchmark_next(&b))
+	{
+		if (args[0][0] == 'r')
+			retval = target_read_buffer(target, address, size, buffer);
+		else if (args[0][0] == 'w')
+			retval = target_write_buffer(target, address, size, buffer);
+		else
+			retval = target->type->bulk_write_memory(target, address, size / 4, buffer);
+
+		if (retval != ERROR_OK)
+			break;
+	}
+
+	benchmark_report(cmd_ctx, &b, retval != ERROR_OK);
+	free(buffer);
+
+	return retval;
+}
+
+static int benchmark_crc(struct command_context_s *cmd_ctx, char **args, int argc)
+{
+	target_t *target = get_current_target(cmd_ctx);
+	benchmark_t b;
+	u32 address, size, checksum;
+	int run_ms = BENCHMARK_DEFAULT_MS;
+	int retval = ERROR_OK;
+
+	if ((argc < 2) || (argc > 3))
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	address = strtoul(args[0], NULL, 0);
+	size = strtoul(args[1], NULL, 0);
+	if (argc > 2)
+		run_ms = strtoul(args[2], NULL, 0);
+
+	if (benchmark_start(&b, "crc", size, run_ms) != ERROR_OK)
+		return ERROR_FAIL;
+
+	while (benchmark_next(&b))
+	{
+		if ((retval = target_checksum_memory(target, address, size, &checksum)) != ERROR_OK)
+			break;
+	}
+
+	benchmark_report(cmd_ctx, &b, retval != ERROR_OK);
+
+	return retval;
+}
+
+/* erase, program and verify one sector, which is left erased */
+static int benchmark_flash(struct command_context_s *cmd_ctx, char **args, int argc)
+{
+	static char *names[] = { "erase", "program", "verify" };
+	flash_bank_t *bank;
+	flash_sector_t *sector;
+	benchmark_t b[3];
+	int rounds = 1;
+	int retval = ERROR_OK;
+	u32 crc, checksum, i;
+	u8 *buffer;
+	int n, round, phase;
+
+	if ((argc < 2) || (argc > 3))
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if ((bank = get_flash_bank_by_num(strtoul(args[0], NULL, 0))) == NULL)
+	{
+		command_print(cmd_ctx, "flash bank '#%s' is out of bounds", args[0]);
+		return ERROR_OK;
+	}
+
+	n = strtoul(args[1], NULL, 0);
+	if ((n < 0) || (n >= bank->num_sectors))
+	{
+		command_print(cmd_ctx, "sector %d is out of bounds", n);
+		return ERROR_OK;
+	}
+	sector = &bank->sectors[n];
+
+	if (argc > 2)
+		rounds = strtoul(args[2], NULL, 0);
+	if ((rounds < 1) || (rounds > BENCHMARK_MAX_SAMPLES))
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if ((buffer = malloc(sector->size)) == NULL)
+		return ERROR_FAIL;
+	for (i = 0; i < sector->size; i++)
+		buffer[i] = (i * 1103515245 + 12345) >> 16;
+	crc = crc32_final(crc32_update(crc32_init(), buffer, sector->size));
+
+	for (phase = 0; phase < 3; phase++)
+	{
+		if (benchmark_start(&b[phase], names[phase], sector->size, 0) != ERROR_OK)
+		{
+			while (phase--)
+				free(b[phase].samples);
+			free(buffer);
+			return ERROR_FAIL;
+		}
+	}
+
+	flash_set_dirty();
+
+	for (round = 0; (round < rounds) && (retval == ERROR_OK); round++)
+	{
+		for (phase = 0; (phase < 3) && (retval == ERROR_OK); phase++)
+		{
+			long long start = monotonic_us();
+			int flushes = jtag_flush_count;
+			int other;
+
+			if (phase == 0)
+				retval = flash_driver_erase(bank, n, n);
+			else if (phase == 1)
+				retval = flash_driver_write(bank, buffer, sector->offset, sector->size);
+			else if ((retval = target_checksum_memory(bank->target, bank->base + sector->offset, sector->size, &checksum)) == ERROR_OK)
+			{
+				if (checksum != crc)
+				{
+					LOG_ERROR("verify failed: crc 0x%8.8x, expected 0x%8.8x", checksum, crc);
+					retval = ERROR_FLASH_OPERATION_FAILED;
+				}
+			}
+
+			if (retval == ERROR_OK)
+				b[phase].samples[b[phase].num_samples++] = monotonic_us() - start;
+
+			/* the flushes of this phase don't count for the others */
+			for (other = 0; other < 3; other++)
+			{
+				if (other != phase)
+					b[other].flush_start += jtag_flush_count - flushes;
+			}
+		}
+	}
+
+	/* leave the scratch sector erased */
+	if (retval == ERROR_OK)
+		retval = flash_driver_erase(bank, n, n);
+
+	command_print(cmd_ctx, "flash bank %s sector %d, %u bytes", args[0], n, sector->size);
+	for (phase = 0; phase < 3; phase++)
+		benchmark_report(cmd_ctx, &b[phase], 0);
+
+	free(buffer);
+
+	return retval;
+}
+
+static int handle_benchmark_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
+{
+	if (argc < 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (strcmp(args[0], "jtag") == 0)
+		return benchmark_jtag(cmd_ctx, args + 1, argc - 1);
+	else if (strcmp(args[0], "mem") == 0)
+		return benchmark_mem(cmd_ctx, args + 1, argc - 1);
+	else if (strcmp(args[0], "crc") == 0)
+		return benchmark_crc(cmd_ctx, args + 1, argc - 1);
+	else if (strcmp(args[0], "flash") == 0)
+		return benchmark_flash(cmd_ctx, args + 1, argc - 1);
+
+	return ERROR_COMMAND_SYNTAX_ERROR;
+}
+
+int benchmark_register_commands(struct command_context_s *cmd_ctx)
+{
+	register_command(cmd_ctx, NULL, "benchmark", handle_benchmark_command, COMMAND_EXEC,
+		"measure throughput and latency: jtag [bits] [ms] | mem <read|write|bulk> <address> <size> [ms] | "
+		"crc <address> <size> [ms] | flash <bank> <sector> [rounds] (destroys the sector contents)");
+
+	return ERROR_OK;
+}
@@ -33,6 +33,7 @@
 #include "algorithm.h"
 #include "binarybuffer.h"
 #include "types.h"
+#include "time_support.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -262,14 +263,35 @@ void cfi_intel_clear_status_register(flash_bank_t *bank)
 	target->type->write_memory(target, flash_address(bank, 0, 0x0), bank->bus_width, 1, command);
 }
 
+/* maximum time of an operation in ms from the CFI query: typical times are
+ * 2^typ us for writes and 2^typ ms for block erases, the maximum is 2^max
+ * times the typical time. Devices that don't specify them (0) get a generous
+ * CFI_UNSPECIFIED_TIMEOUT. */
+#define CFI_UNSPECIFIED_TIMEOUT		10000
+
+static int cfi_max_timeout(u8 typ, u8 max, int unit_us)
+{
+	if ((typ == 0) || (max == 0) || (typ + max > 30))
+		return CFI_UNSPECIFIED_TIMEOUT;
+
+	return (int)(((1LL << (typ + max)) * unit_us) / 1000) + 1;
+}
+
+#define CFI_WORD_WRITE_TIMEOUT(cfi_info)	cfi_max_timeout((cfi_info)->word_write_timeout_typ, (cfi_info)->word_write_timeout_max, 1)
+#define CFI_BUF_WRITE_TIMEOUT(cfi_info)		cfi_max_timeout((cfi_info)->buf_write_timeout_typ, (cfi_info)->buf_write_timeout_max, 1)
+#define CFI_BLOCK_ERASE_TIMEOUT(cfi_info)	cfi_max_timeout((cfi_info)->block_erase_timeout_typ, (cfi_info)->block_erase_timeout_max, 1000)
+
 u8 cfi_intel_wait_status_busy(flash_bank_t *bank, int timeout)
 {
 	u8 status;
+	deadline_t deadline;
 
-	while ((!((status = cfi_get_u8(bank, 0, 0x0)) & 0x80)) && (timeout-- > 0))
+	deadline_start(&deadline, timeout);
+	while (!((status = cfi_get_u8(bank, 0, 0x0)) & 0x80))
 	{
 		LOG_DEBUG("status: 0x%x", status);
-		usleep(1000);
+		if (!deadline_wait(&deadline))
+			break;
 	}
 
 	/* mask out bit 0 (reserved) */
@@ -306,7 +328,9 @@ u8 cfi_intel_wait_status_busy(flash_bank_t *bank, int timeout)
 int cfi_spansion_wait_status_busy(flash_bank_t *bank, int timeout)
 {
 	u8 status, oldstatus;
+	deadline_t deadline;
 
+	deadline_start(&deadline, timeout);
 	oldstatus = cfi_get_u8(bank, 0, 0x0);
 
 	do {
@@ -329,8 +353,7 @@ int cfi_spansion_wait_status_busy(flash_bank_t *bank, int timeout)
 		}
 
 		oldstatus = status;
-		usleep(1000);
-	} while (timeout-- > 0);
+	} while (deadline_wait(&deadline));
 
 	LOG_ERROR("timeout, status: 0x%x", status);
 
@@ -673,7 +696,7 @@ int cfi_intel_erase(struct flash_bank_s *bank, int first, int last)
 		cfi_command(bank, 0xd0, command);
 		target->type->write_memory(target, flash_address(bank, i, 0x0), bank->bus_width, 1, command);
 
-		if (cfi_intel_wait_status_busy(bank, 1000 * (1 << cfi_info->block_erase_timeout_typ)) == 0x80)
+		if (cfi_intel_wait_status_busy(bank, CFI_BLOCK_ERASE_TIMEOUT(cfi_info)) == 0x80)
 			bank->sectors[i].is_erased = 1;
 		else
 		{
@@ -719,7 +742,7 @@ int cfi_spansion_erase(struct flash_bank_s *bank, int first, int last)
 		cfi_command(bank, 0x30, command);
 		target->type->write_memory(target, flash_address(bank, i, 0x0), bank->bus_width, 1, command);
 
-		if (cfi_spansion_wait_status_busy(bank, 1000 * (1 << cfi_info->block_erase_timeout_typ)) == ERROR_OK)
+		if (cfi_spansion_wait_status_busy(bank, CFI_BLOCK_ERASE_TIMEOUT(cfi_info)) == ERROR_OK)
 			bank->sectors[i].is_erased = 1;
 		else
 		{
@@ -812,7 +835,8 @@ int cfi_intel_protect(struct flash_bank_s *bank, int set, int first, int last)
 		if (!(pri_ext->feature_support & 0x20))
 		{
 			/* Clear lock bits operation may take up to 1.4s */
-			cfi_intel_wait_status_busy(bank, 1400);
+			if (cfi_intel_wait_status_busy(bank, 1400) != 0x80)
+				return ERROR_FLASH_OPERATION_FAILED;
 		}
 		else
 		{
@@ -1477,7 +1501,7 @@ int cfi_intel_write_word(struct flash_bank_s *bank, u8 *word, u32 address)
 
 	target->type->write_memory(target, address, bank->bus_width, 1, word);
 
-	if (cfi_intel_wait_status_busy(bank, 1000 * (1 << cfi_info->word_write_timeout_max)) != 0x80)
+	if (cfi_intel_wait_status_busy(bank, CFI_WORD_WRITE_TIMEOUT(cfi_info)) != 0x80)
 	{
 		cfi_command(bank, 0xff, command);
 		target->type->write_memory(target, flash_address(bank, 0, 0x0), bank->bus_width, 1, command);
@@ -1529,7 +1553,7 @@ int cfi_intel_write_words(struct flash_bank_s *bank, u8 *word, u32 wordcount, u3
 	/* Initiate buffer operation _*/
 	cfi_command(bank, 0xE8, command);
 	target->type->write_memory(target, address, bank->bus_width, 1, command);
-	if (cfi_intel_wait_status_busy(bank, 1000 * (1 << cfi_info->buf_write_timeout_max)) != 0x80)
+	if (cfi_intel_wait_status_busy(bank, CFI_BUF_WRITE_TIMEOUT(cfi_info)) != 0x80)
 	{
 		cfi_command(bank, 0xff, command);
 		target->type->write_memory(target, flash_address(bank, 0, 0x0), bank->bus_width, 1, command);
@@ -1547,7 +1571,7 @@ int cfi_intel_write_words(struct flash_bank_s *bank, u8 *word, u32 wordcount, u3
 	/* Commit write operation */
 	cfi_command(bank, 0xd0, command);
 	target->type->write_memory(target, address, bank->bus_width, 1, command);
-	if (cfi_intel_wait_status_busy(bank, 1000 * (1 << cfi_info->buf_write_timeout_max)) != 0x80)
+	if (cfi_intel_wait_status_busy(bank, CFI_BUF_WRITE_TIMEOUT(cfi_info)) != 0x80)
 	{
 		cfi_command(bank, 0xff, command);
 		target->type->write_memory(target, flash_address(bank, 0, 0x0), bank->bus_width, 1, command);
@@ -1577,7 +1601,7 @@ int cfi_spansion_write_word(struct flash_bank_s *bank, u8 *word, u32 address)
 
 	target->type->write_memory(target, address, bank->bus_width, 1, word);
 
-	if (cfi_spansion_wait_status_busy(bank, 1000 * (1 << cfi_info->word_write_timeout_max)) != ERROR_OK)
+	if (cfi_spansion_wait_status_busy(bank, CFI_WORD_WRITE_TIMEOUT(cfi_info)) != ERROR_OK)
 	{
 		cfi_command(bank, 0xf0, command);
 		target->type->write_memory(target, flash_address(bank, 0, 0x0), bank->bus_width, 1, command);
@@ -32,6 +32,7 @@
 #include "algorithm.h"
 #include "binarybuffer.h"
 #include "armv7m.h"
+#include "span.h"
 
 #include <string.h>
 #include <unistd.h>
@@ -93,11 +94,13 @@ flash_bank_t *flash_banks;
 static 	command_t *flash_cmd;
 
 /* wafer thin wrapper for invoking the flash driver */
-static int flash_driver_write(struct flash_bank_s *bank, u8 *buffer, u32 offset, u32 count)
+int flash_driver_write(struct flash_bank_s *bank, u8 *buffer, u32 offset, u32 count)
 {
+	long long span = span_begin();
 	int retval;
 
 	retval=bank->driver->write(bank, buffer, offset, count);
+	span_end_arg(span, "flash_driver_write", count);
 	if (retval!=ERROR_OK)
 	{
 		LOG_ERROR("error writing to flash at address 0x%08x at offset 0x%8.8x (%d)", bank->base, offset, retval);
@@ -106,11 +109,13 @@ static int flash_driver_write(struct flash_bank_s *bank, u8 *buffer, u32 offset,
 	return retval;
 }
 
-static int flash_driver_erase(struct flash_bank_s *bank, int first, int last)
+int flash_driver_erase(struct flash_bank_s *bank, int first, int last)
 {
+	long long span = span_begin();
 	int retval;
 
 	retval=bank->driver->erase(bank, first, last);
+	span_end_arg(span, "flash_driver_erase", last - first + 1);
 	if (retval!=ERROR_OK)
 	{
 		LOG_ERROR("failed erasing sectors %d to %d (%d)", first, last, retval);
@@ -605,6 +610,7 @@ int handle_flash_protect_command(struct command_context_s *cmd_ctx, char *cmd, c
 
 int handle_flash_write_image_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
 {
+	long long span;
 	target_t *target = get_current_target(cmd_ctx);
 
 	image_t image;
@@ -658,7 +664,9 @@ int handle_flash_write_image_command(struct command_context_s *cmd_ctx, char *cm
 
 	image.start_address_set = 0;
 
+	span = span_begin();
 	retval = image_open(&image, args[0], (argc == 3) ? args[2] : NULL);
+	span_end(span, "image_open");
 	if (retval != ERROR_OK)
 	{
 		return retval;
@@ -939,7 +947,7 @@ int flash_erase_address_range(target_t *target, u32 addr, u32 length)
 }
 
 /* write (optional verify) an image to flash memory of the given target */
-int flash_write(target_t *target, image_t *image, u32 *written, int erase)
+static int flash_write_image(target_t *target, image_t *image, u32 *written, int erase)
 {
 	int retval=ERROR_OK;
 
@@ -1062,11 +1070,24 @@ int flash_write(target_t *target, image_t *image, u32 *written, int erase)
 
 		if (written != NULL)
 			*written += run_size; /* add run size to total written counter */
+
+		command_yield();
 	}
 
 	return retval;
 }
 
+int flash_write(target_t *target, image_t *image, u32 *written, int erase)
+{
+	long long span = span_begin();
+	int retval;
+
+	retval = flash_write_image(target, image, written, erase);
+	span_end(span, "flash_write");
+
+	return retval;
+}
+
 int default_flash_blank_check(struct flash_bank_s *bank)
 {
 	target_t *target = bank->target;
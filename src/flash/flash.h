@@ -74,6 +74,9 @@ typedef struct flash_bank_s
 extern int flash_register_commands(struct command_context_s *cmd_ctx);
 extern int flash_init_drivers(struct command_context_s *cmd_ctx);
 
+/* wrappers for the driver calls that log errors */
+extern int flash_driver_erase(struct flash_bank_s *bank, int first, int last);
+extern int flash_driver_write(struct flash_bank_s *bank, u8 *buffer, u32 offset, u32 count);
 extern int flash_erase_address_range(target_t *target, u32 addr, u32 length);
 extern int flash_write(target_t *target, image_t *image, u32 *written, int erase);
 extern void flash_set_dirty(void);
@@ -40,6 +40,7 @@
 #include "log.h"
 #include "binarybuffer.h"
 #include "types.h"
+#include "time_support.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -50,6 +51,11 @@
 
 #define FLASH_PAGE_SIZE     512
 
+/* busy timeouts in ms: lpc288x_load_timer() programs about 400 ms per sector
+ * erase and 3.2 ms per page write at a 12 MHz AHB clock */
+#define LPC288X_ERASE_TIMEOUT   1000
+#define LPC288X_WRITE_TIMEOUT   100
+
 /* LPC288X control registers */
 #define DBGU_CIDR     0x8000507C
 /* LPC288X flash registers */
@@ -140,16 +146,19 @@ u32 lpc288x_wait_status_busy(flash_bank_t *bank, int timeout)
 {
     u32 status;
     target_t *target = bank->target;
+    deadline_t deadline;
+    int ready;
+
+    deadline_start(&deadline, timeout);
     do
     {
-        usleep(1000);
-        timeout--;
         target_read_u32(target, F_STAT, &status);
-    }while (((status & FS_DONE) == 0) && timeout);
+        ready = (status & FS_DONE) != 0;
+    }while (!ready && deadline_wait(&deadline));
 
-    if(timeout == 0)
+    if(!ready)
     {
-        LOG_DEBUG("Timedout!");
+        LOG_ERROR("timeout waiting for flash, status: 0x%x", status);
         return ERROR_FLASH_OPERATION_FAILED;
     }
     return ERROR_OK;
@@ -327,7 +336,7 @@ int lpc288x_erase(struct flash_bank_s *bank, int first, int last)
 
     for (sector = first; sector <= last; sector++)
     {
-        if (lpc288x_wait_status_busy(bank, 1000) != ERROR_OK)
+        if (lpc288x_wait_status_busy(bank, LPC288X_ERASE_TIMEOUT) != ERROR_OK)
         {
             return ERROR_FLASH_OPERATION_FAILED;
         }
@@ -344,7 +353,7 @@ int lpc288x_erase(struct flash_bank_s *bank, int first, int last)
                             FC_PROTECT    |
                             FC_CS);
     }
-    if (lpc288x_wait_status_busy(bank, 1000) != ERROR_OK)
+    if (lpc288x_wait_status_busy(bank, LPC288X_ERASE_TIMEOUT) != ERROR_OK)
     {
         return ERROR_FLASH_OPERATION_FAILED;
     }
@@ -430,7 +439,7 @@ int lpc288x_write(struct flash_bank_s *bank, u8 *buffer, u32 offset, u32 count)
             }
 
             /* Wait for flash to become ready */
-            if (lpc288x_wait_status_busy(bank, 1000) != ERROR_OK)
+            if (lpc288x_wait_status_busy(bank, LPC288X_WRITE_TIMEOUT) != ERROR_OK)
             {
                 return ERROR_FLASH_OPERATION_FAILED;
             }
@@ -35,6 +35,7 @@
 #include "log.h"
 #include "binarybuffer.h"
 #include "types.h"
+#include "time_support.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -406,12 +407,18 @@ void stellaris_set_flash_mode(flash_bank_t *bank,int mode)
 u32 stellaris_wait_status_busy(flash_bank_t *bank, u32 waitbits, int timeout)
 {
 	u32 status;
+	deadline_t deadline;
 	
 	/* Stellaris waits for cmdbit to clear */
-	while (((status = stellaris_get_flash_status(bank)) & waitbits) && (timeout-- > 0))
+	deadline_start(&deadline, timeout);
+	while ((status = stellaris_get_flash_status(bank)) & waitbits)
 	{
 		LOG_DEBUG("status: 0x%x", status);
-		usleep(1000);
+		if (!deadline_wait(&deadline))
+		{
+			LOG_ERROR("timeout waiting for flash, status: 0x%x", status);
+			break;
+		}
 	}
 	
 	/* Flash errors are reflected in the FLASH_CRIS register */
@@ -429,7 +436,7 @@ int stellaris_flash_command(struct flash_bank_s *bank,u8 cmd,u16 pagen)
 	target_write_u32(target, FLASH_CONTROL_BASE|FLASH_FMC, fmc);
 	LOG_DEBUG("Flash command: 0x%x", fmc);
 
-	if (stellaris_wait_status_busy(bank, cmd, 100)) 
+	if (stellaris_wait_status_busy(bank, cmd, (cmd & FMC_MERASE) ? STELLARIS_MASS_ERASE_TIMEOUT : STELLARIS_FLASH_TIMEOUT)) 
 	{
 		return ERROR_FLASH_OPERATION_FAILED;
 	}		
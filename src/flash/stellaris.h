@@ -93,4 +93,9 @@ typedef struct stellaris_flash_bank_s
 
 /* STELLARIS constants */
 
+/* command timeouts in ms: a word write takes up to 20us, a page erase up to
+ * 20ms and a mass erase up to 200ms (datasheet flash characteristics) */
+#define STELLARIS_FLASH_TIMEOUT			100
+#define STELLARIS_MASS_ERASE_TIMEOUT	500
+
 #endif /* STELLARIS_H */
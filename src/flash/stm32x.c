@@ -30,6 +30,7 @@
 #include "armv7m.h"
 #include "algorithm.h"
 #include "binarybuffer.h"
+#include "time_support.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -117,12 +118,18 @@ u32 stm32x_get_flash_status(flash_bank_t *bank)
 u32 stm32x_wait_status_busy(flash_bank_t *bank, int timeout)
 {
 	u32 status;
+	deadline_t deadline;
 	
-	/* wait for busy to clear */
-	while (((status = stm32x_get_flash_status(bank)) & FLASH_BSY) && (timeout-- > 0))
+	/* wait for busy to clear, still set after a timeout */
+	deadline_start(&deadline, timeout);
+	while ((status = stm32x_get_flash_status(bank)) & FLASH_BSY)
 	{
 		LOG_DEBUG("status: 0x%x", status);
-		usleep(1000);
+		if (!deadline_wait(&deadline))
+		{
+			LOG_ERROR("timeout waiting for flash, status: 0x%x", status);
+			break;
+		}
 	}
 	
 	return status;
@@ -179,8 +186,10 @@ int stm32x_erase_options(struct flash_bank_s *bank)
 	target_write_u32(target, STM32_FLASH_CR, FLASH_OPTER|FLASH_OPTWRE);
 	target_write_u32(target, STM32_FLASH_CR, FLASH_OPTER|FLASH_STRT|FLASH_OPTWRE);
 	
-	status = stm32x_wait_status_busy(bank, 10);
+	status = stm32x_wait_status_busy(bank, STM32_FLASH_ERASE_TIMEOUT);
 	
+	if( status & FLASH_BSY )
+		return ERROR_FLASH_OPERATION_FAILED;
 	if( status & FLASH_WRPRTERR )
 		return ERROR_FLASH_OPERATION_FAILED;
 	if( status & FLASH_PGERR )
@@ -215,8 +224,10 @@ int stm32x_write_options(struct flash_bank_s *bank)
 	/* write user option byte */
 	target_write_u16(target, STM32_OB_USER, stm32x_info->option_bytes.user_options);
 	
-	status = stm32x_wait_status_busy(bank, 10);
+	status = stm32x_wait_status_busy(bank, STM32_FLASH_WRITE_TIMEOUT);
 	
+	if( status & FLASH_BSY )
+		return ERROR_FLASH_OPERATION_FAILED;
 	if( status & FLASH_WRPRTERR )
 		return ERROR_FLASH_OPERATION_FAILED;
 	if( status & FLASH_PGERR )
@@ -225,8 +236,10 @@ int stm32x_write_options(struct flash_bank_s *bank)
 	/* write protection byte 1 */
 	target_write_u16(target, STM32_OB_WRP0, stm32x_info->option_bytes.protection[0]);
 	
-	status = stm32x_wait_status_busy(bank, 10);
+	status = stm32x_wait_status_busy(bank, STM32_FLASH_WRITE_TIMEOUT);
 	
+	if( status & FLASH_BSY )
+		return ERROR_FLASH_OPERATION_FAILED;
 	if( status & FLASH_WRPRTERR )
 		return ERROR_FLASH_OPERATION_FAILED;
 	if( status & FLASH_PGERR )
@@ -235,8 +248,10 @@ int stm32x_write_options(struct flash_bank_s *bank)
 	/* write protection byte 2 */
 	target_write_u16(target, STM32_OB_WRP1, stm32x_info->option_bytes.protection[1]);
 	
-	status = stm32x_wait_status_busy(bank, 10);
+	status = stm32x_wait_status_busy(bank, STM32_FLASH_WRITE_TIMEOUT);
 	
+	if( status & FLASH_BSY )
+		return ERROR_FLASH_OPERATION_FAILED;
 	if( status & FLASH_WRPRTERR )
 		return ERROR_FLASH_OPERATION_FAILED;
 	if( status & FLASH_PGERR )
@@ -245,8 +260,10 @@ int stm32x_write_options(struct flash_bank_s *bank)
 	/* write protection byte 3 */
 	target_write_u16(target, STM32_OB_WRP2, stm32x_info->option_bytes.protection[2]);
 	
-	status = stm32x_wait_status_busy(bank, 10);
+	status = stm32x_wait_status_busy(bank, STM32_FLASH_WRITE_TIMEOUT);
 	
+	if( status & FLASH_BSY )
+		return ERROR_FLASH_OPERATION_FAILED;
 	if( status & FLASH_WRPRTERR )
 		return ERROR_FLASH_OPERATION_FAILED;
 	if( status & FLASH_PGERR )
@@ -255,8 +272,10 @@ int stm32x_write_options(struct flash_bank_s *bank)
 	/* write protection byte 4 */
 	target_write_u16(target, STM32_OB_WRP3, stm32x_info->option_bytes.protection[3]);
 	
-	status = stm32x_wait_status_busy(bank, 10);
+	status = stm32x_wait_status_busy(bank, STM32_FLASH_WRITE_TIMEOUT);
 	
+	if( status & FLASH_BSY )
+		return ERROR_FLASH_OPERATION_FAILED;
 	if( status & FLASH_WRPRTERR )
 		return ERROR_FLASH_OPERATION_FAILED;
 	if( status & FLASH_PGERR )
@@ -265,8 +284,10 @@ int stm32x_write_options(struct flash_bank_s *bank)
 	/* write readout protection bit */
 	target_write_u16(target, STM32_OB_RDP, stm32x_info->option_bytes.RDP);
 	
-	status = stm32x_wait_status_busy(bank, 10);
+	status = stm32x_wait_status_busy(bank, STM32_FLASH_WRITE_TIMEOUT);
 	
+	if( status & FLASH_BSY )
+		return ERROR_FLASH_OPERATION_FAILED;
 	if( status & FLASH_WRPRTERR )
 		return ERROR_FLASH_OPERATION_FAILED;
 	if( status & FLASH_PGERR )
@@ -333,8 +354,10 @@ int stm32x_erase(struct flash_bank_s *bank, int first, int last)
 		target_write_u32(target, STM32_FLASH_AR, bank->base + bank->sectors[i].offset);
 		target_write_u32(target, STM32_FLASH_CR, FLASH_PER|FLASH_STRT);
 		
-		status = stm32x_wait_status_busy(bank, 10);
+		status = stm32x_wait_status_busy(bank, STM32_FLASH_ERASE_TIMEOUT);
 		
+		if( status & FLASH_BSY )
+			return ERROR_FLASH_OPERATION_FAILED;
 		if( status & FLASH_WRPRTERR )
 			return ERROR_FLASH_OPERATION_FAILED;
 		if( status & FLASH_PGERR )
@@ -561,8 +584,10 @@ int stm32x_write(struct flash_bank_s *bank, u8 *buffer, u32 offset, u32 count)
 		target_write_u32(target, STM32_FLASH_CR, FLASH_PG);
 		target_write_u16(target, address, *(u16*)(buffer + bytes_written));
 		
-		status = stm32x_wait_status_busy(bank, 5);
+		status = stm32x_wait_status_busy(bank, STM32_FLASH_WRITE_TIMEOUT);
 		
+		if( status & FLASH_BSY )
+			return ERROR_FLASH_OPERATION_FAILED;
 		if( status & FLASH_WRPRTERR )
 			return ERROR_FLASH_OPERATION_FAILED;
 		if( status & FLASH_PGERR )
@@ -588,8 +613,10 @@ int stm32x_write(struct flash_bank_s *bank, u8 *buffer, u32 offset, u32 count)
 		target_write_u32(target, STM32_FLASH_CR, FLASH_PG);
 		target_write_u16(target, address, *(u16*)last_halfword);
 		
-		status = stm32x_wait_status_busy(bank, 5);
+		status = stm32x_wait_status_busy(bank, STM32_FLASH_WRITE_TIMEOUT);
 		
+		if( status & FLASH_BSY )
+			return ERROR_FLASH_OPERATION_FAILED;
 		if( status & FLASH_WRPRTERR )
 			return ERROR_FLASH_OPERATION_FAILED;
 		if( status & FLASH_PGERR )
@@ -944,10 +971,16 @@ int stm32x_handle_mass_erase_command(struct command_context_s *cmd_ctx, char *cm
 	target_write_u32(target, STM32_FLASH_CR, FLASH_MER);
 	target_write_u32(target, STM32_FLASH_CR, FLASH_MER|FLASH_STRT);
 	
-	status = stm32x_wait_status_busy(bank, 10);
+	status = stm32x_wait_status_busy(bank, STM32_FLASH_ERASE_TIMEOUT);
 	
 	target_write_u32(target, STM32_FLASH_CR, FLASH_LOCK);
 	
+	if( status & FLASH_BSY )
+	{
+		command_print(cmd_ctx, "stm32x mass erase timed out");
+		return ERROR_OK;
+	}
+	
 	if( status & FLASH_WRPRTERR )
 	{
 		command_print(cmd_ctx, "stm32x device protected");
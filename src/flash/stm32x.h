@@ -77,6 +77,12 @@ typedef struct stm32x_flash_bank_s
 #define FLASH_WRPRTERR	(1<<4)
 #define FLASH_EOP		(1<<5)
 
+/* timeouts in ms: programming a half-word takes up to 70us, page, mass and
+ * option byte erase up to 40ms (datasheet flash memory characteristics) */
+
+#define STM32_FLASH_WRITE_TIMEOUT	5
+#define STM32_FLASH_ERASE_TIMEOUT	100
+
 /* STM32_FLASH_OBR bit definitions (reading) */
 
 #define OPT_ERROR		0
@@ -30,6 +30,7 @@
 #include "armv4_5.h"
 #include "algorithm.h"
 #include "binarybuffer.h"
+#include "time_support.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -217,6 +218,26 @@ u32 str7x_result(struct flash_bank_s *bank)
 	return retval;
 }
 
+/* wait up to timeout ms for the busy bits to clear */
+int str7x_waitbusy(struct flash_bank_s *bank, int timeout)
+{
+	str7x_flash_bank_t *str7x_info = bank->driver_priv;
+	deadline_t deadline;
+	u32 status;
+
+	deadline_start(&deadline, timeout);
+	while ((status = str7x_status(bank)) & str7x_info->busy_bits)
+	{
+		if (!deadline_wait(&deadline))
+		{
+			LOG_ERROR("timeout waiting for flash, FLASH_CR0: 0x%x", status);
+			return ERROR_FLASH_BUSY;
+		}
+	}
+
+	return ERROR_OK;
+}
+
 int str7x_protect_check(struct flash_bank_s *bank)
 {
 	str7x_flash_bank_t *str7x_info = bank->driver_priv;
@@ -277,9 +298,8 @@ int str7x_erase(struct flash_bank_s *bank, int first, int last)
 	cmd = FLASH_SER|FLASH_WMS;
 	target_write_u32(target, str7x_get_flash_adr(bank, FLASH_CR0), cmd);
 	
-	while (((retval = str7x_status(bank)) & str7x_info->busy_bits)){
-		usleep(1000);
-	}
+	if (str7x_waitbusy(bank, (last - first + 1) * STR7X_SECTOR_ERASE_TIMEOUT) != ERROR_OK)
+		return ERROR_FLASH_OPERATION_FAILED;
 	
 	retval = str7x_result(bank);
 	
@@ -332,9 +352,8 @@ int str7x_protect(struct flash_bank_s *bank, int set, int first, int last)
 	cmd = FLASH_SPR|FLASH_WMS;
 	target_write_u32(target, str7x_get_flash_adr(bank, FLASH_CR0), cmd);
 	
-	while (((retval = str7x_status(bank)) & str7x_info->busy_bits)){
-		usleep(1000);
-	}
+	if (str7x_waitbusy(bank, STR7X_WRITE_TIMEOUT) != ERROR_OK)
+		return ERROR_FLASH_OPERATION_FAILED;
 	
 	retval = str7x_result(bank);
 	
@@ -465,7 +484,6 @@ int str7x_write_block(struct flash_bank_s *bank, u8 *buffer, u32 offset, u32 cou
 int str7x_write(struct flash_bank_s *bank, u8 *buffer, u32 offset, u32 count)
 {
 	target_t *target = bank->target;
-	str7x_flash_bank_t *str7x_info = bank->driver_priv;
 	u32 dwords_remaining = (count / 8);
 	u32 bytes_remaining = (count & 0x00000007);
 	u32 address = bank->base + offset;
@@ -558,10 +576,8 @@ int str7x_write(struct flash_bank_s *bank, u8 *buffer, u32 offset, u32 count)
 		cmd = FLASH_DWPG | FLASH_WMS;
 		target_write_u32(target, str7x_get_flash_adr(bank, FLASH_CR0), cmd);
 		
-		while (((retval = str7x_status(bank)) & str7x_info->busy_bits))
-		{
-			usleep(1000);
-		}
+		if (str7x_waitbusy(bank, STR7X_WRITE_TIMEOUT) != ERROR_OK)
+			return ERROR_FLASH_OPERATION_FAILED;
 		
 		retval = str7x_result(bank);
 		
@@ -605,10 +621,8 @@ int str7x_write(struct flash_bank_s *bank, u8 *buffer, u32 offset, u32 count)
 		cmd = FLASH_DWPG | FLASH_WMS;
 		target_write_u32(target, str7x_get_flash_adr(bank, FLASH_CR0), cmd);
 		
-		while (((retval = str7x_status(bank)) & str7x_info->busy_bits))
-		{
-			usleep(1000);
-		}
+		if (str7x_waitbusy(bank, STR7X_WRITE_TIMEOUT) != ERROR_OK)
+			return ERROR_FLASH_OPERATION_FAILED;
 		
 		retval = str7x_result(bank);
 		
@@ -99,6 +99,13 @@ enum str7x_status_codes
 #define FLASH_ERER		0x00000002
 #define FLASH_ERR		0x00000001
 
+/* busy timeouts in ms: programming a double word or the protection register
+ * takes tens of us, erasing a 64K sector around a second; erase commands
+ * cover several sectors, their timeout is per sector */
+
+#define STR7X_WRITE_TIMEOUT			10
+#define STR7X_SECTOR_ERASE_TIMEOUT	4000
+
 typedef struct str7x_mem_layout_s {
 	u32 sector_start;
 	u32 sector_size;
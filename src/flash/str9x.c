@@ -31,6 +31,7 @@
 #include "arm966e.h"
 #include "algorithm.h"
 #include "binarybuffer.h"
+#include "time_support.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -230,6 +231,28 @@ int str9x_protect_check(struct flash_bank_s *bank)
 	return ERROR_OK;
 }
 
+/* poll the status register until the operation finished, returns the last
+ * status read, bit 7 (ready) is still clear after timeout ms */
+u8 str9x_wait_status_busy(target_t *target, u32 adr, int timeout)
+{
+	deadline_t deadline;
+	u8 status;
+
+	deadline_start(&deadline, timeout);
+	while (1) {
+		target_read_u8(target, adr, &status);
+		if( status & 0x80 )
+			break;
+		if (!deadline_wait(&deadline))
+		{
+			LOG_ERROR("timeout waiting for flash, status: 0x%x", status);
+			break;
+		}
+	}
+
+	return status;
+}
+
 int str9x_erase(struct flash_bank_s *bank, int first, int last)
 {
 	target_t *target = bank->target;
@@ -253,12 +276,7 @@ int str9x_erase(struct flash_bank_s *bank, int first, int last)
 		/* get status */
 		target_write_u16(target, adr, 0x70);
 		
-		while (1) {
-			target_read_u8(target, adr, &status);
-			if( status & 0x80 )
-				break;
-			usleep(1000);
-		}
+		status = str9x_wait_status_busy(target, adr, STR9X_SECTOR_ERASE_TIMEOUT);
 		
 		/* clear status, also clear read array */
 		target_write_u16(target, adr, 0x50);
@@ -266,7 +284,7 @@ int str9x_erase(struct flash_bank_s *bank, int first, int last)
 		/* read array command */
 		target_write_u16(target, adr, 0xFF);
 		
-		if( status & 0x22 )
+		if( (status & 0x22) || !(status & 0x80) )
 		{
 			LOG_ERROR("error erasing flash bank, status: 0x%x", status);
 			return ERROR_FLASH_OPERATION_FAILED;
@@ -504,18 +522,15 @@ int str9x_write(struct flash_bank_s *bank, u8 *buffer, u32 offset, u32 count)
 		/* get status command */
 		target_write_u16(target, bank_adr, 0x70);
 		
-		while (1) {
-			target_read_u8(target, bank_adr, &status);
-			if( status & 0x80 )
-				break;
-			usleep(1000);
-		}
+		status = str9x_wait_status_busy(target, bank_adr, STR9X_WRITE_TIMEOUT);
 		
 		/* clear status reg and read array */
 		target_write_u16(target, bank_adr, 0x50);
 		target_write_u16(target, bank_adr, 0xFF);
 		
-		if (status & 0x10)
+		if (!(status & 0x80))
+			return ERROR_FLASH_OPERATION_FAILED;
+		else if (status & 0x10)
 			return ERROR_FLASH_OPERATION_FAILED;
 		else if (status & 0x02)
 			return ERROR_FLASH_OPERATION_FAILED;
@@ -546,18 +561,15 @@ int str9x_write(struct flash_bank_s *bank, u8 *buffer, u32 offset, u32 count)
 		/* query status command */
 		target_write_u16(target, bank_adr, 0x70);
 		
-		while (1) {
-			target_read_u8(target, bank_adr, &status);
-			if( status & 0x80 )
-				break;
-			usleep(1000);
-		}
+		status = str9x_wait_status_busy(target, bank_adr, STR9X_WRITE_TIMEOUT);
 		
 		/* clear status reg and read array */
 		target_write_u16(target, bank_adr, 0x50);
 		target_write_u16(target, bank_adr, 0xFF);
 		
-		if (status & 0x10)
+		if (!(status & 0x80))
+			return ERROR_FLASH_OPERATION_FAILED;
+		else if (status & 0x10)
 			return ERROR_FLASH_OPERATION_FAILED;
 		else if (status & 0x02)
 			return ERROR_FLASH_OPERATION_FAILED;
@@ -57,5 +57,10 @@ enum str9x_status_codes
 #define FLASH_SR		0x5400001C		/* Status Register                        */
 #define FLASH_BCE5ADDR	0x54000020		/* BC Fifth Entry Target Address Register */
 
+/* status register timeouts in ms: programming a half-word takes tens of us,
+ * erasing a 64K sector around a second */
+#define STR9X_WRITE_TIMEOUT			10
+#define STR9X_SECTOR_ERASE_TIMEOUT	4000
+
 #endif /* STR9X_H */
 
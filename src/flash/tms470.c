@@ -23,6 +23,7 @@
 
 #include "log.h"
 #include "tms470.h"
+#include "time_support.h"
 #include <string.h>
 #include <unistd.h>
 
@@ -354,6 +355,7 @@ int tms470_try_flash_keys(target_t * target, const u32 * key_set)
 {
 	u32 glbctrl, fmmstat;
 	int retval = ERROR_FLASH_OPERATION_FAILED;
+	deadline_t deadline;
 
 	/* set GLBCTRL.4  */
 	target_read_u32(target, 0xFFFFFFDC, &glbctrl);
@@ -369,12 +371,16 @@ int tms470_try_flash_keys(target_t * target, const u32 * key_set)
 		target_write_u32(target, 0xFFE8BC04, fmmstat & ~0x07);
 
 		/* wait for pump ready */
+		deadline_start(&deadline, TMS470_PUMP_READY_TIMEOUT);
 		do
 		{
 			target_read_u32(target, 0xFFE8A814, &fmbptr);
-			usleep(1000);
 		}
-		while (!(fmbptr & 0x0200));
+		while (!(fmbptr & 0x0200) && deadline_wait(&deadline));
+
+		/* the key match below fails then */
+		if (!(fmbptr & 0x0200))
+			LOG_ERROR("timeout waiting for flash pump ready, fmbptr=0x%08x", fmbptr);
 
 		/* force max wait states */
 		target_read_u32(target, 0xFFE88004, &fmbac2);
@@ -665,6 +671,7 @@ int tms470_erase_sector(struct flash_bank_s *bank, int sector)
 	target_t *target = bank->target;
 	u32 flashAddr = bank->base + bank->sectors[sector].offset;
 	int result = ERROR_OK;
+	deadline_t deadline;
 
 	/* 
 	 * Set the bit GLBCTRL4 of the GLBCTRL register (in the System
@@ -713,17 +720,20 @@ int tms470_erase_sector(struct flash_bank_s *bank, int sector)
 	 * Monitor FMMSTAT, busy until clear, then check and other flags for
 	 * ultimate result of the operation.
 	 */
+	deadline_start(&deadline, TMS470_SECTOR_ERASE_TIMEOUT);
 	do
 	{
 		target_read_u32(target, 0xFFE8BC0C, &fmmstat);
-		if (fmmstat & 0x0100)
-		{
-			usleep(1000);
-		}
 	}
-	while (fmmstat & 0x0100);
+	while ((fmmstat & 0x0100) && deadline_wait(&deadline));
 
-	result = tms470_flash_status(bank);
+	if (fmmstat & 0x0100)
+	{
+		LOG_ERROR("timeout erasing sector %d, fmmstat=0x%04x", sector, fmmstat);
+		result = ERROR_FLASH_OPERATION_FAILED;
+	}
+	else
+		result = tms470_flash_status(bank);
 
 	if (sector < 16)
 	{
@@ -869,6 +879,7 @@ int tms470_write(struct flash_bank_s *bank, u8 * buffer, u32 offset, u32 count)
 	target_t *target = bank->target;
 	u32 glbctrl, fmbac2, orig_fmregopt, fmbsea, fmbseb, fmmaxpp, fmmstat;
 	int i, result = ERROR_OK;
+	deadline_t deadline;
 
 	if (target->state != TARGET_HALTED)
 	{
@@ -924,16 +935,14 @@ int tms470_write(struct flash_bank_s *bank, u8 * buffer, u32 offset, u32 count)
 			 * Monitor FMMSTAT, busy until clear, then check and other flags
 			 * for ultimate result of the operation.
 			 */
+			deadline_start(&deadline, TMS470_WRITE_TIMEOUT);
 			do
 			{
 				target_read_u32(target, 0xFFE8BC0C, &fmmstat);
-				if (fmmstat & 0x0100)
-				{
-					usleep(1000);
-				}
 			}
-			while (fmmstat & 0x0100);
+			while ((fmmstat & 0x0100) && deadline_wait(&deadline));
 
+			/* still busy (0x0100) after the timeout fails too */
 			if (fmmstat & 0x3ff)
 			{
 				LOG_ERROR("fmstat=0x%04x", fmmstat);
@@ -22,6 +22,13 @@
 
 #include "flash.h"
 
+/* busy timeouts in ms: the flash pump starts within a ms and a word is
+ * programmed in well under one, while a sector erase runs the controller's
+ * precondition, erase and compaction steps and takes seconds */
+#define TMS470_PUMP_READY_TIMEOUT	100
+#define TMS470_WRITE_TIMEOUT		100
+#define TMS470_SECTOR_ERASE_TIMEOUT	20000
+
 typedef struct tms470_flash_bank_s
 {
 	unsigned ordinal;
@@ -40,46 +40,90 @@
 
 int fast_and_dangerous = 0;
 
+static void (*command_yield_handler)(void) = NULL;
+
 void command_print_help_line(command_context_t* context, struct command_s *command, int indent);
+int find_and_run_command(command_context_t *context, command_t *commands, char *words[], int num_words, int start_word);
 
 int handle_sleep_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
 int handle_time_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
 int handle_fast_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
 
+typedef struct command_sort_s
+{
+	command_t *command;
+	int pos;
+} command_sort_t;
+
+static int command_sort_compare(const void *a, const void *b)
+{
+	const command_sort_t *x = a, *y = b;
+	int diff = strcmp(x->command->name, y->command->name);
+
+	return diff ? diff : x->pos - y->pos;
+}
+
+static int common_prefix_len(const char *a, const char *b)
+{
+	int len = 0;
+
+	while (a[len] && (a[len] == b[len]))
+		len++;
+
+	return len;
+}
+
+/* The number of characters required to uniquely identify a command is one
+ * more than its longest common prefix with any sibling. Once the siblings are
+ * sorted by name, that sibling is a neighbour. */
 int build_unique_lengths(command_context_t *context, command_t *commands)
 {
-	command_t *c, *p;
+	command_sort_t *sorted;
+	command_t *c;
+	int count = 0;
+	int i;
 
-	/* iterate through all commands */
 	for (c = commands; c; c = c->next)
+		count++;
+
+	if (count == 0)
+		return ERROR_OK;
+
+	if ((sorted = malloc(count * sizeof(command_sort_t))) == NULL)
+		return ERROR_FAIL;
+
+	for (c = commands, i = 0; c; c = c->next, i++)
 	{
-		/* find out how many characters are required to uniquely identify a command */
-		for (c->unique_len = 1; c->unique_len <= strlen(c->name); c->unique_len++)
+		sorted[i].command = c;
+		sorted[i].pos = i;
+	}
+	qsort(sorted, count, sizeof(command_sort_t), command_sort_compare);
+
+	for (i = 0; i < count; i++)
+	{
+		int prefix = 0;
+
+		if (i > 0)
+			prefix = common_prefix_len(sorted[i].command->name, sorted[i - 1].command->name);
+		if (i < count - 1)
 		{
-			int foundmatch = 0;
-			
-			/* for every command, see if the current length is enough */
-			for (p = commands; p; p = p->next)
-			{
-				/* ignore the command itself */
-				if (c == p)
-					continue;
-				
-				/* compare commands up to the current length */
-				if (strncmp(p->name, c->name, c->unique_len) == 0)
-					foundmatch++;
-			}
-			
-			/* when none of the commands matched, we've found the minimum length required */
-			if (!foundmatch)
-				break;
+			int next = common_prefix_len(sorted[i].command->name, sorted[i + 1].command->name);
+			if (next > prefix)
+				prefix = next;
 		}
-		
-		/* if the current command has children, build the unique lengths for them */
+
+		sorted[i].command->unique_len = prefix + 1;
+	}
+
+	free(sorted);
+
+	/* if the current command has children, build the unique lengths for them */
+	for (c = commands; c; c = c->next)
+	{
 		if (c->children)
 			build_unique_lengths(context, c->children);
 	}
-	
+
 	return ERROR_OK;
 }
 
@@ -88,6 +132,85 @@ int build_unique_lengths(command_context_t *context, command_t *commands)
  */
 static int unique_length_dirty = 1; 
 
+/* Full command names are looked up in a hash of (parent, name), only
+ * abbreviations walk the list of siblings. The hash is rebuilt together
+ * with the unique lengths. */
+static command_t **command_hash = NULL;
+static unsigned int command_hash_size = 0;
+static command_t *command_hash_root = NULL;
+
+static unsigned int command_hash_key(command_t *parent, const char *name)
+{
+	/* FNV-1a of the lower case name */
+	unsigned int hash = 2166136261u ^ (unsigned int)((unsigned long)parent >> 4);
+
+	while (*name)
+	{
+		hash ^= (unsigned char)tolower(*name++);
+		hash *= 16777619u;
+	}
+
+	return hash & (command_hash_size - 1);
+}
+
+static int command_hash_count(command_t *commands)
+{
+	command_t *c;
+	int count = 0;
+
+	for (c = commands; c; c = c->next)
+		count += 1 + command_hash_count(c->children);
+
+	return count;
+}
+
+static void command_hash_insert(command_t *commands)
+{
+	command_t *c, **p;
+
+	for (c = commands; c; c = c->next)
+	{
+		/* append, so commands registered twice are tried in registration order */
+		for (p = &command_hash[command_hash_key(c->parent, c->name)]; *p; p = &(*p)->hash_next);
+		*p = c;
+		c->hash_next = NULL;
+
+		command_hash_insert(c->children);
+	}
+}
+
+static void command_hash_build(command_context_t *context)
+{
+	unsigned int size = 64;
+	int count = command_hash_count(context->commands);
+
+	while (size < 2 * count)
+		size *= 2;
+
+	free(command_hash);
+	command_hash = calloc(size, sizeof(command_t *));
+	command_hash_size = command_hash ? size : 0;
+	command_hash_root = context->commands;
+
+	if (command_hash)
+		command_hash_insert(context->commands);
+}
+
+static command_t *command_hash_find(command_t *c, command_t *parent, const char *name)
+{
+	if (command_hash == NULL)
+		return NULL;
+
+	/* start at the bucket, or continue after the previous match */
+	for (c = c ? c->hash_next : command_hash[command_hash_key(parent, name)]; c; c = c->hash_next)
+	{
+		if ((c->parent == parent) && (strcasecmp(c->name, name) == 0))
+			return c;
+	}
+
+	return NULL;
+}
+
 command_t* register_command(command_context_t *context, command_t *parent, char *name, int (*handler)(struct command_context_s *context, char* name, char** args, int argc), enum command_mode mode, char *help)
 {
 	command_t *c, *p;
@@ -109,6 +232,7 @@ command_t* register_command(command_context_t *context, command_t *parent, char
 		c->help = NULL;
 	c->unique_len = 0;
 	c->next = NULL;
+	c->hash_next = NULL;
 	
 	/* place command in tree */
 	if (parent)
@@ -232,7 +356,10 @@ int unregister_command(command_context_t *context, char *name)
 	return ERROR_OK;
 }
 
-int parse_line(char *line, char *words[], int max_words)
+/* The words are copied to arena, which must hold at least strlen(line) + 1
+ * bytes: every word is followed by a separator, quote or the end of line,
+ * which leaves room for its terminating NUL. */
+int parse_line(char *line, char *words[], int max_words, char *arena)
 {
 	int nwords = 0;
 	char *p = line;
@@ -264,9 +391,10 @@ int parse_line(char *line, char *words[], int max_words)
 				if (len>0)
 				{
 					/* copy the word */
-					memcpy(words[nwords] = malloc(len + 1), word_start, len);
+					memcpy(words[nwords] = arena, word_start, len);
 					/* add terminating NUL */
 					words[nwords++][len] = 0;
+					arena += len + 1;
 				}
 			}
 			/* we're done parsing the line */
@@ -337,19 +465,80 @@ void command_print(command_context_t *context, char *format, ...)
 	va_end(ap);
 }
 
+static int command_mode_allowed(command_context_t *context, command_t *c)
+{
+	return (context->mode == COMMAND_CONFIG) || (c->mode == COMMAND_ANY) || (c->mode == context->mode);
+}
+
+static int command_invoke(command_context_t *context, command_t *c, char *words[], int num_words, int start_word)
+{
+	if (!c->children)
+	{
+		if (!c->handler)
+		{
+			command_print(context, "No handler for command");
+		}
+		else
+		{
+			int retval = c->handler(context, c->name, words + start_word + 1, num_words - start_word - 1);
+			if (retval == ERROR_COMMAND_SYNTAX_ERROR)
+			{
+				command_print(context, "Syntax error:");
+				command_print_help_line(context, c, 0);
+			} else if (retval != ERROR_OK)
+			{
+				/* we do not print out an error message because the command *should*
+				 * have printed out an error
+				 */
+				LOG_DEBUG("Command failed with error code %d", retval); 
+			}
+			return retval; 
+		}
+	}
+	else
+	{
+		if (start_word == num_words - 1)
+		{
+			command_print(context, "Incomplete command");
+		}
+		else
+			return find_and_run_command(context, c->children, words, num_words, start_word + 1);
+	}
+	
+	command_print(context, "Command %s not found", words[start_word]);
+	return ERROR_COMMAND_SYNTAX_ERROR;
+}
+
 int find_and_run_command(command_context_t *context, command_t *commands, char *words[], int num_words, int start_word)
 {
 	command_t *c;
 	int retval = ERROR_COMMAND_SYNTAX_ERROR;
+	int exact = 0;
 	
-	if (unique_length_dirty)
+	if (unique_length_dirty || (command_hash_root != context->commands))
 	{
 		unique_length_dirty = 0;
 		/* update unique lengths */
 		build_unique_lengths(context, context->commands);
+		command_hash_build(context);
 	}
 	
-	for (c = commands; c; c = c->next)
+	if (commands == NULL)
+	{
+		command_print(context, "Command %s not found", words[start_word]);
+		return retval;
+	}
+	
+	/* a full name can't be the abbreviation of another command */
+	for (c = command_hash_find(NULL, commands->parent, words[start_word]); c;
+			c = command_hash_find(c, commands->parent, words[start_word]))
+	{
+		exact = 1;
+		if (command_mode_allowed(context, c))
+			return command_invoke(context, c, words, num_words, start_word);
+	}
+	
+	for (c = commands; c && !exact; c = c->next)
 	{
 		if (strncasecmp(c->name, words[start_word], c->unique_len))
 			continue;
@@ -357,43 +546,8 @@ int find_and_run_command(command_context_t *context, command_t *commands, char *
 		if (strncasecmp(c->name, words[start_word], strlen(words[start_word])))
 			continue;
 		
-		if ((context->mode == COMMAND_CONFIG) || (c->mode == COMMAND_ANY) || (c->mode == context->mode) )
-		{
-			if (!c->children)
-			{
-				if (!c->handler)
-				{
-					command_print(context, "No handler for command");
-					retval = ERROR_COMMAND_SYNTAX_ERROR;
-					break;
-				}
-				else
-				{
-					int retval = c->handler(context, c->name, words + start_word + 1, num_words - start_word - 1);
-					if (retval == ERROR_COMMAND_SYNTAX_ERROR)
-					{
-						command_print(context, "Syntax error:");
-						command_print_help_line(context, c, 0);
-					} else if (retval != ERROR_OK)
-					{
-						/* we do not print out an error message because the command *should*
-						 * have printed out an error
-						 */
-						LOG_DEBUG("Command failed with error code %d", retval); 
-					}
-					return retval; 
-				}
-			}
-			else
-			{
-				if (start_word == num_words - 1)
-				{
-					command_print(context, "Incomplete command");
-					break;
-				}
-				return find_and_run_command(context, c->children, words, num_words, start_word + 1);
-			}
-		}
+		if (command_mode_allowed(context, c))
+			return command_invoke(context, c, words, num_words, start_word);
 	}
 	
 	command_print(context, "Command %s not found", words[start_word]);
@@ -404,8 +558,9 @@ int command_run_line(command_context_t *context, char *line)
 {
 	int nwords;
 	char *words[128] = {0};
+	char arena_buf[256];
+	char *arena = arena_buf;
 	int retval;
-	int i;
 	
 	if ((!context) || (!line))
 		return ERROR_INVALID_ARGUMENTS;
@@ -424,19 +579,57 @@ int command_run_line(command_context_t *context, char *line)
 	
 	LOG_DEBUG("%s", line);
 
-	nwords = parse_line(line, words, sizeof(words) / sizeof(words[0]));
+	/* all words of the line share one buffer */
+	if (strlen(line) >= sizeof(arena_buf))
+	{
+		if ((arena = malloc(strlen(line) + 1)) == NULL)
+			return ERROR_FAIL;
+	}
+
+	nwords = parse_line(line, words, sizeof(words) / sizeof(words[0]), arena);
 	
 	if (nwords > 0)
 		retval = find_and_run_command(context, context->commands, words, nwords, 0);
 	else
-		return ERROR_INVALID_ARGUMENTS;
+		retval = ERROR_INVALID_ARGUMENTS;
 	
-	for (i = 0; i < nwords; i++)
-		free(words[i]);
+	if (arena != arena_buf)
+		free(arena);
 	
 	return retval;
 }
 
+/* Strip comments and surrounding whitespace from a line read from a script
+ * file. Returns NULL if nothing remains. */
+static char *command_file_line(char *buffer)
+{
+	char *p;
+	char *cmd, *end;
+	
+	/* stop processing line after a comment (#, !) or a LF, CR were encountered */
+	if ((p = strpbrk(buffer, "#!\r\n")))
+		*p = 0;
+
+	/* skip over leading whitespace */
+	cmd = buffer;
+	while (isspace(*cmd))
+		cmd++;
+
+	/* empty (all whitespace) line? */
+	if (!*cmd)
+		return NULL;
+	
+	/* search the end of the current line, ignore trailing whitespace */
+	for (p = end = cmd; *p; p++)
+		if (!isspace(*p))
+			end = p;
+	
+	/* terminate end */
+	*++end = 0;
+	
+	return cmd;
+}
+
 int command_run_file(command_context_t *context, FILE *file, enum command_mode mode)
 {
 	int retval = ERROR_OK;
@@ -452,29 +645,11 @@ int command_run_file(command_context_t *context, FILE *file, enum command_mode m
 	
 	while (fgets(buffer, 4096, file))
 	{
-		char *p;
-		char *cmd, *end;
+		char *cmd;
 		
-		/* stop processing line after a comment (#, !) or a LF, CR were encountered */
-		if ((p = strpbrk(buffer, "#!\r\n")))
-			*p = 0;
-
-		/* skip over leading whitespace */
-		cmd = buffer;
-		while (isspace(*cmd))
-			cmd++;
-
-		/* empty (all whitespace) line? */
-		if (!*cmd)
+		if ((cmd = command_file_line(buffer)) == NULL)
 			continue;
 		
-		/* search the end of the current line, ignore trailing whitespace */
-		for (p = end = cmd; *p; p++)
-			if (!isspace(*p))
-				end = p;
-		
-		/* terminate end */
-		*++end = 0;
 		if (strcasecmp(cmd, "quit") == 0)
 			break;
 
@@ -491,6 +666,165 @@ int command_run_file(command_context_t *context, FILE *file, enum command_mode m
 	return retval;
 }
 
+typedef struct command_script_line_s
+{
+	char *text;		/* the line as read, for the debug log */
+	char *words;	/* the words, each NUL terminated */
+	int size;		/* bytes used by words */
+	int num_words;
+} command_script_line_t;
+
+struct command_script_s
+{
+	command_script_line_t *lines;
+	int num_lines;
+	int max_size;
+};
+
+/* Read and tokenize a script the way command_run_file() would run it */
+command_script_t* command_script_compile(FILE *file)
+{
+	command_script_t *script;
+	char *buffer;
+	char *words[128];
+	int size = 0;
+
+	script = malloc(sizeof(command_script_t));
+	buffer = malloc(4096);
+	if ((script == NULL) || (buffer == NULL))
+	{
+		free(script);
+		free(buffer);
+		return NULL;
+	}
+
+	script->lines = NULL;
+	script->num_lines = 0;
+	script->max_size = 0;
+
+	while (fgets(buffer, 4096, file))
+	{
+		command_script_line_t *line;
+		char *cmd;
+		int num_words;
+
+		if ((cmd = command_file_line(buffer)) == NULL)
+			continue;
+
+		if (strcasecmp(cmd, "quit") == 0)
+			break;
+
+		/* same as command_run_line() */
+		if (cmd[0] == '#')
+			continue;
+
+		if (script->num_lines == size)
+		{
+			command_script_line_t *lines;
+			size = size ? size * 2 : 64;
+			if ((lines = realloc(script->lines, size * sizeof(command_script_line_t))) == NULL)
+				goto error;
+			script->lines = lines;
+		}
+
+		line = &script->lines[script->num_lines];
+		line->text = strdup(cmd);
+		line->words = malloc(strlen(cmd) + 1);
+		if ((line->text == NULL) || (line->words == NULL))
+		{
+			free(line->text);
+			free(line->words);
+			goto error;
+		}
+
+		num_words = parse_line(cmd, words, sizeof(words) / sizeof(words[0]), line->words);
+		if (num_words == 0)
+		{
+			free(line->text);
+			free(line->words);
+			continue;
+		}
+
+		line->num_words = num_words;
+		line->size = words[num_words - 1] + strlen(words[num_words - 1]) + 1 - line->words;
+		if (line->size > script->max_size)
+			script->max_size = line->size;
+
+		script->num_lines++;
+	}
+
+	free(buffer);
+
+	return script;
+
+error:
+	/* a script missing lines must not run */
+	free(buffer);
+	command_script_free(script);
+
+	return NULL;
+}
+
+/* Run a compiled script in the current command mode. Handlers get a fresh
+ * copy of the words of every line, they may modify their arguments. */
+int command_script_run(command_context_t *context, command_script_t *script)
+{
+	int retval = ERROR_OK;
+	char *words[128];
+	char *copy;
+	int i;
+
+	if (script->num_lines == 0)
+		return ERROR_OK;
+
+	if ((copy = malloc(script->max_size)) == NULL)
+		return ERROR_FAIL;
+
+	for (i = 0; i < script->num_lines; i++)
+	{
+		command_script_line_t *line = &script->lines[i];
+		char *p = copy;
+		int j;
+
+		LOG_DEBUG("%s", line->text);
+
+		memcpy(copy, line->words, line->size);
+		for (j = 0; j < line->num_words; j++)
+		{
+			words[j] = p;
+			p += strlen(p) + 1;
+		}
+
+		if ((retval = find_and_run_command(context, context->commands, words, line->num_words, 0)) == ERROR_COMMAND_CLOSE_CONNECTION)
+			break;
+	}
+
+	free(copy);
+
+	return retval;
+}
+
+int command_script_lines(command_script_t *script)
+{
+	return script->num_lines;
+}
+
+void command_script_free(command_script_t *script)
+{
+	int i;
+
+	if (script == NULL)
+		return;
+
+	for (i = 0; i < script->num_lines; i++)
+	{
+		free(script->lines[i].text);
+		free(script->lines[i].words);
+	}
+	free(script->lines);
+	free(script);
+}
+
 void command_print_help_line(command_context_t* context, struct command_s *command, int indent)
 {
 	command_t *c;
@@ -582,6 +916,17 @@ int command_done(command_context_t *context)
 	return ERROR_OK;
 }
 
+void command_set_yield_handler(void (*yield_handler)(void))
+{
+	command_yield_handler = yield_handler;
+}
+
+void command_yield(void)
+{
+	if (command_yield_handler)
+		command_yield_handler();
+}
+
 command_context_t* command_init()
 {
 	command_context_t* context = malloc(sizeof(command_context_t));
@@ -62,8 +62,13 @@ typedef struct command_s
 	char *help;
 	int unique_len;
 	struct command_s *next;
+	struct command_s *hash_next;	/* next command in the same lookup hash bucket */
 } command_t;
 
+/* a script file tokenized once by command_script_compile(), for running it
+ * any number of times */
+typedef struct command_script_s command_script_t;
+
 extern command_t* register_command(command_context_t *context, command_t *parent, char *name, int (*handler)(struct command_context_s *context, char* name, char** args, int argc), enum command_mode mode, char *help);
 extern int unregister_command(command_context_t *context, char *name);
 extern int unregister_all_commands(command_context_t *context);
@@ -74,7 +79,18 @@ extern int command_done(command_context_t *context);
 extern void command_print(command_context_t *context, char *format, ...);
 extern void command_print_sameline(command_context_t *context, char *format, ...);
 extern int command_run_line(command_context_t *context, char *line);
+/* split a line into at most max_words words, arena holds strlen(line) + 1 bytes */
+extern int parse_line(char *line, char *words[], int max_words, char *arena);
 extern int command_run_file(command_context_t *context, FILE *file, enum command_mode mode);
+extern command_script_t* command_script_compile(FILE *file);
+extern int command_script_run(command_context_t *context, command_script_t *script);
+extern int command_script_lines(command_script_t *script);
+extern void command_script_free(command_script_t *script);
+
+/* long running operations call command_yield() between chunks of work, so
+ * the server can keep target polling and output to the clients going */
+extern void command_set_yield_handler(void (*yield_handler)(void));
+extern void command_yield(void);
 
 
 #define		ERROR_COMMAND_CLOSE_CONNECTION		(-600)
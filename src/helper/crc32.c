@@ -0,0 +1,351 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by the OpenOCD developers                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "replacements.h"
+
+#include "crc32.h"
+#include "command.h"
+#include "log.h"
+#include "time_support.h"
+
+#include <stdlib.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/* carry-less multiplication needs the target attribute and SSE intrinsics of gcc >= 4.9 */
+#if defined(__x86_64__) && defined(__GNUC__) && ((__GNUC__ > 4) || ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9)))
+#define CRC32_PCLMUL
+#include <cpuid.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+/* crc32_tables[0] is the classic byte table, crc32_tables[n] advances
+ * a byte through n additional zero bytes, as needed for slice-by-8 */
+static u32 crc32_tables[8][256];
+
+static u32 (*crc32_update_best)(u32 crc, const u8 *buffer, u32 nbytes) = NULL;
+
+#ifdef HAVE_PTHREAD_H
+static pthread_once_t crc32_once = PTHREAD_ONCE_INIT;
+#else
+static int crc32_once = 0;
+#endif
+
+static void crc32_init_tables(void)
+{
+	int i, j;
+	u32 c;
+
+	for (i = 0; i < 256; i++)
+	{
+		/* as per gdb */
+		for (c = i << 24, j = 8; j > 0; --j)
+			c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
+		crc32_tables[0][i] = c;
+	}
+
+	for (i = 0; i < 256; i++)
+	{
+		for (j = 1; j < 8; j++)
+		{
+			c = crc32_tables[j - 1][i];
+			crc32_tables[j][i] = (c << 8) ^ crc32_tables[0][c >> 24];
+		}
+	}
+
+	if (crc32_pclmul_available())
+		crc32_update_best = crc32_update_pclmul;
+	else
+		crc32_update_best = crc32_update_slice8;
+}
+
+/* the tables are shared with worker threads, e.g. verify_image's */
+static void crc32_setup(void)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_once(&crc32_once, crc32_init_tables);
+#else
+	if (!crc32_once)
+	{
+		crc32_init_tables();
+		crc32_once = 1;
+	}
+#endif
+}
+
+const u32 *crc32_table(void)
+{
+	crc32_setup();
+
+	return crc32_tables[0];
+}
+
+u32 crc32_update_bytewise(u32 crc, const u8 *buffer, u32 nbytes)
+{
+	const u32 *table = crc32_table();
+
+	while (nbytes--)
+	{
+		/* as per gdb */
+		crc = (crc << 8) ^ table[((crc >> 24) ^ *buffer++) & 255];
+	}
+
+	return crc;
+}
+
+u32 crc32_update_slice8(u32 crc, const u8 *buffer, u32 nbytes)
+{
+	crc32_setup();
+
+	while (nbytes >= 8)
+	{
+		crc ^= ((u32)buffer[0] << 24) | (buffer[1] << 16) | (buffer[2] << 8) | buffer[3];
+
+		crc = crc32_tables[7][crc >> 24] ^
+			crc32_tables[6][(crc >> 16) & 0xff] ^
+			crc32_tables[5][(crc >> 8) & 0xff] ^
+			crc32_tables[4][crc & 0xff] ^
+			crc32_tables[3][buffer[4]] ^
+			crc32_tables[2][buffer[5]] ^
+			crc32_tables[1][buffer[6]] ^
+			crc32_tables[0][buffer[7]];
+
+		buffer += 8;
+		nbytes -= 8;
+	}
+
+	return crc32_update_bytewise(crc, buffer, nbytes);
+}
+
+#ifdef CRC32_PCLMUL
+
+/* x^n mod P for folding 128 bit blocks over 512 and 128 bits, and for the final reduction */
+#define CRC32_X576	0x8833794cULL
+#define CRC32_X512	0xe6228b11ULL
+#define CRC32_X192	0xc5b9cd4cULL
+#define CRC32_X128	0xe8a45605ULL
+#define CRC32_X96	0xf200aa66ULL
+#define CRC32_X64	0x490d678dULL
+/* Barrett constant floor(x^64 / P) and P itself */
+#define CRC32_MU	0x104d101dfULL
+#define CRC32_POLY	0x104c11db7ULL
+
+__attribute__((target("pclmul,ssse3")))
+static __m128i crc32_fold(__m128i x, __m128i k, __m128i data)
+{
+	return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11),
+		_mm_clmulepi64_si128(x, k, 0x00)), data);
+}
+
+__attribute__((target("pclmul,ssse3")))
+static unsigned long long crc32_clmul64(unsigned long long a, unsigned long long b)
+{
+	return _mm_cvtsi128_si64(_mm_clmulepi64_si128(_mm_cvtsi64_si128(a), _mm_cvtsi64_si128(b), 0x00));
+}
+
+/* Fold the buffer in 16 byte blocks with carry-less multiplication, four
+ * blocks in parallel, then reduce the remaining 128 bits to the CRC.
+ * Blocks are byte swapped so the first message bit is the top polynomial bit. */
+__attribute__((target("pclmul,ssse3")))
+u32 crc32_update_pclmul(u32 crc, const u8 *buffer, u32 nbytes)
+{
+	const __m128i bswap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+	const __m128i k512 = _mm_set_epi64x(CRC32_X576, CRC32_X512);
+	const __m128i k128 = _mm_set_epi64x(CRC32_X192, CRC32_X128);
+	__m128i x0, x1, x2, x3;
+	unsigned long long hi, lo, t;
+
+	if (nbytes < 64)
+		return crc32_update_slice8(crc, buffer, nbytes);
+
+	x0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buffer + 0)), bswap);
+	x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buffer + 16)), bswap);
+	x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buffer + 32)), bswap);
+	x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buffer + 48)), bswap);
+
+	/* the initial value is xor'ed into the first 32 message bits */
+	x0 = _mm_xor_si128(x0, _mm_set_epi32(crc, 0, 0, 0));
+
+	buffer += 64;
+	nbytes -= 64;
+
+	while (nbytes >= 64)
+	{
+		x0 = crc32_fold(x0, k512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buffer + 0)), bswap));
+		x1 = crc32_fold(x1, k512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buffer + 16)), bswap));
+		x2 = crc32_fold(x2, k512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buffer + 32)), bswap));
+		x3 = crc32_fold(x3, k512, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buffer + 48)), bswap));
+
+		buffer += 64;
+		nbytes -= 64;
+	}
+
+	x0 = crc32_fold(x0, k128, x1);
+	x0 = crc32_fold(x0, k128, x2);
+	x0 = crc32_fold(x0, k128, x3);
+
+	while (nbytes >= 16)
+	{
+		x0 = crc32_fold(x0, k128, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)buffer), bswap));
+
+		buffer += 16;
+		nbytes -= 16;
+	}
+
+	/* reduce (x0 * x^32) mod P: 128 -> 96 -> 64 bits, then Barrett reduction */
+	hi = _mm_cvtsi128_si64(_mm_unpackhi_epi64(x0, x0));
+	lo = _mm_cvtsi128_si64(x0);
+
+	x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_cvtsi64_si128(hi), _mm_cvtsi64_si128(CRC32_X96), 0x00),
+		_mm_set_epi64x(lo >> 32, lo << 32));
+	hi = _mm_cvtsi128_si64(_mm_unpackhi_epi64(x1, x1));
+	lo = _mm_cvtsi128_si64(x1);
+
+	t = crc32_clmul64(hi, CRC32_X64) ^ lo;
+
+	hi = crc32_clmul64(t >> 32, CRC32_MU) >> 32;
+	crc = (u32)(t ^ crc32_clmul64(hi, CRC32_POLY));
+
+	return crc32_update_slice8(crc, buffer, nbytes);
+}
+
+int crc32_pclmul_available(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return 0;
+
+	/* PCLMULQDQ and SSSE3 */
+	return (ecx & (1 << 1)) && (ecx & (1 << 9));
+}
+
+#else
+
+u32 crc32_update_pclmul(u32 crc, const u8 *buffer, u32 nbytes)
+{
+	return crc32_update_slice8(crc, buffer, nbytes);
+}
+
+int crc32_pclmul_available(void)
+{
+	return 0;
+}
+
+#endif
+
+u32 crc32_init(void)
+{
+	return 0xffffffff;
+}
+
+u32 crc32_update(u32 crc, const u8 *buffer, u32 nbytes)
+{
+	crc32_setup();
+
+	return crc32_update_best(crc, buffer, nbytes);
+}
+
+u32 crc32_final(u32 crc)
+{
+	return crc;
+}
+
+static int handle_crc32_benchmark_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
+{
+	struct
+	{
+		char *name;
+		u32 (*update)(u32 crc, const u8 *buffer, u32 nbytes);
+	} impls[] =
+	{
+		{ "bytewise", crc32_update_bytewise },
+		{ "slice-by-8", crc32_update_slice8 },
+		{ "pclmul", crc32_update_pclmul },
+	};
+	u32 size = 1024 * 1024;
+	u32 reference = 0;
+	u8 *buffer;
+	u32 i;
+
+	if (argc > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (argc == 1)
+		size = strtoul(args[0], NULL, 0) * 1024;
+
+	if (size == 0)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if ((buffer = malloc(size)) == NULL)
+	{
+		LOG_ERROR("error allocating buffer (%d bytes)", size);
+		return ERROR_OK;
+	}
+
+	/* fixed pseudo random data, so results are comparable between runs */
+	for (i = 0; i < size; i++)
+		buffer[i] = (i * 1103515245 + 12345) >> 16;
+
+	for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++)
+	{
+		long long start, elapsed;
+		int rounds = 0;
+		u32 crc = 0;
+
+		if ((impls[i].update == crc32_update_pclmul) && !crc32_pclmul_available())
+		{
+			command_print(cmd_ctx, "%-10s not available on this host", impls[i].name);
+			continue;
+		}
+
+		start = timeval_ms();
+		do
+		{
+			crc = crc32_final(impls[i].update(crc32_init(), buffer, size));
+			rounds++;
+			elapsed = timeval_ms() - start;
+		} while (elapsed < 250);
+
+		if (i == 0)
+			reference = crc;
+
+		command_print(cmd_ctx, "%-10s 0x%8.8x %8.1f MB/s%s", impls[i].name, crc,
+			((double)size * rounds) / (elapsed * 1000.0), (crc != reference) ? " MISMATCH" : "");
+	}
+
+	free(buffer);
+
+	return ERROR_OK;
+}
+
+int crc32_register_commands(struct command_context_s *cmd_ctx)
+{
+	register_command(cmd_ctx, NULL, "crc32_benchmark", handle_crc32_benchmark_command, COMMAND_ANY,
+		"compare host crc32 implementations [kbytes]");
+
+	return ERROR_OK;
+}
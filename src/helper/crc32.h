@@ -0,0 +1,48 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by the OpenOCD developers                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef CRC32_H
+#define CRC32_H
+
+#include "types.h"
+
+struct command_context_s;
+
+/* CRC32 as used by gdb's qCRC packet: polynomial 0x04C11DB7, processed
+ * MSB first, initial value 0xffffffff, no final inversion.
+ *
+ * crc = crc32_init();
+ * crc = crc32_update(crc, buffer, size);	(repeated for every block)
+ * checksum = crc32_final(crc);
+ */
+extern u32 crc32_init(void);
+extern u32 crc32_update(u32 crc, const u8 *buffer, u32 nbytes);
+extern u32 crc32_final(u32 crc);
+
+/* 256 entry lookup table, e.g. for on-target algorithms */
+extern const u32 *crc32_table(void);
+
+/* individual implementations, crc32_update() picks the fastest available one */
+extern u32 crc32_update_bytewise(u32 crc, const u8 *buffer, u32 nbytes);
+extern u32 crc32_update_slice8(u32 crc, const u8 *buffer, u32 nbytes);
+extern u32 crc32_update_pclmul(u32 crc, const u8 *buffer, u32 nbytes);
+extern int crc32_pclmul_available(void);
+
+extern int crc32_register_commands(struct command_context_s *cmd_ctx);
+
+#endif /* CRC32_H */
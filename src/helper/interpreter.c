@@ -30,9 +30,22 @@
 
 var_t *variables = NULL;
 
+/* scripts tokenized once by script_compile, for running them again and again */
+typedef struct compiled_script_s
+{
+	char *name;
+	command_script_t *script;
+	int running;	/* can't be replaced or run again until it returns */
+	struct compiled_script_s *next;
+} compiled_script_t;
+
+static compiled_script_t *compiled_scripts = NULL;
+
 int handle_var_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
 int handle_field_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
 int handle_script_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
+int handle_script_compile_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
+int handle_script_run_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
 
 int interpreter_register_commands(struct command_context_s *cmd_ctx)
 {
@@ -42,6 +55,10 @@ int interpreter_register_commands(struct command_context_s *cmd_ctx)
 		COMMAND_ANY, "display/modify variable field <var> <field> [value|'flip']");
 	register_command(cmd_ctx, NULL, "script", handle_script_command,
 		COMMAND_ANY, "execute commands from <file>");
+	register_command(cmd_ctx, NULL, "script_compile", handle_script_compile_command,
+		COMMAND_ANY, "read and tokenize commands from a file for script_run [<name> <file>]");
+	register_command(cmd_ctx, NULL, "script_run", handle_script_run_command,
+		COMMAND_ANY, "execute a script compiled by script_compile <name>");
 
 	return ERROR_OK;
 }
@@ -235,3 +252,101 @@ int handle_script_command(struct command_context_s *cmd_ctx, char *cmd, char **a
 
 	return ERROR_OK;
 }
+
+int handle_script_compile_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
+{
+	compiled_script_t **p;
+	command_script_t *script;
+	FILE *script_file;
+
+	if (argc == 0)
+	{
+		compiled_script_t *c;
+		for (c = compiled_scripts; c; c = c->next)
+			command_print(cmd_ctx, "%s: %i commands", c->name, command_script_lines(c->script));
+		return ERROR_OK;
+	}
+
+	if (argc != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	/* replace a script of the same name, unless it is running */
+	for (p = &compiled_scripts; *p; p = &(*p)->next)
+	{
+		if (strcmp((*p)->name, args[0]) == 0)
+			break;
+	}
+
+	if (*p && (*p)->running)
+	{
+		command_print(cmd_ctx, "script %s is running, can't replace it", args[0]);
+		return ERROR_FAIL;
+	}
+
+	script_file = open_file_from_path (args[1], "r");
+
+	if (!script_file)
+	{
+		command_print(cmd_ctx, "couldn't open script file %s", args[1]);
+		return ERROR_FAIL;
+	}
+
+	script = command_script_compile(script_file);
+
+	fclose(script_file);
+
+	if (script == NULL)
+	{
+		command_print(cmd_ctx, "couldn't compile script file %s", args[1]);
+		return ERROR_FAIL;
+	}
+
+	if (*p == NULL)
+	{
+		*p = malloc(sizeof(compiled_script_t));
+		(*p)->name = strdup(args[0]);
+		(*p)->running = 0;
+		(*p)->next = NULL;
+	}
+	else
+		command_script_free((*p)->script);
+
+	(*p)->script = script;
+
+	command_print(cmd_ctx, "%s: %i commands", args[0], command_script_lines(script));
+
+	return ERROR_OK;
+}
+
+int handle_script_run_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
+{
+	compiled_script_t *c;
+
+	if (argc != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	for (c = compiled_scripts; c; c = c->next)
+	{
+		if (strcmp(c->name, args[0]) == 0)
+		{
+			int retval;
+
+			/* a script running itself would recurse without end */
+			if (c->running)
+			{
+				command_print(cmd_ctx, "script %s is already running", args[0]);
+				return ERROR_FAIL;
+			}
+
+			c->running = 1;
+			retval = command_script_run(cmd_ctx, c->script);
+			c->running = 0;
+
+			return retval;
+		}
+	}
+
+	command_print(cmd_ctx, "no compiled script %s", args[0]);
+
+	return ERROR_FAIL;
+}
@@ -29,6 +29,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <unistd.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 #define PRINT_MEM() 0
 #if PRINT_MEM()
@@ -53,6 +58,282 @@ static char *log_strings[5] =
 
 static int count = 0;
 
+#ifdef HAVE_PTHREAD_H
+/* Messages from other threads, e.g. the JTAG worker, are written to the log
+ * right away, but the callbacks write to gdb and telnet connections, so they
+ * only see these messages once the main thread calls log_forward_deferred() */
+typedef struct log_deferred_s
+{
+	const char *file;
+	int line;
+	const char *function;
+	char *string;
+	struct log_deferred_s *next;
+} log_deferred_t;
+
+static pthread_t log_main_thread;
+static int log_main_thread_valid = 0;
+static pthread_mutex_t log_deferred_mutex = PTHREAD_MUTEX_INITIALIZER;
+static log_deferred_t *log_deferred = NULL;
+static log_deferred_t **log_deferred_last = &log_deferred;
+
+static int log_defer(const char *file, int line, const char *function, const char *string)
+{
+	log_deferred_t *msg;
+
+	if (!log_main_thread_valid || pthread_equal(pthread_self(), log_main_thread))
+		return 0;
+
+	msg = malloc(sizeof(log_deferred_t));
+	if (msg == NULL)
+		return 1;
+	msg->file = file;
+	msg->line = line;
+	msg->function = function;
+	msg->string = strdup(string);
+	msg->next = NULL;
+
+	pthread_mutex_lock(&log_deferred_mutex);
+	*log_deferred_last = msg;
+	log_deferred_last = &msg->next;
+	pthread_mutex_unlock(&log_deferred_mutex);
+
+	return 1;
+}
+#endif
+
+/* write one log line, the caller flushes log_output. time_ms < 0 leaves
+ * out the count and time information */
+static void log_write(enum log_levels level, const char *file, int line, const char *function, int msg_count, int time_ms, const char *string)
+{
+	if (level == LOG_LVL_OUTPUT)
+	{
+		/* do not prepend any headers, just print out what we were given */
+		fputs(string, log_output);
+		return;
+	}
+
+	if (time_ms >= 0)
+	{
+		/* print with count and time information */
+#if PRINT_MEM()	
+		struct mallinfo info;
+		info = mallinfo();
+#endif
+		fprintf(log_output, "%s %d %d %s:%d %s()"
+#if PRINT_MEM()
+				" %d"
+#endif
+				": %s", log_strings[level+1], msg_count, time_ms, file, line, function, 
+#if PRINT_MEM()
+				info.fordblks,
+#endif
+				string);
+	}
+	else
+	{
+		/* do not print count and time */
+		fprintf(log_output, "%s %s:%d %s(): %s", log_strings[level+1], file, line, function, string);
+	}
+}
+
+#ifdef HAVE_PTHREAD_H
+/* With "log_async on", log lines are put into a ring of fixed size records
+ * and a writer thread writes them to log_output, flushing once it has caught
+ * up. Any thread may log: a record is claimed by advancing log_ring_tail with
+ * compare-and-swap and handed to the writer by setting its sequence number.
+ * The writer only sleeps when the ring is empty, a thread that fills a
+ * record wakes it up. If the ring is full the line is dropped; lines that
+ * don't fit a record are written directly once the ring has been written. */
+#define LOG_RING_SIZE		1024	/* records, power of two */
+#define LOG_RING_TEXT		496
+
+typedef struct log_record_s
+{
+	volatile unsigned int seq;
+	enum log_levels level;
+	const char *file;
+	int line;
+	const char *function;
+	int count;
+	int time_ms;
+	char text[LOG_RING_TEXT];
+} log_record_t;
+
+static log_record_t *log_ring = NULL;
+static volatile unsigned int log_ring_tail = 0;
+static volatile unsigned int log_ring_written = 0;
+static volatile int log_async_enabled = 0;
+static volatile int log_writer_sleeping = 0;
+static int log_writer_stop = 0;
+static int log_writer_running = 0;
+static pthread_t log_writer_thread;
+static pthread_mutex_t log_writer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_writer_cond = PTHREAD_COND_INITIALIZER;
+
+static volatile unsigned int log_stat_queued = 0;
+static volatile unsigned int log_stat_dropped = 0;
+static volatile unsigned int log_stat_direct = 0;
+static unsigned int log_stat_batches = 0;
+
+static void *log_writer_run(void *arg)
+{
+	unsigned int head = log_ring_written;
+	int written = 0;
+
+	for (;;)
+	{
+		log_record_t *rec = &log_ring[head & (LOG_RING_SIZE - 1)];
+
+		if (rec->seq == head + 1)
+		{
+			__sync_synchronize();
+			log_write(rec->level, rec->file, rec->line, rec->function, rec->count, rec->time_ms, rec->text);
+			__sync_synchronize();
+			/* free for the thread wrapping around to it */
+			rec->seq = head + LOG_RING_SIZE;
+			log_ring_written = ++head;
+			written = 1;
+			continue;
+		}
+
+		if (written)
+		{
+			fflush(log_output);
+			log_stat_batches++;
+			written = 0;
+		}
+
+		pthread_mutex_lock(&log_writer_mutex);
+		if (log_writer_stop)
+		{
+			pthread_mutex_unlock(&log_writer_mutex);
+			break;
+		}
+		log_writer_sleeping = 1;
+		__sync_synchronize();
+		if (rec->seq != head + 1)
+			pthread_cond_wait(&log_writer_cond, &log_writer_mutex);
+		log_writer_sleeping = 0;
+		pthread_mutex_unlock(&log_writer_mutex);
+	}
+
+	return NULL;
+}
+
+/* returns 0 if the caller has to write the line itself */
+static int log_ring_put(enum log_levels level, const char *file, int line, const char *function, int msg_count, int time_ms, const char *string)
+{
+	size_t len = strlen(string);
+	log_record_t *rec;
+	unsigned int pos;
+
+	if (!log_async_enabled)
+		return 0;
+
+	if (len >= LOG_RING_TEXT)
+	{
+		/* keep the order of lines, let the writer catch up first */
+		while (log_async_enabled && (log_ring_written != log_ring_tail))
+			usleep(1000);
+		__sync_fetch_and_add(&log_stat_direct, 1);
+		return 0;
+	}
+
+	pos = log_ring_tail;
+	for (;;)
+	{
+		int diff;
+
+		rec = &log_ring[pos & (LOG_RING_SIZE - 1)];
+		diff = (int)(rec->seq - pos);
+
+		if (diff == 0)
+		{
+			if (__sync_bool_compare_and_swap(&log_ring_tail, pos, pos + 1))
+				break;
+		}
+		else if (diff < 0)
+		{
+			/* the writer hasn't written this record yet, the ring is full */
+			__sync_fetch_and_add(&log_stat_dropped, 1);
+			return 1;
+		}
+		pos = log_ring_tail;
+	}
+
+	rec->level = level;
+	rec->file = file;
+	rec->line = line;
+	rec->function = function;
+	rec->count = msg_count;
+	rec->time_ms = time_ms;
+	memcpy(rec->text, string, len + 1);
+	__sync_synchronize();
+	rec->seq = pos + 1;
+	__sync_fetch_and_add(&log_stat_queued, 1);
+
+	__sync_synchronize();
+	if (log_writer_sleeping)
+	{
+		pthread_mutex_lock(&log_writer_mutex);
+		pthread_cond_signal(&log_writer_cond);
+		pthread_mutex_unlock(&log_writer_mutex);
+	}
+
+	return 1;
+}
+
+/* write everything still in the ring and stop the writer */
+static void log_async_stop(void)
+{
+	if (!log_writer_running)
+		return;
+
+	log_async_enabled = 0;
+
+	pthread_mutex_lock(&log_writer_mutex);
+	log_writer_stop = 1;
+	pthread_cond_signal(&log_writer_cond);
+	pthread_mutex_unlock(&log_writer_mutex);
+
+	pthread_join(log_writer_thread, NULL);
+	log_writer_running = 0;
+	log_writer_stop = 0;
+}
+
+static int log_async_start(void)
+{
+	static int atexit_registered = 0;
+	unsigned int i;
+
+	if (log_writer_running)
+		return ERROR_OK;
+
+	if (log_ring == NULL)
+	{
+		if ((log_ring = malloc(LOG_RING_SIZE * sizeof(log_record_t))) == NULL)
+			return ERROR_FAIL;
+		for (i = 0; i < LOG_RING_SIZE; i++)
+			log_ring[i].seq = i;
+	}
+
+	if (pthread_create(&log_writer_thread, NULL, log_writer_run, NULL) != 0)
+		return ERROR_FAIL;
+	log_writer_running = 1;
+	log_async_enabled = 1;
+
+	/* nothing must stay in the ring when OpenOCD exits */
+	if (!atexit_registered)
+	{
+		atexit(log_async_stop);
+		atexit_registered = 1;
+	}
+
+	return ERROR_OK;
+}
+#endif
+
 /* The log_puts() serves to somewhat different goals:
  * 
  * - logging
@@ -69,7 +350,11 @@ static void log_puts(enum log_levels level, const char *file, int line, const ch
 	if (level == LOG_LVL_OUTPUT)
 	{
 		/* do not prepend any headers, just print out what we were given and return */
-		fputs(string, log_output);
+#ifdef HAVE_PTHREAD_H
+		if (log_ring_put(level, file, line, function, count, -1, string))
+			return;
+#endif
+		log_write(level, file, line, function, count, -1, string);
 		fflush(log_output);
 		return;
 	}
@@ -80,41 +365,30 @@ static void log_puts(enum log_levels level, const char *file, int line, const ch
 
 	if (strchr(string, '\n')!=NULL)
 	{
-		if (debug_level >= LOG_LVL_DEBUG)
-		{
-			/* print with count and time information */
-			int t=(int)(timeval_ms()-start);
-#if PRINT_MEM()	
-			struct mallinfo info;
-			info = mallinfo();
-#endif
-			fprintf(log_output, "%s %d %d %s:%d %s()"
-#if PRINT_MEM()
-					" %d"
-#endif
-					": %s", log_strings[level+1], count, t, file, line, function, 
-#if PRINT_MEM()
-					info.fordblks,
+		/* count and time information only at debug level */
+		int t = (debug_level >= LOG_LVL_DEBUG) ? (int)(timeval_ms()-start) : -1;
+		
+#ifdef HAVE_PTHREAD_H
+		if (!log_ring_put(level, file, line, function, count, t, string))
 #endif
-					string);
-		}
-		else
 		{
-			/* do not print count and time */
-			fprintf(log_output, "%s %s:%d %s(): %s", log_strings[level+1], file, line, function, string);
+			log_write(level, file, line, function, count, t, string);
+			fflush(log_output);
 		}
 	} else
 	{
 		/* only entire lines are logged. Otherwise it's 
 		 * single chars intended for the log callbacks. */
 	}
-
-	fflush(log_output);
 	
 	/* Never forward LOG_LVL_DEBUG, too verbose and they can be found in the log if need be */
 	if (level <= LOG_LVL_INFO)
 	{
 		log_callback_t *cb, *next;
+#ifdef HAVE_PTHREAD_H
+		if (log_defer(file, line, function, string))
+			return;
+#endif
 		cb = log_callbacks;
 		/* DANGER!!!! the log callback can remove itself!!!! */
 		while (cb)
@@ -200,9 +474,65 @@ int handle_log_output_command(struct command_context_s *cmd_ctx, char *cmd, char
 		
 		if (file)
 		{
+#ifdef HAVE_PTHREAD_H
+			/* earlier lines go to the old output */
+			int async = log_writer_running;
+			log_async_stop();
+#endif
 			log_output = file;
+#ifdef HAVE_PTHREAD_H
+			if (async)
+				log_async_start();
+#endif
+		}
+	}
+
+	return ERROR_OK;
+}
+
+int handle_log_async_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
+{
+#ifdef HAVE_PTHREAD_H
+	if (argc > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (argc == 1)
+	{
+		if (strcmp(args[0], "on") == 0)
+		{
+			if (log_async_start() != ERROR_OK)
+				command_print(cmd_ctx, "couldn't start the log writer thread");
 		}
+		else if (strcmp(args[0], "off") == 0)
+			log_async_stop();
+		else
+			return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+
+	command_print(cmd_ctx, "asynchronous logging %s", log_writer_running ? "on" : "off");
+#else
+	command_print(cmd_ctx, "asynchronous logging not available in this build");
+#endif
+
+	return ERROR_OK;
+}
+
+int handle_log_stats_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
+{
+	command_print(cmd_ctx, "%d messages, debug_level %d", count, debug_level);
+#ifdef HAVE_PTHREAD_H
+	command_print(cmd_ctx, "async %s: %u queued, %u flushes, %u pending, %u dropped (ring full), %u too long and written directly",
+		log_writer_running ? "on" : "off", log_stat_queued, log_stat_batches,
+		log_ring_tail - log_ring_written, log_stat_dropped, log_stat_direct);
+
+	if ((argc == 1) && (strcmp(args[0], "reset") == 0))
+	{
+		log_stat_queued = 0;
+		log_stat_dropped = 0;
+		log_stat_direct = 0;
+		log_stat_batches = 0;
 	}
+#endif
 
 	return ERROR_OK;
 }
@@ -214,6 +544,10 @@ int log_register_commands(struct command_context_s *cmd_ctx)
 		COMMAND_ANY, "redirect logging to <file> (default: stderr)");
 	register_command(cmd_ctx, NULL, "debug_level", handle_debug_level_command,
 		COMMAND_ANY, "adjust debug level <0-3>");
+	register_command(cmd_ctx, NULL, "log_async", handle_log_async_command,
+		COMMAND_ANY, "write the log from a background thread [on|off]");
+	register_command(cmd_ctx, NULL, "log_stats", handle_log_stats_command,
+		COMMAND_ANY, "show logging statistics, dropped messages of the asynchronous log ['reset']");
 
 	return ERROR_OK;
 }
@@ -229,8 +563,47 @@ int log_init(struct command_context_s *cmd_ctx)
 		log_output = stderr;
 	}
 	
+#ifdef HAVE_PTHREAD_H
+	log_main_thread = pthread_self();
+	log_main_thread_valid = 1;
+#endif
+	
 	return ERROR_OK;
 }
+
+/* pass messages logged by other threads on to the log callbacks */
+void log_forward_deferred(void)
+{
+#ifdef HAVE_PTHREAD_H
+	log_deferred_t *msg;
+
+	if (log_deferred == NULL)
+		return;
+
+	pthread_mutex_lock(&log_deferred_mutex);
+	msg = log_deferred;
+	log_deferred = NULL;
+	log_deferred_last = &log_deferred;
+	pthread_mutex_unlock(&log_deferred_mutex);
+
+	while (msg)
+	{
+		log_deferred_t *next = msg->next;
+		log_callback_t *cb, *next_cb;
+
+		for (cb = log_callbacks; cb; cb = next_cb)
+		{
+			next_cb = cb->next;
+			if (msg->string)
+				cb->fn(cb->priv, msg->file, msg->line, msg->function, msg->string);
+		}
+
+		free(msg->string);
+		free(msg);
+		msg = next;
+	}
+#endif
+}
 	
 int set_log_output(struct command_context_s *cmd_ctx, FILE *output)
 {
@@ -69,6 +69,8 @@ typedef struct log_callback_s
 
 extern int log_add_callback(log_callback_fn fn, void *priv);
 extern int log_remove_callback(log_callback_fn fn, void *priv);
+/* messages logged by other threads reach the callbacks through this, main thread only */
+extern void log_forward_deferred(void);
 
 char *alloc_vprintf(const char *fmt, va_list ap);
 char *alloc_printf(const char *fmt, ...);
@@ -76,23 +78,31 @@ char *alloc_printf(const char *fmt, ...);
 extern int debug_level;
 
 /* Avoid fn call and building parameter list if we're not outputting the information.
- * Matters on feeble CPUs for DEBUG/INFO statements that are involved frequently */
+ * Matters on feeble CPUs for DEBUG/INFO statements that are involved frequently.
+ *
+ * Levels above LOG_COMPILE_LEVEL are compiled out altogether, e.g.
+ * CFLAGS=-DLOG_COMPILE_LEVEL=LOG_LVL_INFO drops all LOG_DEBUG statements. */
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LVL_DEBUG
+#endif
 
+#define LOG_LEVEL_ENABLED(level) \
+		(((level) <= LOG_COMPILE_LEVEL) && (debug_level >= (level)))
 
 #define LOG_DEBUG(expr ...) \
-		if (debug_level >= LOG_LVL_DEBUG) { log_printf_lf (LOG_LVL_DEBUG, __FILE__, __LINE__, __FUNCTION__, expr); }
+		if (LOG_LEVEL_ENABLED(LOG_LVL_DEBUG)) { log_printf_lf (LOG_LVL_DEBUG, __FILE__, __LINE__, __FUNCTION__, expr); }
 
 #define LOG_INFO(expr ...) \
-		log_printf_lf (LOG_LVL_INFO, __FILE__, __LINE__, __FUNCTION__, expr)
+		do { if (LOG_LEVEL_ENABLED(LOG_LVL_INFO)) log_printf_lf (LOG_LVL_INFO, __FILE__, __LINE__, __FUNCTION__, expr); } while (0)
 
 #define LOG_INFO_N(expr ...) \
-		log_printf (LOG_LVL_INFO, __FILE__, __LINE__, __FUNCTION__, expr)
+		do { if (LOG_LEVEL_ENABLED(LOG_LVL_INFO)) log_printf (LOG_LVL_INFO, __FILE__, __LINE__, __FUNCTION__, expr); } while (0)
 
 #define LOG_WARNING(expr ...) \
-		log_printf_lf (LOG_LVL_WARNING, __FILE__, __LINE__, __FUNCTION__, expr)
+		do { if (LOG_LEVEL_ENABLED(LOG_LVL_WARNING)) log_printf_lf (LOG_LVL_WARNING, __FILE__, __LINE__, __FUNCTION__, expr); } while (0)
 
 #define LOG_ERROR(expr ...) \
-		log_printf_lf (LOG_LVL_ERROR, __FILE__, __LINE__, __FUNCTION__, expr)
+		do { if (debug_level >= LOG_LVL_ERROR) log_printf_lf (LOG_LVL_ERROR, __FILE__, __LINE__, __FUNCTION__, expr); } while (0)
 
 #define LOG_USER(expr ...) \
 		log_printf_lf (LOG_LVL_USER, __FILE__, __LINE__, __FUNCTION__, expr)
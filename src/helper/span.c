@@ -0,0 +1,285 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by the OpenOCD developers                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "replacements.h"
+
+#include "span.h"
+#include "command.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#define SPAN_THREAD_LOCAL __thread
+#else
+#define SPAN_THREAD_LOCAL
+#endif
+
+#define SPAN_RING_SIZE	16384	/* spans per thread */
+#define SPAN_TEXT	16
+
+typedef struct span_record_s
+{
+	const char *name;
+	long long start;
+	int duration;	/* us */
+	int arg;
+	int has_arg;
+	char text[SPAN_TEXT];
+} span_record_t;
+
+typedef struct span_ring_s
+{
+	int tid;
+	const char *name;
+	span_record_t *records;
+	unsigned int count;	/* spans recorded, index of the next one modulo SPAN_RING_SIZE */
+	struct span_ring_s *next;
+} span_ring_t;
+
+int span_enabled = 0;
+
+static span_ring_t *span_rings = NULL;
+static int span_next_tid = 1;
+static SPAN_THREAD_LOCAL span_ring_t *span_self = NULL;
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t span_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static span_ring_t *span_get_ring(void)
+{
+	span_ring_t *ring;
+
+	if (span_self)
+		return span_self;
+
+	if ((ring = malloc(sizeof(span_ring_t))) == NULL)
+		return NULL;
+	if ((ring->records = malloc(SPAN_RING_SIZE * sizeof(span_record_t))) == NULL)
+	{
+		free(ring);
+		return NULL;
+	}
+	ring->name = NULL;
+	ring->count = 0;
+
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&span_mutex);
+#endif
+	ring->tid = span_next_tid++;
+	ring->next = span_rings;
+	span_rings = ring;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&span_mutex);
+#endif
+
+	span_self = ring;
+
+	return ring;
+}
+
+static span_record_t *span_record(long long start, const char *name)
+{
+	span_ring_t *ring;
+	span_record_t *rec;
+
+	/* started before recording was turned on, or off now */
+	if (!start || !span_enabled)
+		return NULL;
+
+	if ((ring = span_get_ring()) == NULL)
+		return NULL;
+
+	rec = &ring->records[ring->count++ % SPAN_RING_SIZE];
+	rec->name = name;
+	rec->start = start;
+	rec->duration = monotonic_us() - start;
+	rec->has_arg = 0;
+	rec->text[0] = 0;
+
+	return rec;
+}
+
+void span_end(long long start, const char *name)
+{
+	span_record(start, name);
+}
+
+void span_end_arg(long long start, const char *name, int arg)
+{
+	span_record_t *rec = span_record(start, name);
+
+	if (rec)
+	{
+		rec->arg = arg;
+		rec->has_arg = 1;
+	}
+}
+
+void span_end_text(long long start, const char *name, const char *text, int len)
+{
+	span_record_t *rec = span_record(start, name);
+
+	if (rec)
+	{
+		if (len > SPAN_TEXT - 1)
+			len = SPAN_TEXT - 1;
+		memcpy(rec->text, text, len);
+		rec->text[len] = 0;
+	}
+}
+
+void span_thread_name(const char *name)
+{
+	span_ring_t *ring = span_get_ring();
+
+	if (ring)
+		ring->name = name;
+}
+
+/* text recorded from gdb packets may contain anything */
+static void span_write_string(FILE *file, const char *s)
+{
+	fputc('"', file);
+	for (; *s; s++)
+	{
+		if ((*s == '"') || (*s == '\\') || ((unsigned char)*s < 0x20) || ((unsigned char)*s >= 0x7f))
+			fprintf(file, "\\u%4.4x", (unsigned char)*s);
+		else
+			fputc(*s, file);
+	}
+	fputc('"', file);
+}
+
+static int span_dump(struct command_context_s *cmd_ctx, char *filename)
+{
+	FILE *file;
+	span_ring_t *ring;
+	int enabled = span_enabled;
+	int first = 1;
+	int spans = 0;
+
+	if ((file = fopen(filename, "w")) == NULL)
+	{
+		command_print(cmd_ctx, "couldn't open '%s'", filename);
+		return ERROR_OK;
+	}
+
+	/* stop recording while the rings are written */
+	span_enabled = 0;
+
+	fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+	for (ring = span_rings; ring; ring = ring->next)
+	{
+		unsigned int i = (ring->count > SPAN_RING_SIZE) ? ring->count - SPAN_RING_SIZE : 0;
+
+		if (ring->name)
+		{
+			fprintf(file, "%s{\"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"name\": \"thread_name\", \"args\": {\"name\": ",
+				first ? "" : ",\n", ring->tid);
+			span_write_string(file, ring->name);
+			fprintf(file, "}}");
+			first = 0;
+		}
+
+		for (; i < ring->count; i++)
+		{
+			span_record_t *rec = &ring->records[i % SPAN_RING_SIZE];
+
+			fprintf(file, "%s{\"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %lld, \"dur\": %d, \"name\": ",
+				first ? "" : ",\n", ring->tid, rec->start, rec->duration);
+			span_write_string(file, rec->name);
+			if (rec->has_arg)
+				fprintf(file, ", \"args\": {\"arg\": %d}", rec->arg);
+			else if (rec->text[0])
+			{
+				fprintf(file, ", \"args\": {\"text\": ");
+				span_write_string(file, rec->text);
+				fprintf(file, "}");
+			}
+			fprintf(file, "}");
+			first = 0;
+			spans++;
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	span_enabled = enabled;
+
+	command_print(cmd_ctx, "%d spans written to '%s'", spans, filename);
+
+	return ERROR_OK;
+}
+
+static int handle_trace_spans_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
+{
+	span_ring_t *ring;
+	unsigned int spans = 0;
+
+	if (argc > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (argc == 1)
+	{
+		if (strcmp(args[0], "on") == 0)
+		{
+			span_thread_name("main");
+			span_enabled = 1;
+		}
+		else if (strcmp(args[0], "off") == 0)
+			span_enabled = 0;
+		else if (strcmp(args[0], "clear") == 0)
+		{
+			for (ring = span_rings; ring; ring = ring->next)
+				ring->count = 0;
+		}
+		else
+			return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+	else if (argc == 2)
+	{
+		if (strcmp(args[0], "dump") != 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		return span_dump(cmd_ctx, args[1]);
+	}
+
+	for (ring = span_rings; ring; ring = ring->next)
+		spans += (ring->count > SPAN_RING_SIZE) ? SPAN_RING_SIZE : ring->count;
+
+	command_print(cmd_ctx, "span recording %s, %u spans", span_enabled ? "on" : "off", spans);
+
+	return ERROR_OK;
+}
+
+int span_register_commands(struct command_context_s *cmd_ctx)
+{
+	register_command(cmd_ctx, NULL, "trace_spans", handle_trace_spans_command, COMMAND_ANY,
+		"record timing of jtag, flash, target and gdb operations [on|off|clear|dump <file.json>]");
+
+	return ERROR_OK;
+}
@@ -0,0 +1,51 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by the OpenOCD developers                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef SPAN_H
+#define SPAN_H
+
+#include "time_support.h"
+
+struct command_context_s;
+
+/* Timing of hot paths for "trace_spans", written as Chrome trace events
+ * (chrome://tracing, Perfetto). Instrumented code does
+ *
+ *	long long span = span_begin();
+ *	...
+ *	span_end(span, "jtag_execute_queue");
+ *
+ * which costs a test of span_enabled while recording is off. Every thread
+ * records into a ring of its own, the oldest spans are overwritten.
+ * Names must be string constants. */
+extern int span_enabled;
+
+#define span_begin() (span_enabled ? monotonic_us() : 0)
+
+extern void span_end(long long start, const char *name);
+/* with a number, e.g. a byte count */
+extern void span_end_arg(long long start, const char *name, int arg);
+/* with the start of some text, e.g. a gdb packet */
+extern void span_end_text(long long start, const char *name, const char *text, int len);
+
+/* name of the calling thread in the trace */
+extern void span_thread_name(const char *name);
+
+extern int span_register_commands(struct command_context_s *cmd_ctx);
+
+#endif /* SPAN_H */
@@ -26,6 +26,8 @@
 #include "log.h"
 
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 
 int timeval_subtract(struct timeval *result, struct timeval *x, struct timeval *y);
 int timeval_add(struct timeval *result, struct timeval *x, struct timeval *y);
@@ -124,3 +126,73 @@ long long timeval_ms()
 	
 	return t;
 }
+
+long long monotonic_ns()
+{
+	struct timeval now;
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+		return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+
+	gettimeofday(&now, NULL);
+	return now.tv_sec * 1000000000LL + now.tv_usec * 1000LL;
+}
+
+long long monotonic_us()
+{
+	return monotonic_ns() / 1000;
+}
+
+long long monotonic_ms()
+{
+	return monotonic_ns() / 1000000;
+}
+
+void deadline_start(deadline_t *deadline, int timeout_ms)
+{
+	deadline->start = monotonic_ns();
+	if (timeout_ms < 0)
+		deadline->end = 0x7fffffffffffffffLL;
+	else
+		deadline->end = deadline->start + timeout_ms * 1000000LL;
+	deadline->sleep_us = 0;
+}
+
+int deadline_expired(deadline_t *deadline)
+{
+	return monotonic_ns() >= deadline->end;
+}
+
+long long deadline_elapsed_us(deadline_t *deadline)
+{
+	return (monotonic_ns() - deadline->start) / 1000;
+}
+
+int deadline_wait(deadline_t *deadline)
+{
+	long long now = monotonic_ns();
+	long long left_us;
+
+	if (now >= deadline->end)
+		return 0;
+
+	/* whatever is polled is often ready within a few round trips */
+	if (now - deadline->start < DEADLINE_SPIN_US * 1000LL)
+		return 1;
+
+	if (deadline->sleep_us == 0)
+		deadline->sleep_us = DEADLINE_MIN_SLEEP_US;
+	else if (deadline->sleep_us < DEADLINE_MAX_SLEEP_US)
+		deadline->sleep_us *= 2;
+	if (deadline->sleep_us > DEADLINE_MAX_SLEEP_US)
+		deadline->sleep_us = DEADLINE_MAX_SLEEP_US;
+
+	/* poll once more right at the deadline */
+	left_us = (deadline->end - now + 999) / 1000;
+	usleep((left_us < deadline->sleep_us) ? left_us : deadline->sleep_us);
+
+	return 1;
+}
@@ -36,6 +36,10 @@ extern int timeval_add(struct timeval *result, struct timeval *x, struct timeval
 extern int timeval_add_time(struct timeval *result, int sec, int usec);
 /* gettimeofday() timeval in 64 bit ms */
 extern long long timeval_ms();
+/* monotonic clock, unaffected by changes of the wall clock, in ns, us and ms */
+extern long long monotonic_ns();
+extern long long monotonic_us();
+extern long long monotonic_ms();
 
 typedef struct duration_s
 {
@@ -46,4 +50,36 @@ typedef struct duration_s
 extern int duration_start_measure(duration_t *duration);
 extern int duration_stop_measure(duration_t *duration, char **text);
 
+/* Polling the hardware with a timeout:
+ *
+ *	deadline_t deadline;
+ *
+ *	deadline_start(&deadline, timeout_ms);
+ *	while (!ready())
+ *	{
+ *		if (!deadline_wait(&deadline))
+ *			return ERROR_..._TIMEOUT;
+ *	}
+ *
+ * deadline_wait() returns 0 once the timeout has passed, a negative
+ * timeout never passes. For the first DEADLINE_SPIN_US it returns right
+ * away, so hardware that is ready after a few polls isn't delayed by a
+ * sleep of a scheduler tick. After that it sleeps, doubling the sleep
+ * up to DEADLINE_MAX_SLEEP_US. */
+#define DEADLINE_SPIN_US		200
+#define DEADLINE_MIN_SLEEP_US	10
+#define DEADLINE_MAX_SLEEP_US	1000
+
+typedef struct deadline_s
+{
+	long long start;	/* ns */
+	long long end;		/* ns */
+	int sleep_us;
+} deadline_t;
+
+extern void deadline_start(deadline_t *deadline, int timeout_ms);
+extern int deadline_wait(deadline_t *deadline);
+extern int deadline_expired(deadline_t *deadline);
+extern long long deadline_elapsed_us(deadline_t *deadline);
+
 #endif /* TIME_SUPPORT_H */
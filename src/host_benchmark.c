@@ -0,0 +1,514 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by the OpenOCD developers                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "replacements.h"
+
+#include "host_benchmark.h"
+
+#include "binarybuffer.h"
+#include "image.h"
+#include "arm_disassembler.h"
+#include "etm.h"
+#include "command.h"
+#include "log.h"
+#include "time_support.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Benchmarks of host-only code on fixed inputs, so timings are comparable
+ * between builds. Built into the benchmark_host check program only:
+ * "save <file>" stores the results as a baseline, "check <file>" fails if
+ * a benchmark became slower than the baseline by more than the given
+ * percentage. */
+
+#define HOST_BENCHMARK_CORPUS	(16 * 1024)
+#define HOST_BENCHMARK_MS	40	/* per run, the best of HOST_BENCHMARK_RUNS counts */
+#define HOST_BENCHMARK_RUNS	5
+#define HOST_BENCHMARK_SLOWER	20	/* percent */
+
+typedef struct host_benchmark_s
+{
+	char *name;
+	/* one pass over the corpus, returns the number of operations or -1 on failure */
+	int (*run)(void);
+	u32 bytes;	/* per operation, 0 if a throughput doesn't make sense */
+	double ns_per_op;
+} host_benchmark_t;
+
+static u8 *corpus = NULL;	/* pseudo random bytes */
+static u8 *corpus2 = NULL;
+static u8 *corpus_mask = NULL;
+static u32 *arm_opcodes = NULL;
+static etmv1_trace_data_t *trace_data = NULL;
+static char ihex_file[32] = "";
+static char s19_file[32] = "";
+static volatile u32 sink;	/* keeps results alive */
+
+static char *lines[] =
+{
+	"mww 0x20000000 0x12345678",
+	"flash write_image erase \"/home/user/my firmware/image.elf\" 0x08000000 elf",
+	"arm7_9 dcc_downloads enable",
+	"  reg   r0    0xdeadbeef  ",
+	"mdw 0x40000000 0x100",
+	"target_script 0 reset \"event scripts/reset with spaces.script\"",
+	"jtag_khz 6000",
+	"xscale vector_table low 1 0xe59ff018",
+};
+
+static int run_buf_set_u32(void)
+{
+	int i;
+
+	for (i = 0; i < 1024; i++)
+		buf_set_u32(corpus2, (i * 29) % (HOST_BENCHMARK_CORPUS * 8 - 32), 1 + (i % 32), i * 0x9e3779b9);
+
+	return 1024;
+}
+
+static int run_buf_get_u32(void)
+{
+	u32 sum = 0;
+	int i;
+
+	for (i = 0; i < 1024; i++)
+		sum += buf_get_u32(corpus, (i * 29) % (HOST_BENCHMARK_CORPUS * 8 - 32), 1 + (i % 32));
+	sink = sum;
+
+	return 1024;
+}
+
+static int run_buf_set_buf(void)
+{
+	buf_set_buf(corpus, 3, corpus2, 5, HOST_BENCHMARK_CORPUS * 8 - 8);
+
+	return 1;
+}
+
+static int run_buf_cmp_mask(void)
+{
+	/* equal buffers, every byte is compared */
+	sink = buf_cmp_mask(corpus, corpus, corpus_mask, HOST_BENCHMARK_CORPUS * 8);
+
+	return 1;
+}
+
+static int run_image_checksum(void)
+{
+	u32 checksum;
+
+	image_calculate_checksum(corpus, HOST_BENCHMARK_CORPUS, &checksum);
+	sink = checksum;
+
+	return 1;
+}
+
+static int run_arm_evaluate_opcode(void)
+{
+	arm_instruction_t instruction;
+	u32 i;
+
+	for (i = 0; i < HOST_BENCHMARK_CORPUS / 4; i++)
+		arm_evaluate_opcode(arm_opcodes[i], i * 4, &instruction);
+
+	return HOST_BENCHMARK_CORPUS / 4;
+}
+
+static int run_thumb_evaluate_opcode(void)
+{
+	arm_instruction_t instruction;
+	u32 i;
+
+	for (i = 0; i < HOST_BENCHMARK_CORPUS / 2; i++)
+		thumb_evaluate_opcode(le_to_h_u16(corpus + i * 2), i * 2, &instruction);
+
+	return HOST_BENCHMARK_CORPUS / 2;
+}
+
+static int run_parse_line(void)
+{
+	char *words[32];
+	char arena[256];
+	char line[256];
+	u32 i;
+
+	for (i = 0; i < sizeof(lines) / sizeof(lines[0]); i++)
+	{
+		/* parse_line() may modify the line */
+		strcpy(line, lines[i]);
+		sink = parse_line(line, words, 32, arena);
+	}
+
+	return sizeof(lines) / sizeof(lines[0]);
+}
+
+static int run_image_file(char *file, char *type)
+{
+	image_t image;
+	u32 size_read;
+	int i, retval = ERROR_OK;
+
+	if (image_open(&image, file, type) != ERROR_OK)
+		return -1;
+
+	for (i = 0; (i < image.num_sections) && (retval == ERROR_OK); i++)
+		retval = image_read_section(&image, i, 0, image.sections[i].size, corpus2, &size_read);
+
+	image_close(&image);
+
+	return (retval == ERROR_OK) ? 1 : -1;
+}
+
+static int run_ihex(void)
+{
+	return run_image_file(ihex_file, "ihex");
+}
+
+static int run_s19(void)
+{
+	return run_image_file(s19_file, "s19");
+}
+
+static int run_etmv1_next_packet(void)
+{
+	etm_context_t ctx;
+	u8 packet;
+	int packets = 0;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.trace_data = trace_data;
+	ctx.trace_depth = HOST_BENCHMARK_CORPUS / 2;
+	ctx.portmode = ETM_PORT_16BIT;
+
+	while (etmv1_next_packet(&ctx, &packet, 0) == 0)
+		packets++;
+	sink = packets;
+
+	return packets;
+}
+
+static host_benchmark_t host_benchmarks[] =
+{
+	{ "buf_set_u32", run_buf_set_u32, 0, 0.0 },
+	{ "buf_get_u32", run_buf_get_u32, 0, 0.0 },
+	{ "buf_set_buf", run_buf_set_buf, HOST_BENCHMARK_CORPUS, 0.0 },
+	{ "buf_cmp_mask", run_buf_cmp_mask, HOST_BENCHMARK_CORPUS, 0.0 },
+	{ "image_calculate_checksum", run_image_checksum, HOST_BENCHMARK_CORPUS, 0.0 },
+	{ "arm_evaluate_opcode", run_arm_evaluate_opcode, 0, 0.0 },
+	{ "thumb_evaluate_opcode", run_thumb_evaluate_opcode, 0, 0.0 },
+	{ "parse_line", run_parse_line, 0, 0.0 },
+	{ "ihex", run_ihex, HOST_BENCHMARK_CORPUS, 0.0 },
+	{ "s19", run_s19, HOST_BENCHMARK_CORPUS, 0.0 },
+	{ "etmv1_next_packet", run_etmv1_next_packet, 0, 0.0 },
+};
+
+#define NUM_HOST_BENCHMARKS	(int)(sizeof(host_benchmarks) / sizeof(host_benchmarks[0]))
+
+/* the image code reads files, the corpus is written to temporary ones */
+static FILE *host_benchmark_tmpfile(char *name, char *type)
+{
+#ifdef _WIN32
+	FILE *file;
+
+	snprintf(name, 32, "openocd-%s-%d.tmp", type, (int)getpid());
+	if ((file = fopen(name, "w")) == NULL)
+		name[0] = 0;
+	return file;
+#else
+	int fd;
+
+	snprintf(name, 32, "/tmp/openocd-%s-XXXXXX", type);
+	if ((fd = mkstemp(name)) < 0)
+	{
+		name[0] = 0;
+		return NULL;
+	}
+	return fdopen(fd, "w");
+#endif
+}
+
+/* 16 data bytes per record, addresses start at 0 */
+static int write_ihex(char *name)
+{
+	FILE *file;
+	u32 address;
+	int i;
+
+	if ((file = host_benchmark_tmpfile(name, "ihex")) == NULL)
+		return ERROR_FAIL;
+
+	for (address = 0; address < HOST_BENCHMARK_CORPUS; address += 16)
+	{
+		u8 sum = 16 + (address >> 8) + address;
+
+		fprintf(file, ":10%4.4X00", address);
+		for (i = 0; i < 16; i++)
+		{
+			fprintf(file, "%2.2X", corpus[address + i]);
+			sum += corpus[address + i];
+		}
+		fprintf(file, "%2.2X\n", (u8)-sum);
+	}
+	fprintf(file, ":00000001FF\n");
+
+	fclose(file);
+
+	return ERROR_OK;
+}
+
+static int write_s19(char *name)
+{
+	FILE *file;
+	u32 address;
+	int i;
+
+	if ((file = host_benchmark_tmpfile(name, "s19")) == NULL)
+		return ERROR_FAIL;
+
+	for (address = 0; address < HOST_BENCHMARK_CORPUS; address += 16)
+	{
+		/* count covers address, data and checksum */
+		u8 sum = 19 + (address >> 8) + address;
+
+		fprintf(file, "S113%4.4X", address);
+		for (i = 0; i < 16; i++)
+		{
+			fprintf(file, "%2.2X", corpus[address + i]);
+			sum += corpus[address + i];
+		}
+		fprintf(file, "%2.2X\n", (u8)~sum);
+	}
+	fprintf(file, "S9030000FC\n");
+
+	fclose(file);
+
+	return ERROR_OK;
+}
+
+static int host_benchmark_setup(void)
+{
+	u32 i, seed = 12345;
+
+	if (corpus)
+		return ERROR_OK;
+
+	corpus = malloc(HOST_BENCHMARK_CORPUS);
+	corpus2 = malloc(HOST_BENCHMARK_CORPUS);
+	corpus_mask = malloc(HOST_BENCHMARK_CORPUS);
+	arm_opcodes = malloc((HOST_BENCHMARK_CORPUS / 4) * sizeof(u32));
+	trace_data = malloc((HOST_BENCHMARK_CORPUS / 2) * sizeof(etmv1_trace_data_t));
+	if (!corpus || !corpus2 || !corpus_mask || !arm_opcodes || !trace_data)
+		return ERROR_FAIL;
+
+	for (i = 0; i < HOST_BENCHMARK_CORPUS; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		corpus[i] = seed >> 16;
+		corpus_mask[i] = 0xff;
+	}
+	memset(corpus2, 0, HOST_BENCHMARK_CORPUS);
+
+	/* unconditional ARM instructions, leaving out coprocessor load/store
+	 * which the disassembler doesn't decode */
+	for (i = 0; i < HOST_BENCHMARK_CORPUS / 4; i++)
+	{
+		arm_opcodes[i] = 0xe0000000 | (le_to_h_u32(corpus + i * 4) & 0x0fffffff);
+		if ((arm_opcodes[i] & 0x0e000000) == 0x0c000000)
+			arm_opcodes[i] ^= 0x04000000;
+	}
+
+	for (i = 0; i < HOST_BENCHMARK_CORPUS / 2; i++)
+	{
+		trace_data[i].pipestat = corpus[i] & 0x3;
+		trace_data[i].packet = le_to_h_u16(corpus + 2 * i);
+		trace_data[i].flags = 0;
+	}
+
+	if ((write_ihex(ihex_file) != ERROR_OK) || (write_s19(s19_file) != ERROR_OK))
+		return ERROR_FAIL;
+
+	return ERROR_OK;
+}
+
+static void host_benchmark_cleanup(void)
+{
+	if (ihex_file[0])
+		unlink(ihex_file);
+	if (s19_file[0])
+		unlink(s19_file);
+	ihex_file[0] = s19_file[0] = 0;
+	free(corpus);
+	free(corpus2);
+	free(corpus_mask);
+	free(arm_opcodes);
+	free(trace_data);
+	corpus = corpus2 = corpus_mask = NULL;
+	arm_opcodes = NULL;
+	trace_data = NULL;
+}
+
+/* the fastest of several runs is least disturbed by the rest of the system,
+ * returns -1 if the benchmark failed */
+static double host_benchmark_measure(host_benchmark_t *b)
+{
+	double best = 0.0;
+	int run;
+
+	for (run = 0; run < HOST_BENCHMARK_RUNS; run++)
+	{
+		long long start = monotonic_us(), elapsed;
+		long long ops = 0;
+		double ns;
+
+		do
+		{
+			int n;
+			if ((n = b->run()) < 0)
+				return -1.0;
+			ops += n;
+			elapsed = monotonic_us() - start;
+		} while (elapsed < HOST_BENCHMARK_MS * 1000LL);
+
+		ns = ops ? (elapsed * 1000.0) / ops : 0.0;
+		if ((run == 0) || (ns < best))
+			best = ns;
+	}
+
+	return best;
+}
+
+/* ns per operation from a baseline file, -1 if the benchmark isn't listed */
+static double host_benchmark_baseline(FILE *file, char *name)
+{
+	char line[128], bench[64];
+	double ns;
+
+	rewind(file);
+	while (fgets(line, sizeof(line), file))
+	{
+		if ((line[0] != '#') && (sscanf(line, "%63s %lf", bench, &ns) == 2) && (strcmp(bench, name) == 0))
+			return ns;
+	}
+
+	return -1.0;
+}
+
+int host_benchmark(struct command_context_s *cmd_ctx, char **args, int argc)
+{
+	FILE *baseline = NULL;
+	int save = 0;
+	int slower = HOST_BENCHMARK_SLOWER;
+	int regressions = 0;
+	int failures = 0;
+	int i;
+
+	if (argc > 3)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (argc >= 2)
+	{
+		if (strcmp(args[0], "save") == 0)
+			save = 1;
+		else if (strcmp(args[0], "check") != 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+
+		if ((baseline = fopen(args[1], save ? "w" : "r")) == NULL)
+		{
+			command_print(cmd_ctx, "couldn't open baseline '%s'", args[1]);
+			return ERROR_FAIL;
+		}
+
+		if (argc == 3)
+			slower = strtoul(args[2], NULL, 0);
+	}
+	else if (argc == 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (host_benchmark_setup() != ERROR_OK)
+	{
+		command_print(cmd_ctx, "couldn't set up the benchmark data");
+		host_benchmark_cleanup();
+		if (baseline)
+			fclose(baseline);
+		return ERROR_FAIL;
+	}
+
+	if (save)
+		fprintf(baseline, "# host benchmark baseline, ns per operation\n");
+
+	for (i = 0; i < NUM_HOST_BENCHMARKS; i++)
+	{
+		host_benchmark_t *b = &host_benchmarks[i];
+		double ref;
+		char *verdict = "";
+
+		b->ns_per_op = host_benchmark_measure(b);
+
+		if (b->ns_per_op < 0)
+		{
+			command_print(cmd_ctx, "%-26s failed", b->name);
+			failures++;
+			continue;
+		}
+
+		if (save)
+			fprintf(baseline, "%s %.1f\n", b->name, b->ns_per_op);
+		else if (baseline && ((ref = host_benchmark_baseline(baseline, b->name)) > 0))
+		{
+			if (b->ns_per_op > ref * (100 + slower) / 100)
+			{
+				verdict = " REGRESSION";
+				regressions++;
+			}
+			else
+				verdict = " ok";
+		}
+
+		if (b->bytes)
+			command_print(cmd_ctx, "%-26s %12.1f ns/op %10.1f MB/s%s", b->name, b->ns_per_op,
+				b->bytes * 1000.0 / b->ns_per_op, verdict);
+		else
+			command_print(cmd_ctx, "%-26s %12.1f ns/op%s", b->name, b->ns_per_op, verdict);
+	}
+
+	host_benchmark_cleanup();
+
+	if (baseline)
+		fclose(baseline);
+
+	if (failures)
+	{
+		command_print(cmd_ctx, "%d benchmarks failed", failures);
+		return ERROR_FAIL;
+	}
+
+	if (regressions)
+	{
+		command_print(cmd_ctx, "%d benchmarks more than %d%% slower than the baseline", regressions, slower);
+		return ERROR_FAIL;
+	}
+
+	return ERROR_OK;
+}
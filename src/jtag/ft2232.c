@@ -33,6 +33,7 @@
 #include "jtag.h"
 #include "configuration.h"
 #include "time_support.h"
+#include "span.h"
 
 /* system includes */
 #include <string.h>
@@ -163,7 +164,7 @@ jtag_interface_t ft2232_interface =
 	.quit = ft2232_quit,
 };
 
-int ft2232_write(u8 *buf, int size, u32* bytes_written)
+static int ft2232_write_device(u8 *buf, int size, u32* bytes_written)
 {
 #if BUILD_FT2232_FTD2XX == 1
 	FT_STATUS status;
@@ -195,7 +196,7 @@ int ft2232_write(u8 *buf, int size, u32* bytes_written)
 #endif
 }
 
-int ft2232_read(u8* buf, int size, u32* bytes_read)
+static int ft2232_read_device(u8* buf, int size, u32* bytes_read)
 {
 #if BUILD_FT2232_FTD2XX == 1
 	DWORD dw_bytes_read;
@@ -240,6 +241,28 @@ int ft2232_read(u8* buf, int size, u32* bytes_read)
 	return ERROR_OK;
 }
 
+int ft2232_write(u8 *buf, int size, u32* bytes_written)
+{
+	long long span = span_begin();
+	int retval;
+
+	retval = ft2232_write_device(buf, size, bytes_written);
+	span_end_arg(span, "ft2232_write", size);
+
+	return retval;
+}
+
+int ft2232_read(u8* buf, int size, u32* bytes_read)
+{
+	long long span = span_begin();
+	int retval;
+
+	retval = ft2232_read_device(buf, size, bytes_read);
+	span_end_arg(span, "ft2232_read", size);
+
+	return retval;
+}
+
 int ft2232_speed(int speed)
 {
 	u8 buf[3];
@@ -30,6 +30,7 @@
 #include <string.h>
 
 #include "log.h"
+#include "span.h"
 
 /* enable this to debug communication
  */
@@ -502,6 +503,9 @@ int jlink_handle_jlink_info_command(struct command_context_s *cmd_ctx, char *cmd
 	int result;
 	int len = 0;
 	
+	/* the adapter is used directly, let the worker finish first */
+	jtag_worker_sync();
+	
 	/* query hardware version */
 	jlink_simple_command(JLINK_FIRMWARE_VERSION);
 	result = jlink_usb_read(jlink_jtag_handle);
@@ -789,6 +793,7 @@ int jlink_usb_message(jlink_jtag_t *jlink_jtag, int out_length, int in_length)
 /* Write data from out_buffer to USB. */
 int jlink_usb_write(jlink_jtag_t *jlink_jtag, int out_length)
 {
+	long long span;
 	int result;
 	
 	if (out_length > JLINK_OUT_BUFFER_SIZE)
@@ -797,8 +802,10 @@ int jlink_usb_write(jlink_jtag_t *jlink_jtag, int out_length)
 		return -1;
 	}
 	
+	span = span_begin();
 	result = usb_bulk_write(jlink_jtag->usb_handle, JLINK_WRITE_ENDPOINT, \
 		usb_out_buffer, out_length, JLINK_USB_TIMEOUT);
+	span_end_arg(span, "jlink_usb_write", out_length);
 	
 	DEBUG_JTAG_IO("jlink_usb_write, out_length = %d, result = %d", out_length, result);
 	
@@ -811,9 +818,12 @@ int jlink_usb_write(jlink_jtag_t *jlink_jtag, int out_length)
 /* Read data from USB into in_buffer. */
 int jlink_usb_read(jlink_jtag_t *jlink_jtag)
 {
+	long long span = span_begin();
 	int result = usb_bulk_read(jlink_jtag->usb_handle, JLINK_READ_ENDPOINT, \
 		usb_in_buffer, JLINK_IN_BUFFER_SIZE, JLINK_USB_TIMEOUT);
 
+	span_end_arg(span, "jlink_usb_read", result);
+
 	DEBUG_JTAG_IO("jlink_usb_read, result = %d", result);
 	
 #ifdef _DEBUG_USB_COMMS_
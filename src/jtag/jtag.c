@@ -28,10 +28,18 @@
 #include "command.h"
 #include "log.h"
 #include "interpreter.h"
+#include "span.h"
 
 #include "stdlib.h"
 #include "string.h"
 #include <unistd.h>
+#include <sys/time.h>
+
+/* the worker hands whole command queues to the interface, a minidriver has none */
+#if defined(HAVE_PTHREAD_H) && !defined(HAVE_JTAG_MINIDRIVER_H)
+#define JTAG_WORKER
+#include <pthread.h>
+#endif
 
 
 /* note that this is not marked as static as it must be available from outside jtag.c for those 
@@ -39,6 +47,8 @@
 */
 int jtag_error=ERROR_OK; 
 
+int jtag_flush_count = 0;
+
 
 char* tap_state_strings[16] =
 {
@@ -57,6 +67,8 @@ typedef struct cmd_queue_page_s
 
 #define CMD_QUEUE_PAGE_SIZE (1024 * 1024)
 static cmd_queue_page_t *cmd_queue_pages = NULL;
+/* bytes allocated for the commands queued since the queue was last executed */
+static size_t cmd_queue_size = 0;
 
 /* tap_move[i][j]: tap movement command to go from state i to state j
  * 0: Test-Logic-Reset
@@ -119,8 +131,11 @@ enum tap_state cur_state = TAP_TLR;
 int jtag_trst = 0;
 int jtag_srst = 0;
 
+/* commands being executed by the interface, jtag_add_xxx() builds the next
+ * queue in cmd_queue_head meanwhile */
 jtag_command_t *jtag_command_queue = NULL;
-jtag_command_t **last_comand_pointer = &jtag_command_queue;
+static jtag_command_t *cmd_queue_head = NULL;
+jtag_command_t **last_comand_pointer = &cmd_queue_head;
 jtag_device_t *jtag_devices = NULL;
 int jtag_num_devices = 0;
 int jtag_ir_scan_size = 0;
@@ -271,6 +286,7 @@ int handle_irscan_command(struct command_context_s *cmd_ctx, char *cmd, char **a
 int handle_drscan_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
 
 int handle_verify_ircapture_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
+int handle_jtag_worker_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
 
 int jtag_register_event_callback(int (*callback)(enum jtag_event event, void *priv), void *priv)
 {
@@ -335,7 +351,7 @@ int jtag_call_event_callbacks(enum jtag_event event)
 }
 
 /* returns a pointer to the pointer of the last command in queue
- * this may be a pointer to the root pointer (jtag_command_queue)
+ * this may be a pointer to the root pointer (cmd_queue_head)
  * or to the next member of the last but one command
  */
 jtag_command_t** jtag_get_last_command_p(void)
@@ -395,15 +411,14 @@ void* cmd_queue_alloc(size_t size)
 
 	offset = (*p_page)->used;
 	(*p_page)->used += size;
+	cmd_queue_size += size;
 	
 	t=(u8 *)((*p_page)->address);
 	return t + offset;
 }
 
-void cmd_queue_free()
+static void cmd_queue_free_pages(cmd_queue_page_t *page)
 {
-	cmd_queue_page_t *page = cmd_queue_pages;
-
 	while (page)
 	{
 		cmd_queue_page_t *last = page;
@@ -411,12 +426,217 @@ void cmd_queue_free()
 		page = page->next;
 		free(last);
 	}
+}
+
+void cmd_queue_free()
+{
+	cmd_queue_free_pages(cmd_queue_pages);
+
+	cmd_queue_pages = NULL;
+	cmd_queue_size = 0;
+}
+
+#ifdef JTAG_WORKER
+/* With the worker enabled the interface is driven from its own thread. Once
+ * the queue holds jtag_worker_batch_size bytes of commands it is handed to the
+ * worker as a batch, and the main thread goes on queueing the next batch while
+ * the adapter works. jtag_execute_queue() waits for all batches; meanwhile the
+ * wait handler runs every JTAG_WORKER_WAIT_MS, e.g. to flush network output.
+ *
+ * This is not a threading model for the server: commands, target code and
+ * all client I/O stay on the main thread. The worker only helps queues that
+ * grow beyond the batch size, e.g. bulk memory writes; the short queues of a
+ * flash driver's status poll loop are executed one at a time as before. While
+ * jtag_execute_queue() waits, output of the command being executed keeps
+ * going out, but input of other clients is not served, it stays in the
+ * socket buffers until the command returns or yields (see server_yield()).
+ * Any command may touch targets or the JTAG queue of the command that is
+ * waiting, so running one from here would need every target driver to be
+ * re-entrant.
+ *
+ * The worker owns the interface driver and its state (cur_state, end_state and
+ * the adapter buffers) while batches are pending; code that calls into the
+ * driver directly, e.g. speed changes or adapter commands like jlink_info,
+ * calls jtag_worker_sync() first. in_handler callbacks of the scan fields run
+ * on the worker. They may only write the memory the caller reads after
+ * jtag_execute_queue() and may log, messages are forwarded by the main thread
+ * (see log_forward_deferred()). arm11's SCAN_N handler still exit()s on a
+ * communication error, from whichever thread executes the queue. */
+typedef struct jtag_batch_s
+{
+	jtag_command_t *commands;
+	cmd_queue_page_t *pages;
+	struct jtag_batch_s *next;
+} jtag_batch_t;
+
+#define JTAG_WORKER_WAIT_MS	10
+
+static int jtag_worker_enabled = 0;
+static size_t jtag_worker_batch_size = 64 * 1024;
+static int jtag_worker_started = 0;
+static pthread_t jtag_worker_thread;
+static pthread_mutex_t jtag_worker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jtag_worker_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t jtag_worker_done = PTHREAD_COND_INITIALIZER;
+static jtag_batch_t *jtag_worker_batches = NULL;
+static jtag_batch_t **jtag_worker_last_batch = &jtag_worker_batches;
+static int jtag_worker_busy = 0;
+static int jtag_worker_retval = ERROR_OK;
+static int jtag_worker_early = 0;
+static int jtag_worker_total = 0;
+#endif
+
+static void (*jtag_wait_handler)(void) = NULL;
+
+void jtag_set_wait_handler(void (*handler)(void))
+{
+	jtag_wait_handler = handler;
+}
+
+#ifdef JTAG_WORKER
+static void *jtag_worker_run(void *arg)
+{
+	span_thread_name("jtag worker");
+
+	for (;;)
+	{
+		jtag_batch_t *batch;
+		long long span;
+		int retval;
+
+		pthread_mutex_lock(&jtag_worker_mutex);
+		while (jtag_worker_batches == NULL)
+			pthread_cond_wait(&jtag_worker_work, &jtag_worker_mutex);
+		batch = jtag_worker_batches;
+		jtag_worker_batches = batch->next;
+		if (jtag_worker_batches == NULL)
+			jtag_worker_last_batch = &jtag_worker_batches;
+		jtag_worker_busy = 1;
+		pthread_mutex_unlock(&jtag_worker_mutex);
+
+		span = span_begin();
+		jtag_command_queue = batch->commands;
+		retval = jtag->execute_queue();
+		jtag_command_queue = NULL;
+		span_end(span, "interface execute_queue");
+
+		cmd_queue_free_pages(batch->pages);
+		free(batch);
+
+		pthread_mutex_lock(&jtag_worker_mutex);
+		if ((retval != ERROR_OK) && (jtag_worker_retval == ERROR_OK))
+			jtag_worker_retval = retval;
+		jtag_worker_busy = 0;
+		pthread_cond_broadcast(&jtag_worker_done);
+		pthread_mutex_unlock(&jtag_worker_mutex);
+	}
+
+	return NULL;
+}
+
+/* hand the queued commands to the worker */
+static int jtag_worker_submit(void)
+{
+	jtag_batch_t *batch;
+
+	if (cmd_queue_head == NULL)
+		return ERROR_OK;
+
+	if (!jtag_worker_started)
+	{
+		if (pthread_create(&jtag_worker_thread, NULL, jtag_worker_run, NULL) != 0)
+		{
+			LOG_WARNING("couldn't start the JTAG worker thread, executing the queue directly");
+			jtag_worker_enabled = 0;
+			return ERROR_FAIL;
+		}
+		jtag_worker_started = 1;
+	}
 
+	batch = malloc(sizeof(jtag_batch_t));
+	batch->commands = cmd_queue_head;
+	batch->pages = cmd_queue_pages;
+	batch->next = NULL;
+
+	cmd_queue_head = NULL;
+	last_comand_pointer = &cmd_queue_head;
 	cmd_queue_pages = NULL;
+	cmd_queue_size = 0;
+
+	pthread_mutex_lock(&jtag_worker_mutex);
+	*jtag_worker_last_batch = batch;
+	jtag_worker_last_batch = &batch->next;
+	jtag_worker_total++;
+	pthread_cond_signal(&jtag_worker_work);
+	pthread_mutex_unlock(&jtag_worker_mutex);
+
+	return ERROR_OK;
+}
+
+/* start on a large queue before the commands following it are queued */
+static void jtag_worker_submit_if_full(void)
+{
+	if (jtag_worker_enabled && (cmd_queue_size >= jtag_worker_batch_size))
+	{
+		if (jtag_worker_submit() == ERROR_OK)
+			jtag_worker_early++;
+	}
+}
+#endif
+
+/* wait until the worker has executed everything handed to it, returns the
+ * first error any of these batches reported. The interface may be accessed
+ * directly afterwards, commands that are still queued are not executed. */
+int jtag_worker_sync(void)
+{
+#ifdef JTAG_WORKER
+	int retval;
+
+	if (!jtag_worker_started)
+		return ERROR_OK;
+
+	pthread_mutex_lock(&jtag_worker_mutex);
+	while (jtag_worker_batches || jtag_worker_busy)
+	{
+		struct timeval now;
+		struct timespec timeout;
+
+		gettimeofday(&now, NULL);
+		timeout.tv_sec = now.tv_sec;
+		timeout.tv_nsec = (now.tv_usec + JTAG_WORKER_WAIT_MS * 1000) * 1000;
+		if (timeout.tv_nsec >= 1000000000)
+		{
+			timeout.tv_sec++;
+			timeout.tv_nsec -= 1000000000;
+		}
+
+		if (pthread_cond_timedwait(&jtag_worker_done, &jtag_worker_mutex, &timeout) != 0)
+		{
+			pthread_mutex_unlock(&jtag_worker_mutex);
+			log_forward_deferred();
+			if (jtag_wait_handler)
+				jtag_wait_handler();
+			pthread_mutex_lock(&jtag_worker_mutex);
+		}
+	}
+	retval = jtag_worker_retval;
+	jtag_worker_retval = ERROR_OK;
+	pthread_mutex_unlock(&jtag_worker_mutex);
+
+	log_forward_deferred();
+
+	return retval;
+#else
+	return ERROR_OK;
+#endif
 }
 
 static void jtag_prelude1()
 {
+#ifdef JTAG_WORKER
+	jtag_worker_submit_if_full();
+#endif
+
 	if (jtag_trst == 1)
 	{
 		LOG_WARNING("JTAG command queued, while TRST is low (TAP in reset)");
@@ -683,8 +903,14 @@ void MINIDRIVER(interface_jtag_add_dr_out)(int device_num,
 	int scan_size;
 	int bypass_devices = 0;
 
-	jtag_command_t **last_cmd = jtag_get_last_command_p();
+	jtag_command_t **last_cmd;
 	jtag_device_t *device = jtag_devices;
+	
+#ifdef JTAG_WORKER
+	jtag_worker_submit_if_full();
+#endif
+	last_cmd = jtag_get_last_command_p();
+	
 	/* count devices in bypass */
 	while (device)
 	{
@@ -1261,19 +1487,32 @@ int MINIDRIVER(interface_jtag_execute_queue)(void)
 {
 	int retval;
 
+#ifdef JTAG_WORKER
+	if (jtag_worker_enabled && (jtag_worker_submit() == ERROR_OK))
+		return jtag_worker_sync();
+#endif
+
+	jtag_command_queue = cmd_queue_head;
 	retval = jtag->execute_queue();
 	
 	cmd_queue_free();
 
 	jtag_command_queue = NULL;
-	last_comand_pointer = &jtag_command_queue;
+	cmd_queue_head = NULL;
+	last_comand_pointer = &cmd_queue_head;
 
 	return retval;
 }
 
 int jtag_execute_queue(void)
 {
-	int retval=interface_jtag_execute_queue();
+	long long span = span_begin();
+	int retval;
+
+	jtag_flush_count++;
+
+	retval=interface_jtag_execute_queue();
+	span_end(span, "jtag_execute_queue");
 	if (retval==ERROR_OK)
 	{
 		retval=jtag_error;
@@ -1491,6 +1730,8 @@ int jtag_register_commands(struct command_context_s *cmd_ctx)
 
 	register_command(cmd_ctx, NULL, "verify_ircapture", handle_verify_ircapture_command,
 		COMMAND_ANY, "verify value captured during Capture-IR <enable|disable>");
+	register_command(cmd_ctx, NULL, "jtag_worker", handle_jtag_worker_command,
+		COMMAND_ANY, "overlap adapter I/O with queueing for queues larger than the batch size, client input still waits [on|off] [batch kbytes]");
 	return ERROR_OK;
 }
 
@@ -1865,6 +2106,7 @@ int handle_jtag_speed_command(struct command_context_s *cmd_ctx, char *cmd, char
 		 * in which case jtag isn't initialized */
 		if (jtag)
 		{
+			jtag_worker_sync();
 			jtag->speed_div(jtag_speed, &speed1);
 			jtag->speed_div(jtag_speed_post_reset, &speed2);
 			jtag->speed(cur_speed);
@@ -1911,6 +2153,7 @@ int handle_jtag_khz_command(struct command_context_s *cmd_ctx, char *cmd, char *
 			if (argc == 2)
 				cur_speed = jtag_speed_post_reset = speed_div2;
 	
+			jtag_worker_sync();
 			jtag->speed(cur_speed);
 		} else
 		{
@@ -2119,3 +2362,42 @@ int handle_verify_ircapture_command(struct command_context_s *cmd_ctx, char *cmd
 	
 	return ERROR_OK;
 }
+
+int handle_jtag_worker_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
+{
+#ifdef JTAG_WORKER
+	if (argc > 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	
+	if (argc >= 1)
+	{
+		if (strcmp(args[0], "on") == 0)
+			jtag_worker_enabled = 1;
+		else if (strcmp(args[0], "off") == 0)
+		{
+			/* the queue is executed directly from now on, errors of
+			 * batches the worker still had show up in the next execute */
+			int retval;
+			jtag_worker_enabled = 0;
+			if ((retval = jtag_worker_sync()) != ERROR_OK)
+				jtag_error = retval;
+		}
+		else
+			return ERROR_COMMAND_SYNTAX_ERROR;
+	}
+	
+	if (argc == 2)
+	{
+		jtag_worker_batch_size = strtoul(args[1], NULL, 0) * 1024;
+		if (jtag_worker_batch_size == 0)
+			jtag_worker_batch_size = CMD_QUEUE_PAGE_SIZE;
+	}
+	
+	command_print(cmd_ctx, "jtag worker %s, batches of %i kbytes, %i of %i batches started before execute_queue",
+		jtag_worker_enabled ? "on" : "off", (int)(jtag_worker_batch_size / 1024), jtag_worker_early, jtag_worker_total);
+#else
+	command_print(cmd_ctx, "jtag worker not available in this build");
+#endif
+	
+	return ERROR_OK;
+}
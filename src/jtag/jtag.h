@@ -378,9 +378,19 @@ extern int interface_jtag_add_sleep(u32 us);
  * at some time between the jtag_add_xxx() fn call and jtag_execute_queue().  
  */
 extern int jtag_execute_queue(void);
+/* number of jtag_execute_queue() calls so far, for benchmarks */
+extern int jtag_flush_count;
 /* can be implemented by hw+sw */
 extern int interface_jtag_execute_queue(void);
 
+/* With "jtag_worker on" the interface runs on a worker thread. Code accessing
+ * the interface directly, e.g. jtag->speed(), calls this first; it waits for
+ * the commands the worker has been handed, but doesn't execute the queue.
+ */
+extern int jtag_worker_sync(void);
+/* called every few ms while jtag_execute_queue() waits for the worker */
+extern void jtag_set_wait_handler(void (*handler)(void));
+
 /* JTAG support functions */
 extern void jtag_set_check_value(scan_field_t *field, u8 *value,  u8 *mask, error_handler_t *in_error_handler);
 extern enum scan_type jtag_scan_type(scan_command_t *cmd);
@@ -36,9 +36,13 @@
 #include "pld.h"
 
 #include "command.h"
+#include "crc32.h"
+#include "benchmark.h"
+#include "span.h"
 #include "server.h"
 #include "telnet_server.h"
 #include "gdb_server.h"
+#include "rpc_server.h"
 
 #include <sys/time.h>
 #include <sys/types.h>
@@ -49,6 +53,10 @@
 #include <unistd.h>
 #include <errno.h>
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 /* Give TELNET a way to find out what version this is */
 int handle_version_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
 {
@@ -78,7 +86,10 @@ void exit_handler(void)
 {
 	/* close JTAG interface */
 	if (jtag && jtag->quit)
+	{
+		jtag_worker_sync();
 		jtag->quit();
+	}
 }
 
 
@@ -139,19 +150,32 @@ int handle_init_command(struct command_context_s *cmd_ctx, char *cmd, char **arg
 	/* initialize telnet subsystem */
 	telnet_init("Open On-Chip Debugger");
 	gdb_init();
+	rpc_init();
 
 	return ERROR_OK;
 }
 
 
 /* implementations of OpenOCD that uses multithreading needs to lock OpenOCD while calling
- * OpenOCD fn's. No-op in vanilla OpenOCD
+ * OpenOCD fn's. The server loop holds the lock except while it sleeps, so other threads
+ * can take it then. The JTAG worker doesn't need it, it only touches the interface and
+ * the command batches handed to it.
  */
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t big_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 void lockBigLock()
 {
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&big_lock);
+#endif
 }
 void unlockBigLock()
 {
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&big_lock);
+#endif
 }
 
 
@@ -170,6 +194,7 @@ int main(int argc, char *argv[])
 	server_register_commands(cmd_ctx);
 	telnet_register_commands(cmd_ctx);
 	gdb_register_commands(cmd_ctx);
+	rpc_register_commands(cmd_ctx);
 	log_register_commands(cmd_ctx);
 	jtag_register_commands(cmd_ctx);
 	interpreter_register_commands(cmd_ctx);
@@ -178,6 +203,9 @@ int main(int argc, char *argv[])
 	flash_register_commands(cmd_ctx);
 	nand_register_commands(cmd_ctx);
 	pld_register_commands(cmd_ctx);
+	crc32_register_commands(cmd_ctx);
+	benchmark_register_commands(cmd_ctx);
+	span_register_commands(cmd_ctx);
 	
 	if (log_init(cmd_ctx) != ERROR_OK)
 		return EXIT_FAILURE;
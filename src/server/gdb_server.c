@@ -33,6 +33,11 @@
 #include "flash.h"
 #include "target_request.h"
 #include "configuration.h"
+#include "armv4_5.h"
+#include "armv7m.h"
+#include "arm_simulator.h"
+#include "time_support.h"
+#include "span.h"
 
 #include <string.h>
 #include <errno.h>
@@ -44,7 +49,12 @@
 #endif
 
 extern int gdb_error(connection_t *connection, int retval);
+int gdb_target_callback_event_handler(struct target_s *target, enum target_event event, void *priv);
+int gdb_flush(connection_t *connection);
+int gdb_write_flush(connection_t *connection, target_t *target);
 static unsigned short gdb_port;
+/* set while input is served from server_yield(), see gdb_yield_input() */
+static int gdb_yield_serving = 0;
 static const char *DIGITS = "0123456789abcdef";
 
 static void gdb_log_callback(void *priv, const char *file, int line,
@@ -157,6 +167,10 @@ int gdb_get_char(connection_t *connection, int* next_char)
 		return ERROR_OK;
 	}
 
+	/* whatever we sent gdb has to be out before we wait for its answer */
+	if ((retval = gdb_flush(connection)) != ERROR_OK)
+		return retval;
+
 	for (;;)
 	{
 		retval=check_pending(connection, 1, NULL);
@@ -259,7 +273,21 @@ int gdb_write(connection_t *connection, void *data, int len)
 	if (gdb_con->closed)
 		return ERROR_SERVER_REMOTE_CLOSED;
 
-	if (write_socket(connection->fd, data, len) == len)
+	if (connection_write(connection, data, len) == ERROR_OK)
+	{
+		return ERROR_OK;
+	}
+	gdb_con->closed = 1;
+	return ERROR_SERVER_REMOTE_CLOSED;
+}
+
+int gdb_flush(connection_t *connection)
+{
+	gdb_connection_t *gdb_con = connection->priv;
+	if (gdb_con->closed)
+		return ERROR_SERVER_REMOTE_CLOSED;
+
+	if (connection_flush(connection) == ERROR_OK)
 	{
 		return ERROR_OK;
 	}
@@ -289,7 +317,8 @@ int gdb_put_packet_inner(connection_t *connection, char *buffer, int len)
 	 */
 #ifndef _WIN32
 	int gotdata;
-	for (;;)
+	/* in no-ack mode pending input is the next packet */
+	while (!gdb_con->noack_mode)
 	{
 		if ((retval=check_pending(connection, 0, &gotdata))!=ERROR_OK)
 			return retval;
@@ -335,6 +364,12 @@ int gdb_put_packet_inner(connection_t *connection, char *buffer, int len)
 			gdb_write(connection, local_buffer+1, 3);
 		}
 
+		/* after QStartNoAckMode gdb doesn't acknowledge packets, the transport is
+		 * reliable. Nothing waits for an ack that would flush the output, e.g. for
+		 * the 'O' packets of a long monitor command, so it goes out right away */
+		if (gdb_con->noack_mode)
+			return gdb_flush(connection);
+
 		if ((retval = gdb_get_char(connection, &reply)) != ERROR_OK)
 			return retval;
 
@@ -388,6 +423,39 @@ int gdb_put_packet(connection_t *connection, char *buffer, int len)
 	return retval;
 }
 
+/* asynchronous notifications aren't acknowledged, not even outside of no-ack mode */
+int gdb_put_notification(connection_t *connection, char *buffer, int len)
+{
+	unsigned char my_checksum = 0;
+	char *notification;
+	int retval;
+	int i;
+
+	for (i = 0; i < len; i++)
+		my_checksum += buffer[i];
+
+	if ((notification = malloc(len + 4)) == NULL)
+		return ERROR_FAIL;
+
+	notification[0] = '%';
+	memcpy(notification + 1, buffer, len);
+	notification[len + 1] = '#';
+	notification[len + 2] = DIGITS[(my_checksum >> 4) & 0xf];
+	notification[len + 3] = DIGITS[my_checksum & 0xf];
+
+	LOG_DEBUG("sending notification '%%%.*s'", len, buffer);
+
+	retval = gdb_write(connection, notification, len + 4);
+
+	free(notification);
+
+	/* notifications are asynchronous, nothing else would flush them */
+	if (retval == ERROR_OK)
+		retval = gdb_flush(connection);
+
+	return retval;
+}
+
 int gdb_get_packet_inner(connection_t *connection, char *buffer, int *len)
 {
 	int character;
@@ -522,6 +590,14 @@ int gdb_get_packet_inner(connection_t *connection, char *buffer, int *len)
 		checksum[1] = character;
 		checksum[2] = 0;
 
+		if (gdb_con->noack_mode)
+		{
+			/* no retransmission possible, the packet is processed anyway */
+			if (my_checksum != strtoul(checksum, NULL, 16))
+				LOG_WARNING("checksum error in no-ack mode");
+			break;
+		}
+
 		if (my_checksum == strtoul(checksum, NULL, 16))
 		{
 			gdb_write(connection, "+", 1);
@@ -603,9 +679,14 @@ int gdb_target_callback_event_handler(struct target_s *target, enum target_event
 {
 	connection_t *connection = priv;
 	gdb_connection_t *gdb_connection = connection->priv;
-	char sig_reply[4];
+	gdb_service_t *gdb_service = connection->service->priv;
+	char sig_reply[20];
 	int signal;
 
+	/* each gdb connection only follows its own target */
+	if (target != gdb_service->target)
+		return ERROR_OK;
+
 	switch (event)
 	{
 		case TARGET_EVENT_HALTED:
@@ -618,7 +699,8 @@ int gdb_target_callback_event_handler(struct target_s *target, enum target_event
 			 * out of the running state so we'll see lots of TARGET_EVENT_XXX
 			 * that are to be ignored.
 			 */
-			if (gdb_connection->frontend_state == TARGET_RUNNING)
+			/* intermediate halts while range stepping aren't reported */
+			if ((gdb_connection->frontend_state == TARGET_RUNNING) && !gdb_connection->range_stepping)
 			{
 				/* stop forwarding log packets! */
 				log_remove_callback(gdb_log_callback, connection);
@@ -628,13 +710,28 @@ int gdb_target_callback_event_handler(struct target_s *target, enum target_event
 					signal = 0x2;
 					gdb_connection->ctrl_c = 0;
 				}
+				else if (gdb_connection->halt_requested)
+				{
+					/* vCont;t stops are reported without a signal */
+					signal = 0x0;
+				}
 				else
 				{
 					signal = gdb_last_signal(target);
 				}
+				gdb_connection->halt_requested = 0;
 
-				snprintf(sig_reply, 4, "T%2.2x", signal);
-				gdb_put_packet(connection, sig_reply, 3);
+				if (gdb_connection->non_stop)
+				{
+					/* gdb picks this up with vStopped, thread 1 is the only one */
+					snprintf(sig_reply, sizeof(sig_reply), "Stop:T%2.2xthread:1;", signal);
+					gdb_put_notification(connection, sig_reply, strlen(sig_reply));
+				}
+				else
+				{
+					snprintf(sig_reply, 4, "T%2.2x", signal);
+					gdb_put_packet(connection, sig_reply, 3);
+				}
 				gdb_connection->frontend_state = TARGET_HALTED;
 			}
 			break;
@@ -663,9 +760,36 @@ int gdb_new_connection(connection_t *connection)
 	gdb_connection->buf_cnt = 0;
 	gdb_connection->ctrl_c = 0;
 	gdb_connection->frontend_state = TARGET_HALTED;
-	gdb_connection->vflash_image = NULL;
+	gdb_connection->vflash_address = 0;
+	gdb_connection->vflash_buffer = NULL;
+	gdb_connection->vflash_size = 0;
+	gdb_connection->vflash_buffer_size = 0;
+	gdb_connection->vflash_written = 0;
+	gdb_connection->vflash_error = ERROR_OK;
 	gdb_connection->closed = 0;
 	gdb_connection->busy = 0;
+	gdb_connection->noack_mode = 0;
+	gdb_connection->range_stepping = 0;
+	gdb_connection->non_stop = 0;
+	gdb_connection->halt_requested = 0;
+	gdb_connection->extended_protocol = 0;
+	gdb_connection->memory_map = NULL;
+	gdb_connection->memory_map_len = 0;
+	gdb_connection->memory_map_signature = 0;
+	gdb_connection->tdesc = NULL;
+	gdb_connection->tdesc_len = 0;
+	gdb_connection->tdesc_m_profile = 0;
+	gdb_connection->skip_fpa = 0;
+	gdb_connection->write_address = 0;
+	gdb_connection->write_buffer = NULL;
+	gdb_connection->write_size = 0;
+	gdb_connection->write_buffer_size = 0;
+	gdb_connection->write_error = ERROR_OK;
+	gdb_connection->deferred_size = 0;
+	gdb_connection->read_buffer = NULL;
+	gdb_connection->read_buffer_size = 0;
+	gdb_connection->reply_buffer = NULL;
+	gdb_connection->reply_buffer_size = 0;
 	
 	/* send ACK to GDB for debug request */
 	gdb_write(connection, "+", 1);
@@ -673,6 +797,9 @@ int gdb_new_connection(connection_t *connection)
 	/* output goes through gdb connection */
 	command_set_output_handler(connection->cmd_ctx, gdb_output, connection);
 
+	/* monitor commands act on the target this port belongs to */
+	connection->cmd_ctx->current_target = gdb_service->target_num;
+
 	/* register callback to be informed about target events */
 	target_register_event_callback(gdb_target_callback_event_handler, connection);
 
@@ -712,13 +839,18 @@ int gdb_connection_closed(connection_t *connection)
 	gdb_service_t *gdb_service = connection->service->priv;
 	gdb_connection_t *gdb_connection = connection->priv;
 
-	/* see if an image built with vFlash commands is left */
-	if (gdb_connection->vflash_image)
-	{
-		image_close(gdb_connection->vflash_image);
-		free(gdb_connection->vflash_image);
-		gdb_connection->vflash_image = NULL;
-	}
+	/* vFlash data that didn't see a vFlashDone is dropped */
+	free(gdb_connection->vflash_buffer);
+	gdb_connection->vflash_buffer = NULL;
+
+	/* memory writes gdb already saw acknowledged are completed */
+	gdb_write_flush(connection, gdb_service->target);
+	free(gdb_connection->write_buffer);
+
+	free(gdb_connection->read_buffer);
+	free(gdb_connection->reply_buffer);
+	free(gdb_connection->memory_map);
+	free(gdb_connection->tdesc);
 
 	/* if this connection registered a debug-message receiver delete it */
 	delete_debug_msg_receiver(connection->cmd_ctx, gdb_service->target);
@@ -748,11 +880,28 @@ void gdb_send_error(connection_t *connection, u8 the_error)
 
 int gdb_last_signal_packet(connection_t *connection, target_t *target, char* packet, int packet_size)
 {
+	gdb_connection_t *gdb_con = connection->priv;
 	char sig_reply[4];
 	int signal;
 
+	/* in non-stop mode a running target has nothing to report */
+	if (gdb_con->non_stop && (target->state != TARGET_HALTED))
+	{
+		gdb_put_packet(connection, "OK", 2);
+		return ERROR_OK;
+	}
+
 	signal = gdb_last_signal(target);
 
+	if (gdb_con->non_stop)
+	{
+		/* a stop reply naming the thread, vStopped follows */
+		char stop_reply[32];
+		snprintf(stop_reply, sizeof(stop_reply), "T%2.2xthread:1;", signal);
+		gdb_put_packet(connection, stop_reply, strlen(stop_reply));
+		return ERROR_OK;
+	}
+
 	snprintf(sig_reply, 4, "S%2.2x", signal);
 	gdb_put_packet(connection, sig_reply, 3);
 
@@ -796,6 +945,14 @@ void gdb_target_to_str(target_t *target, char *tstr, char *str)
 	}
 }
 
+/* f0-f7 and fps, not part of an M-profile target description */
+static int gdb_reg_skipped(connection_t *connection, int reg_num)
+{
+	gdb_connection_t *gdb_con = connection->priv;
+
+	return gdb_con->skip_fpa && (reg_num >= 16) && (reg_num < 25);
+}
+
 int gdb_get_registers_packet(connection_t *connection, target_t *target, char* packet, int packet_size)
 {
 	reg_t **reg_list;
@@ -817,7 +974,8 @@ int gdb_get_registers_packet(connection_t *connection, target_t *target, char* p
 
 	for (i = 0; i < reg_list_size; i++)
 	{
-		reg_packet_size += reg_list[i]->size;
+		if (!gdb_reg_skipped(connection, i))
+			reg_packet_size += reg_list[i]->size;
 	}
 
 	reg_packet = malloc(CEIL(reg_packet_size, 8) * 2);
@@ -825,6 +983,8 @@ int gdb_get_registers_packet(connection_t *connection, target_t *target, char* p
 
 	for (i = 0; i < reg_list_size; i++)
 	{
+		if (gdb_reg_skipped(connection, i))
+			continue;
 		gdb_str_to_target(target, reg_packet_p, reg_list[i]);
 		reg_packet_p += CEIL(reg_list[i]->size, 8) * 2;
 	}
@@ -880,6 +1040,9 @@ int gdb_set_registers_packet(connection_t *connection, target_t *target, char *p
 		char *hex_buf;
 		reg_arch_type_t *arch_type;
 
+		if (gdb_reg_skipped(connection, i))
+			continue;
+
 		/* convert from GDB-string (target-endian) to hex-string (big-endian) */
 		hex_buf = malloc(CEIL(reg_list[i]->size, 8) * 2);
 		gdb_target_to_str(target, packet_p, hex_buf);
@@ -1029,19 +1192,43 @@ int gdb_error(connection_t *connection, int retval)
 	return ERROR_OK;
 }
 
+/* grow one of the per-connection buffers reused by the memory read packets */
+static void *gdb_con_buffer(void **buffer, int *size, int needed)
+{
+	if (*size < needed)
+	{
+		free(*buffer);
+		if ((*buffer = malloc(needed)) == NULL)
+		{
+			*size = 0;
+			return NULL;
+		}
+		*size = needed;
+	}
+
+	return *buffer;
+}
+
 /* We don't have to worry about the default 2 second timeout for GDB packets,
  * because GDB breaks up large memory reads into smaller reads.
  *
  * 8191 bytes by the looks of it. Why 8191 bytes instead of 8192?????
+ *
+ * 'm' replies with hex data, 'x' (announced as binary-upload) with a 'b'
+ * followed by the raw data, escaped just like the data of 'X' packets.
  */
 int gdb_read_memory_packet(connection_t *connection, target_t *target, char *packet, int packet_size)
 {
+	gdb_connection_t *gdb_con = connection->priv;
 	char *separator;
 	u32 addr = 0;
 	u32 len = 0;
+	int binary = (packet[0] == 'x');
 
 	u8 *buffer;
-	char *hex_buffer;
+	char *reply;
+	int reply_len;
+	u32 i;
 
 	int retval = ERROR_OK;
 
@@ -1058,11 +1245,44 @@ int gdb_read_memory_packet(connection_t *connection, target_t *target, char *pac
 
 	len = strtoul(separator+1, NULL, 16);
 
-	buffer = malloc(len);
+	/* worst case the reply is twice the size of the data, for hex and for fully
+	 * escaped binary. Longer reads are cut short to what fits into a packet,
+	 * gdb asks for the rest in another packet */
+	if (len > (binary ? (GDB_BUFFER_SIZE - 2) / 2 : (GDB_BUFFER_SIZE - 1) / 2))
+		len = binary ? (GDB_BUFFER_SIZE - 2) / 2 : (GDB_BUFFER_SIZE - 1) / 2;
+
+	buffer = gdb_con_buffer((void **)&gdb_con->read_buffer, &gdb_con->read_buffer_size, len);
+	reply = gdb_con_buffer((void **)&gdb_con->reply_buffer, &gdb_con->reply_buffer_size, len * 2 + 1);
+	if ((len > 0) && ((buffer == NULL) || (reply == NULL)))
+	{
+		LOG_ERROR("error allocating buffer for memory read (%d bytes)", len);
+		gdb_send_error(connection, 0x0C);
+		return ERROR_OK;
+	}
 
 	LOG_DEBUG("addr: 0x%8.8x, len: 0x%8.8x", addr, len);
 
-	retval = target_read_buffer(target, addr, len, buffer);
+	/* large reads let target polling and output go on in between chunks */
+	for (i = 0; i < len; i += GDB_YIELD_CHUNK_SIZE)
+	{
+		u32 chunk = ((len - i) > GDB_YIELD_CHUNK_SIZE) ? GDB_YIELD_CHUNK_SIZE : (len - i);
+
+		if (i > 0)
+		{
+			command_yield();
+
+			/* a ^C that arrived meanwhile ends the read */
+			if (gdb_con->ctrl_c)
+			{
+				gdb_con->ctrl_c = 0;
+				gdb_send_error(connection, EINTR);
+				return ERROR_OK;
+			}
+		}
+
+		if ((retval = target_read_buffer(target, addr + i, chunk, buffer + i)) != ERROR_OK)
+			break;
+	}
 
 	if ((retval == ERROR_TARGET_DATA_ABORT) && (!gdb_report_data_abort))
 	{
@@ -1084,27 +1304,39 @@ int gdb_read_memory_packet(connection_t *connection, target_t *target, char *pac
 
 	if (retval == ERROR_OK)
 	{
-		hex_buffer = malloc(len * 2 + 1);
-
-		int i;
-		for (i = 0; i < len; i++)
+		if (binary)
+		{
+			reply_len = 0;
+			reply[reply_len++] = 'b';
+			for (i = 0; i < len; i++)
+			{
+				u8 t = buffer[i];
+				if ((t == '#') || (t == '$') || (t == '}') || (t == '*'))
+				{
+					reply[reply_len++] = '}';
+					t ^= 0x20;
+				}
+				reply[reply_len++] = t;
+			}
+		}
+		else
 		{
-			u8 t = buffer[i];
-			hex_buffer[2 * i] = DIGITS[(t >> 4) & 0xf];
-			hex_buffer[2 * i + 1] = DIGITS[t & 0xf];
+			for (i = 0; i < len; i++)
+			{
+				u8 t = buffer[i];
+				reply[2 * i] = DIGITS[(t >> 4) & 0xf];
+				reply[2 * i + 1] = DIGITS[t & 0xf];
+			}
+			reply_len = len * 2;
 		}
 
-		gdb_put_packet(connection, hex_buffer, len * 2);
-
-		free(hex_buffer);
+		gdb_put_packet(connection, reply, reply_len);
 	}
 	else
 	{
 		retval = gdb_error(connection, retval);
 	}
 
-	free(buffer);
-
 	return retval;
 }
 
@@ -1165,8 +1397,18 @@ int gdb_write_memory_packet(connection_t *connection, target_t *target, char *pa
 	return retval;
 }
 
+/* gdb waits for the reply to each X packet, so the data is written
+ * before it is acknowledged and a failure is the reply to this packet.
+ * With the 64K PacketSize a gdb load sends large enough X packets that
+ * each one is an efficient bulk write by itself. */
+/* Contiguous X packets, as sent by a gdb load, are acknowledged at once and
+ * collected. They are written in one go when the run breaks, when
+ * GDB_WRITE_COALESCE_SIZE is reached, before any other packet of this
+ * connection and before input of any other connection is handled. A failed
+ * write is the reply to the next packet. */
 int gdb_write_memory_binary_packet(connection_t *connection, target_t *target, char *packet, int packet_size)
 {
+	gdb_connection_t *gdb_con = connection->priv;
 	char *separator;
 	u32 addr = 0;
 	u32 len = 0;
@@ -1192,20 +1434,42 @@ int gdb_write_memory_binary_packet(connection_t *connection, target_t *target, c
 		return ERROR_SERVER_REMOTE_CLOSED;
 	}
 
-	retval = ERROR_OK;
-	if (len)
+	/* a write that doesn't continue the collected data starts a new run */
+	if ((gdb_con->write_size > 0) && (addr != gdb_con->write_address + gdb_con->write_size))
+		gdb_write_flush(connection, target);
+
+	if ((len > 0) && (gdb_con->write_error == ERROR_OK))
 	{
 		LOG_DEBUG("addr: 0x%8.8x, len: 0x%8.8x", addr, len);
 
-		retval = target_write_buffer(target, addr, len, (u8*)separator);
+		if (gdb_con_buffer((void **)&gdb_con->write_buffer, &gdb_con->write_buffer_size, gdb_con->write_size + len) == NULL)
+		{
+			/* write what we have, then this packet on its own */
+			gdb_write_flush(connection, target);
+			if (gdb_con->write_error == ERROR_OK)
+				gdb_con->write_error = target_write_buffer(target, addr, len, (u8*)separator);
+		}
+		else
+		{
+			if (gdb_con->write_size == 0)
+				gdb_con->write_address = addr;
+			memcpy(gdb_con->write_buffer + gdb_con->write_size, separator, len);
+			gdb_con->write_size += len;
+		}
 	}
 
-	if (retval == ERROR_OK)
+	/* zero length writes are probes, they see all data written */
+	if ((len == 0) || (gdb_con->write_size >= GDB_WRITE_COALESCE_SIZE))
+		gdb_write_flush(connection, target);
+
+	if (gdb_con->write_error == ERROR_OK)
 	{
 		gdb_put_packet(connection, "OK", 2);
 	}
 	else
 	{
+		retval = gdb_con->write_error;
+		gdb_con->write_error = ERROR_OK;
 		if ((retval = gdb_error(connection, retval)) != ERROR_OK)
 			return retval;
 	}
@@ -1213,6 +1477,34 @@ int gdb_write_memory_binary_packet(connection_t *connection, target_t *target, c
 	return ERROR_OK;
 }
 
+/* Write the data collected from X packets. A failure is kept in
+ * write_error and reported in the reply to the next packet. */
+int gdb_write_flush(connection_t *connection, target_t *target)
+{
+	gdb_connection_t *gdb_con = connection->priv;
+	int retval = ERROR_OK;
+
+	if (gdb_con->write_size > 0)
+	{
+		LOG_DEBUG("writing 0x%8.8x bytes at 0x%8.8x", gdb_con->write_size, gdb_con->write_address);
+		retval = target_write_buffer(target, gdb_con->write_address, gdb_con->write_size, gdb_con->write_buffer);
+		gdb_con->write_size = 0;
+
+		if (gdb_con->write_error == ERROR_OK)
+			gdb_con->write_error = retval;
+	}
+
+	return retval;
+}
+
+/* the server is about to handle input of another connection */
+int gdb_connection_sync(connection_t *connection)
+{
+	gdb_service_t *gdb_service = connection->service->priv;
+
+	return gdb_write_flush(connection, gdb_service->target);
+}
+
 void gdb_step_continue_packet(connection_t *connection, target_t *target, char *packet, int packet_size)
 {
 	int current = 0;
@@ -1242,109 +1534,420 @@ void gdb_step_continue_packet(connection_t *connection, target_t *target, char *
 	}
 }
 
-int gdb_breakpoint_watchpoint_packet(connection_t *connection, target_t *target, char *packet, int packet_size)
+/* read the pc from the gdb register list, r15 on all ARM targets */
+int gdb_get_pc(target_t *target, u32 *pc)
 {
-	int type;
-	enum breakpoint_type bp_type = BKPT_SOFT /* dummy init to avoid warning */;
-	enum watchpoint_rw wp_type;
-	u32 address;
-	u32 size;
-	char *separator;
+	reg_t **reg_list;
+	int reg_list_size;
 	int retval;
 
-	LOG_DEBUG("-");
-
-	type = strtoul(packet + 1, &separator, 16);
-
-	if (type == 0)	/* memory breakpoint */
-		bp_type = BKPT_SOFT;
-	else if (type == 1) /* hardware breakpoint */
-		bp_type = BKPT_HARD;
-	else if (type == 2) /* write watchpoint */
-		wp_type = WPT_WRITE;
-	else if (type == 3) /* read watchpoint */
-		wp_type = WPT_READ;
-	else if (type == 4) /* access watchpoint */
-		wp_type = WPT_ACCESS;
+	if ((retval = target->type->get_gdb_reg_list(target, &reg_list, &reg_list_size)) != ERROR_OK)
+		return retval;
 
-	if (*separator != ',')
+	if (reg_list_size <= 15)
 	{
-		LOG_ERROR("incomplete breakpoint/watchpoint packet received, dropping connection");
-		return ERROR_SERVER_REMOTE_CLOSED;
+		free(reg_list);
+		return ERROR_FAIL;
 	}
 
-	address = strtoul(separator+1, &separator, 16);
+	*pc = buf_get_u32(reg_list[15]->value, 0, 32);
 
-	if (*separator != ',')
+	free(reg_list);
+
+	return ERROR_OK;
+}
+
+/* consume a ^C gdb sent while the target runs, other input is left for the packet parser */
+static void gdb_poll_ctrl_c(connection_t *connection)
+{
+	gdb_connection_t *gdb_con = connection->priv;
+	int got_data;
+	int character;
+
+	if ((check_pending(connection, 0, &got_data) != ERROR_OK) || !got_data)
+		return;
+
+	if (gdb_get_char(connection, &character) != ERROR_OK)
+		return;
+
+	if (character == 0x3)
 	{
-		LOG_ERROR("incomplete breakpoint/watchpoint packet received, dropping connection");
-		return ERROR_SERVER_REMOTE_CLOSED;
+		gdb_con->ctrl_c = 1;
+	}
+	else
+	{
+		gdb_putback_char(connection, character);
+		connection->input_pending = 1;
 	}
+}
 
-	size = strtoul(separator+1, &separator, 16);
+/* resume until the breakpoint at address is hit, returns ERROR_TARGET_TIMEOUT if it isn't.
+ * A breakpoint the user already set there is used, and left in place. */
+int gdb_run_to_address(connection_t *connection, target_t *target, u32 address, int size)
+{
+	gdb_connection_t *gdb_con = connection->priv;
+	int user_breakpoint = (breakpoint_find(target, address) != NULL);
+	deadline_t deadline;
+	int retval;
 
-	switch (type)
+	if (!user_breakpoint && ((retval = breakpoint_add(target, address, size, BKPT_HARD)) != ERROR_OK))
+		return retval;
+
+	if ((retval = target_resume(target, 1, 0, 1, 0)) == ERROR_OK)
 	{
-		case 0:
-		case 1:
-			if (packet[0] == 'Z')
-			{
-				if ((retval = breakpoint_add(target, address, size, bp_type)) != ERROR_OK)
-				{
-					if ((retval = gdb_error(connection, retval)) != ERROR_OK)
-						return retval;
-				}
-				else
-				{
-					gdb_put_packet(connection, "OK", 2);
-				}
-			}
-			else
-			{
-				breakpoint_remove(target, address);
-				gdb_put_packet(connection, "OK", 2);
-			}
-			break;
-		case 2:
-		case 3:
-		case 4:
+		deadline_start(&deadline, GDB_RANGE_STEP_TIMEOUT);
+		while (target->state != TARGET_HALTED)
 		{
-			if (packet[0] == 'Z')
+			if ((retval = target_poll(target)) != ERROR_OK)
+				break;
+			if (target->state == TARGET_HALTED)
+				break;
+
+			gdb_poll_ctrl_c(connection);
+			if (gdb_con->ctrl_c)
+				break;
+
+			if (!deadline_wait(&deadline))
 			{
-				if ((retval = watchpoint_add(target, address, size, type-2, 0, 0xffffffffu)) != ERROR_OK)
-				{
-					if ((retval = gdb_error(connection, retval)) != ERROR_OK)
-						return retval;
-				}
-				else
-				{
-					gdb_put_packet(connection, "OK", 2);
-				}
+				retval = ERROR_TARGET_TIMEOUT;
+				break;
 			}
-			else
+		}
+
+		if (target->state != TARGET_HALTED)
+		{
+			target_halt(target);
+			deadline_start(&deadline, GDB_RANGE_STEP_TIMEOUT);
+			while (target->state != TARGET_HALTED)
 			{
-				watchpoint_remove(target, address);
-				gdb_put_packet(connection, "OK", 2);
+				if (target_poll(target) != ERROR_OK)
+					break;
+				if ((target->state != TARGET_HALTED) && !deadline_wait(&deadline))
+					break;
 			}
-			break;
 		}
-		default:
-			break;
 	}
 
-	return ERROR_OK;
+	if (!user_breakpoint)
+		breakpoint_remove(target, address);
+
+	return retval;
 }
 
-/* print out a string and allocate more space as needed, mainly used for XML at this point */
-void xml_printf(int *retval, char **xml, int *pos, int *size, const char *fmt, ...)
+/* arch_info has a different layout per target type, its common_magic can
+ * only be read once the type is known to be an armv4_5 one */
+static int gdb_target_is_armv4_5(target_t *target)
 {
-	if (*retval != ERROR_OK)
+	static char *types[] =
 	{
-		return;
-	}
-	int first = 1;
+		"arm7tdmi", "arm720t", "arm9tdmi", "arm920t", "arm966e", "arm926ejs",
+		"feroceon", "xscale", NULL
+	};
+	int i;
 
-	for (;;)
+	for (i = 0; types[i]; i++)
+	{
+		if (strcmp(target->type->name, types[i]) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+/* step while the pc is within [start, end), only the final stop is reported to gdb.
+ * On ARM7/9 style cores straight-line code up to the next possible branch runs
+ * to a hardware breakpoint instead of being single-stepped. A ^C from gdb
+ * or a user breakpoint at that branch ends the range step. */
+void gdb_range_step(connection_t *connection, target_t *target, u32 start, u32 end)
+{
+	gdb_connection_t *gdb_con = connection->priv;
+	armv4_5_common_t *armv4_5 = gdb_target_is_armv4_5(target) ? target->arch_info : NULL;
+	u32 pc;
+	u32 branch_pc;
+
+	LOG_DEBUG("range step 0x%8.8x - 0x%8.8x", start, end);
+
+	gdb_con->range_stepping = 1;
+
+	while ((target->state == TARGET_HALTED) && (gdb_get_pc(target, &pc) == ERROR_OK)
+		&& (pc >= start) && (pc < end))
+	{
+		if (gdb_con->ctrl_c)
+		{
+			target->debug_reason = DBG_REASON_DBGRQ;
+			break;
+		}
+
+		if (armv4_5 && (armv4_5->common_magic == ARMV4_5_COMMON_MAGIC)
+			&& (arm_simulate_next_branch(target, end, &branch_pc) == ERROR_OK)
+			&& (branch_pc > pc + ((armv4_5->core_state == ARMV4_5_STATE_ARM) ? 4 : 2)))
+		{
+			/* the pc leaving the range at branch_pc == end is caught by the loop condition */
+			int user_breakpoint = (breakpoint_find(target, branch_pc) != NULL);
+			int retval = gdb_run_to_address(connection, target, branch_pc, (armv4_5->core_state == ARMV4_5_STATE_ARM) ? 4 : 2);
+
+			if (retval == ERROR_OK)
+			{
+				if ((target->state != TARGET_HALTED) || (gdb_get_pc(target, &pc) != ERROR_OK) || (pc != branch_pc))
+					break;
+				if (user_breakpoint)
+				{
+					target->debug_reason = DBG_REASON_BREAKPOINT;
+					break;
+				}
+				continue;
+			}
+			else if (retval != ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
+			{
+				/* stopped somewhere else or timed out */
+				break;
+			}
+		}
+
+		/* step at current address, don't handle breakpoints */
+		target->type->step(target, 1, 0, 0);
+
+		if (target->debug_reason != DBG_REASON_SINGLESTEP)
+			break;
+
+		/* single steps don't trigger breakpoints, stop at the user's ones ourselves */
+		if ((gdb_get_pc(target, &pc) == ERROR_OK) && breakpoint_find(target, pc))
+		{
+			target->debug_reason = DBG_REASON_BREAKPOINT;
+			break;
+		}
+
+		gdb_poll_ctrl_c(connection);
+	}
+
+	gdb_con->range_stepping = 0;
+	gdb_con->ctrl_c = 0;
+
+	/* report the final stop */
+	if (target->state == TARGET_HALTED)
+		gdb_target_callback_event_handler(target, TARGET_EVENT_HALTED, connection);
+}
+
+/* vCont for the one thread we have. gdb sends an action per thread, e.g.
+ * "vCont;s:1;c", the leftmost one that applies to a thread is taken. Ours
+ * is thread 1, actions without a thread id apply to every thread. */
+int gdb_vcont_packet(connection_t *connection, target_t *target, char *packet, int packet_size)
+{
+	gdb_connection_t *gdb_con = connection->priv;
+	char *action = NULL;
+	char *p;
+
+	if (!strcmp(packet, "vCont?"))
+	{
+		gdb_put_packet(connection, "vCont;c;C;s;S;t;r", 17);
+		return ERROR_OK;
+	}
+
+	if (strncmp(packet, "vCont;", 6))
+	{
+		gdb_put_packet(connection, "", 0);
+		return ERROR_OK;
+	}
+
+	for (p = packet + 5; p != NULL; p = strchr(p + 1, ';'))
+	{
+		int len = strcspn(p + 1, ";");
+		char *thread = memchr(p + 1, ':', len);
+		long thread_id;
+
+		if ((p[1] == 0) || (strchr("cCsStr", p[1]) == NULL))
+		{
+			gdb_send_error(connection, EINVAL);
+			return ERROR_OK;
+		}
+
+		if (action)
+			continue;
+
+		thread_id = thread ? strtol(thread + 1, NULL, 16) : -1;
+		if ((thread_id == 1) || (thread_id == 0) || (thread_id == -1))
+			action = p + 1;
+	}
+
+	if (action == NULL)
+	{
+		/* nothing for our thread to do */
+		gdb_send_error(connection, EINVAL);
+		return ERROR_OK;
+	}
+
+	if (*action == 't')
+	{
+		/* only valid in non-stop mode, the stop follows as a notification */
+		if (!gdb_con->non_stop)
+		{
+			gdb_send_error(connection, EINVAL);
+			return ERROR_OK;
+		}
+
+		gdb_put_packet(connection, "OK", 2);
+		if (target->state == TARGET_RUNNING)
+		{
+			gdb_con->halt_requested = 1;
+			target_halt(target);
+		}
+		return ERROR_OK;
+	}
+
+	if (target->state != TARGET_HALTED)
+	{
+		/* If the target isn't in the halted state, then we can't
+		 * step/continue. This might be early setup, etc.
+		 */
+		char sig_reply[4];
+		snprintf(sig_reply, 4, "T%2.2x", 2);
+		gdb_put_packet(connection, sig_reply, 3);
+		return ERROR_OK;
+	}
+
+	/* forward log output until the target is halted */
+	gdb_con->frontend_state = TARGET_RUNNING;
+	log_add_callback(gdb_log_callback, connection);
+
+	if (gdb_con->non_stop)
+		gdb_put_packet(connection, "OK", 2);
+
+	switch (*action)
+	{
+		case 'c':
+		case 'C':
+			LOG_DEBUG("continue");
+			target_resume(target, 1, 0, 0, 0);
+			break;
+		case 's':
+		case 'S':
+			LOG_DEBUG("step");
+			target->type->step(target, 1, 0, 0);
+			break;
+		case 'r':
+			{
+				char *separator;
+				u32 start, end;
+
+				start = strtoul(action + 1, &separator, 16);
+				if (*separator != ',')
+				{
+					LOG_ERROR("incomplete vCont;r packet received, dropping connection");
+					return ERROR_SERVER_REMOTE_CLOSED;
+				}
+				end = strtoul(separator + 1, NULL, 16);
+
+				gdb_range_step(connection, target, start, end);
+			}
+			break;
+	}
+
+	return ERROR_OK;
+}
+
+int gdb_breakpoint_watchpoint_packet(connection_t *connection, target_t *target, char *packet, int packet_size)
+{
+	int type;
+	enum breakpoint_type bp_type = BKPT_SOFT /* dummy init to avoid warning */;
+	enum watchpoint_rw wp_type;
+	u32 address;
+	u32 size;
+	char *separator;
+	int retval;
+
+	LOG_DEBUG("-");
+
+	type = strtoul(packet + 1, &separator, 16);
+
+	if (type == 0)	/* memory breakpoint */
+		bp_type = BKPT_SOFT;
+	else if (type == 1) /* hardware breakpoint */
+		bp_type = BKPT_HARD;
+	else if (type == 2) /* write watchpoint */
+		wp_type = WPT_WRITE;
+	else if (type == 3) /* read watchpoint */
+		wp_type = WPT_READ;
+	else if (type == 4) /* access watchpoint */
+		wp_type = WPT_ACCESS;
+
+	if (*separator != ',')
+	{
+		LOG_ERROR("incomplete breakpoint/watchpoint packet received, dropping connection");
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	address = strtoul(separator+1, &separator, 16);
+
+	if (*separator != ',')
+	{
+		LOG_ERROR("incomplete breakpoint/watchpoint packet received, dropping connection");
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	size = strtoul(separator+1, &separator, 16);
+
+	switch (type)
+	{
+		case 0:
+		case 1:
+			if (packet[0] == 'Z')
+			{
+				if ((retval = breakpoint_add(target, address, size, bp_type)) != ERROR_OK)
+				{
+					if ((retval = gdb_error(connection, retval)) != ERROR_OK)
+						return retval;
+				}
+				else
+				{
+					gdb_put_packet(connection, "OK", 2);
+				}
+			}
+			else
+			{
+				breakpoint_remove(target, address);
+				gdb_put_packet(connection, "OK", 2);
+			}
+			break;
+		case 2:
+		case 3:
+		case 4:
+		{
+			if (packet[0] == 'Z')
+			{
+				if ((retval = watchpoint_add(target, address, size, type-2, 0, 0xffffffffu)) != ERROR_OK)
+				{
+					if ((retval = gdb_error(connection, retval)) != ERROR_OK)
+						return retval;
+				}
+				else
+				{
+					gdb_put_packet(connection, "OK", 2);
+				}
+			}
+			else
+			{
+				watchpoint_remove(target, address);
+				gdb_put_packet(connection, "OK", 2);
+			}
+			break;
+		}
+		default:
+			break;
+	}
+
+	return ERROR_OK;
+}
+
+/* print out a string and allocate more space as needed, mainly used for XML at this point */
+void xml_printf(int *retval, char **xml, int *pos, int *size, const char *fmt, ...)
+{
+	if (*retval != ERROR_OK)
+	{
+		return;
+	}
+	int first = 1;
+
+	for (;;)
 	{
 		if ((*xml == NULL) || (!first))
 		{
@@ -1437,9 +2040,246 @@ static int compare_bank (const void * a, const void * b)
 	}
 }
 
+/* identifies the flash bank layout of a target, the cached memory map is
+ * rebuilt when this changes, e.g. after a flash probe */
+static u32 gdb_flash_signature(target_t *target)
+{
+	flash_bank_t *p;
+	u32 signature = flash_get_bank_count();
+	int i;
+
+	for (i = 0; i < flash_get_bank_count(); i++)
+	{
+		if (((p = get_flash_bank_by_num_noprobe(i)) == NULL) || (p->target != target))
+			continue;
+		signature = (signature * 31) ^ p->base;
+		signature = (signature * 31) ^ p->size;
+		signature = (signature * 31) ^ p->num_sectors;
+	}
+
+	return signature;
+}
+
+int gdb_generate_memory_map(connection_t *connection, target_t *target)
+{
+	gdb_connection_t *gdb_con = connection->priv;
+	/* We get away with only specifying flash here. Regions that are not
+	 * specified are treated as if we provided no memory map(if not we
+	 * could detect the holes and mark them as RAM).
+	 * The map is generated once and served from the cache for all the
+	 * chunks gdb asks for, until the flash banks change. */
+	flash_bank_t *p;
+	char *xml = NULL;
+	int size = 0;
+	int pos = 0;
+	int retval = ERROR_OK;
+	int blocksize;
+
+	if (gdb_con->memory_map && (gdb_con->memory_map_signature == gdb_flash_signature(target)))
+		return ERROR_OK;
+
+	xml_printf(&retval, &xml, &pos, &size, "<memory-map>\n");
+
+	/* 
+	sort banks in ascending order, we need to make non-flash memory be ram(or rather
+	read/write) by default for GDB.
+	GDB does not have a concept of non-cacheable read/write memory.
+	 */
+	flash_bank_t **banks=malloc(sizeof(flash_bank_t *)*flash_get_bank_count());
+	int num_banks = 0;
+	int i;
+	
+	for (i=0; i<flash_get_bank_count(); i++)
+	{
+		p = get_flash_bank_by_num(i);
+		if (p == NULL)
+		{
+			free(banks);
+			free(xml);
+			return ERROR_FAIL;
+		}
+		/* only the banks of the target behind this gdb port */
+		if (p->target == target)
+			banks[num_banks++]=p;
+	}
+	
+	qsort(banks, num_banks, sizeof(flash_bank_t *), compare_bank);
+	
+	u32 ram_start=0;
+	for (i=0; i<num_banks; i++)
+	{
+		p = banks[i];
+		
+		if (ram_start<p->base)
+		{
+			xml_printf(&retval, &xml, &pos, &size, "<memory type=\"ram\" start=\"0x%x\" length=\"0x%x\"/>\n",
+				ram_start, p->base-ram_start);
+		}
+		
+		/* if device has uneven sector sizes, eg. str7, lpc
+		 * we pass the smallest sector size to gdb memory map */
+		blocksize = gdb_calc_blocksize(p);
+
+		xml_printf(&retval, &xml, &pos, &size, "<memory type=\"flash\" start=\"0x%x\" length=\"0x%x\">\n" \
+			"<property name=\"blocksize\">0x%x</property>\n" \
+			"</memory>\n", \
+			p->base, p->size, blocksize);
+		ram_start=p->base+p->size;			
+	}
+	if (ram_start!=0)
+	{
+		xml_printf(&retval, &xml, &pos, &size, "<memory type=\"ram\" start=\"0x%x\" length=\"0x%x\"/>\n",
+			ram_start, 0-ram_start);
+	} else
+	{
+		/* a flash chip could be at the very end of the 32 bit address space, in which case
+		ram_start will be precisely 0 */
+	}
+	
+	free(banks);
+	banks = NULL;
+
+	xml_printf(&retval, &xml, &pos, &size, "</memory-map>\n");
+
+	if (retval != ERROR_OK)
+		return retval;
+
+	free(gdb_con->memory_map);
+	gdb_con->memory_map = xml;
+	gdb_con->memory_map_len = pos;
+	/* get_flash_bank_by_num() may have probed the banks */
+	gdb_con->memory_map_signature = gdb_flash_signature(target);
+
+	return ERROR_OK;
+}
+
+/* arch_info is an armv7m_common_t only for cortex_m3 targets, other types
+ * (arm11 e.g.) have their own layout there */
+static int gdb_target_is_armv7m(target_t *target)
+{
+	return (strcmp(target->type->name, "cortex_m3") == 0);
+}
+
+/* ARM targets present gdb's classic register layout: r0-r15, f0-f7, fps
+ * and cpsr. ARMv7-M has xpsr and no FPA registers. Describing it lets gdb
+ * skip probing. */
+int gdb_generate_target_description(connection_t *connection, target_t *target)
+{
+	gdb_connection_t *gdb_con = connection->priv;
+	static char *core_names[] =
+	{
+		"r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7",
+		"r8", "r9", "r10", "r11", "r12", "sp", "lr", "pc",
+	};
+	int m_profile = 0;
+	reg_t **reg_list;
+	int reg_list_size;
+	char *xml = NULL;
+	int size = 0;
+	int pos = 0;
+	int retval = ERROR_OK;
+	int i;
+
+	if (gdb_con->tdesc)
+		return ERROR_OK;
+
+	if (gdb_target_is_armv7m(target))
+	{
+		armv7m_common_t *armv7m = target->arch_info;
+		m_profile = (armv7m->common_magic == ARMV7M_COMMON_MAGIC);
+	}
+
+	if ((retval = target->type->get_gdb_reg_list(target, &reg_list, &reg_list_size)) != ERROR_OK)
+		return retval;
+
+	if (reg_list_size != 26)
+	{
+		free(reg_list);
+		return ERROR_FAIL;
+	}
+
+	xml_printf(&retval, &xml, &pos, &size,
+		"<?xml version=\"1.0\"?>\n"
+		"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+		"<target version=\"1.0\">\n"
+		"<architecture>arm</architecture>\n"
+		"<feature name=\"org.gnu.gdb.arm.%s\">\n", m_profile ? "m-profile" : "core");
+
+	for (i = 0; i < 16; i++)
+	{
+		xml_printf(&retval, &xml, &pos, &size, "<reg name=\"%s\" bitsize=\"%d\" regnum=\"%d\"%s/>\n",
+			core_names[i], reg_list[i]->size, i,
+			(i == 13) ? " type=\"data_ptr\"" : ((i == 15) ? " type=\"code_ptr\"" : ""));
+	}
+
+	xml_printf(&retval, &xml, &pos, &size, "<reg name=\"%s\" bitsize=\"%d\" regnum=\"25\"/>\n"
+		"</feature>\n", m_profile ? "xpsr" : "cpsr", reg_list[25]->size);
+
+	/* M-profile cores have no FPA, gdb rejects that feature with m-profile */
+	if (!m_profile)
+	{
+		xml_printf(&retval, &xml, &pos, &size, "<feature name=\"org.gnu.gdb.arm.fpa\">\n");
+
+		for (i = 16; i < 24; i++)
+		{
+			xml_printf(&retval, &xml, &pos, &size, "<reg name=\"f%d\" bitsize=\"%d\" regnum=\"%d\" type=\"arm_fpa_ext\"/>\n",
+				i - 16, reg_list[i]->size, i);
+		}
+
+		xml_printf(&retval, &xml, &pos, &size, "<reg name=\"fps\" bitsize=\"%d\" regnum=\"24\"/>\n"
+			"</feature>\n", reg_list[24]->size);
+	}
+
+	xml_printf(&retval, &xml, &pos, &size, "</target>\n");
+
+	free(reg_list);
+
+	if (retval != ERROR_OK)
+		return retval;
+
+	gdb_con->tdesc = xml;
+	gdb_con->tdesc_len = pos;
+	gdb_con->tdesc_m_profile = m_profile;
+
+	return ERROR_OK;
+}
+
+/* reply to a qXfer read of offset/length from data */
+int gdb_xfer_reply(connection_t *connection, char *data, int data_len, int offset, int length)
+{
+	gdb_connection_t *gdb_con = connection->priv;
+	char *reply;
+	char type = 'm';
+
+	if (offset >= data_len)
+	{
+		gdb_put_packet(connection, "l", 1);
+		return ERROR_OK;
+	}
+
+	if (offset + length >= data_len)
+	{
+		length = data_len - offset;
+		type = 'l';
+	}
+
+	if ((reply = gdb_con_buffer((void **)&gdb_con->reply_buffer, &gdb_con->reply_buffer_size, length + 1)) == NULL)
+	{
+		gdb_send_error(connection, 0x0C);
+		return ERROR_OK;
+	}
+
+	reply[0] = type;
+	memcpy(reply + 1, data + offset, length);
+	gdb_put_packet(connection, reply, length + 1);
+
+	return ERROR_OK;
+}
+
 int gdb_query_packet(connection_t *connection, target_t *target, char *packet, int packet_size)
 {
 	command_context_t *cmd_ctx = connection->cmd_ctx;
+	gdb_connection_t *gdb_con = connection->priv;
 
 	if (strstr(packet, "qRcmd,"))
 	{
@@ -1509,16 +2349,17 @@ int gdb_query_packet(connection_t *connection, target_t *target, char *packet, i
 	}
 	else if (strstr(packet, "qSupported"))
 	{
-		/* we currently support packet size and qXfer:memory-map:read (if enabled)
-		 * disable qXfer:features:read for the moment */
+		/* we currently support packet size, no-ack mode, non-stop mode, binary memory reads, qXfer:memory-map:read (if enabled)
+		 * and qXfer:features:read for targets with the classic ARM register layout */
 		int retval = ERROR_OK;
 		char *buffer = NULL;
 		int pos = 0;
 		int size = 0;
 
 		xml_printf(&retval, &buffer, &pos, &size,
-				"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read-",
-				(GDB_BUFFER_SIZE - 1), gdb_use_memory_map == 1 ? '+' : '-');
+				"PacketSize=%x;qXfer:memory-map:read%c;qXfer:features:read%c;QStartNoAckMode+;QNonStop+;binary-upload+",
+				(GDB_BUFFER_SIZE - 1), gdb_use_memory_map == 1 ? '+' : '-',
+				gdb_generate_target_description(connection, target) == ERROR_OK ? '+' : '-');
 
 		if (retval != ERROR_OK)
 		{
@@ -1531,24 +2372,45 @@ int gdb_query_packet(connection_t *connection, target_t *target, char *packet, i
 
 		return ERROR_OK;
 	}
-	else if (strstr(packet, "qXfer:memory-map:read::"))
+	else if (strstr(packet, "QStartNoAckMode"))
 	{
-		/* We get away with only specifying flash here. Regions that are not
-		 * specified are treated as if we provided no memory map(if not we
-		 * could detect the holes and mark them as RAM).
-		 * Normally we only execute this code once, but no big deal if we
-		 * have to regenerate it a couple of times. */
+		/* this reply is still acknowledged by gdb, everything after it isn't */
+		gdb_put_packet(connection, "OK", 2);
+		gdb_con->noack_mode = 1;
+		LOG_DEBUG("gdb connection switched to no-ack mode");
 
-		flash_bank_t *p;
-		char *xml = NULL;
-		int size = 0;
-		int pos = 0;
-		int retval = ERROR_OK;
+		return ERROR_OK;
+	}
+	else if (strstr(packet, "QNonStop:"))
+	{
+		gdb_con->non_stop = (packet[9] == '1');
+		LOG_DEBUG("gdb connection switched to %s mode", gdb_con->non_stop ? "non-stop" : "all-stop");
+		gdb_put_packet(connection, "OK", 2);
 
+		return ERROR_OK;
+	}
+	else if (gdb_con->non_stop && (!strcmp(packet, "qfThreadInfo") || !strcmp(packet, "qsThreadInfo")))
+	{
+		/* non-stop mode needs threads, the target is thread 1 */
+		if (packet[1] == 'f')
+			gdb_put_packet(connection, "m1", 2);
+		else
+			gdb_put_packet(connection, "l", 1);
+
+		return ERROR_OK;
+	}
+	else if (gdb_con->non_stop && !strcmp(packet, "qC"))
+	{
+		gdb_put_packet(connection, "QC1", 3);
+
+		return ERROR_OK;
+	}
+	else if (strstr(packet, "qXfer:memory-map:read::"))
+	{
 		int offset;
 		int length;
 		char *separator;
-		int blocksize;
+		int retval;
 
 		/* skip command character */
 		packet += 23;
@@ -1556,94 +2418,16 @@ int gdb_query_packet(connection_t *connection, target_t *target, char *packet, i
 		offset = strtoul(packet, &separator, 16);
 		length = strtoul(separator + 1, &separator, 16);
 
-		xml_printf(&retval, &xml, &pos, &size, "<memory-map>\n");
-	
-		/* 
-		sort banks in ascending order, we need to make non-flash memory be ram(or rather
-		read/write) by default for GDB.
-		GDB does not have a concept of non-cacheable read/write memory.
-		 */
-		flash_bank_t **banks=malloc(sizeof(flash_bank_t *)*flash_get_bank_count());
-		int i;
-		
-		for (i=0; i<flash_get_bank_count(); i++)
-		{
-			p = get_flash_bank_by_num(i);
-			if (p == NULL)
-			{
-				free(banks);
-				retval = ERROR_FAIL;
-				gdb_send_error(connection, retval);
-				return retval;
-			}
-			banks[i]=p;
-		}
-		
-		qsort(banks, flash_get_bank_count(), sizeof(flash_bank_t *), compare_bank);
-		
-		u32 ram_start=0;
-		for (i=0; i<flash_get_bank_count(); i++)
-		{
-			p = banks[i];
-			
-			if (ram_start<p->base)
-			{
-				xml_printf(&retval, &xml, &pos, &size, "<memory type=\"ram\" start=\"0x%x\" length=\"0x%x\"/>\n",
-					ram_start, p->base-ram_start);
-			}
-			
-			/* if device has uneven sector sizes, eg. str7, lpc
-			 * we pass the smallest sector size to gdb memory map */
-			blocksize = gdb_calc_blocksize(p);
-	
-			xml_printf(&retval, &xml, &pos, &size, "<memory type=\"flash\" start=\"0x%x\" length=\"0x%x\">\n" \
-				"<property name=\"blocksize\">0x%x</property>\n" \
-				"</memory>\n", \
-				p->base, p->size, blocksize);
-			ram_start=p->base+p->size;			
-		}
-		if (ram_start!=0)
-		{
-			xml_printf(&retval, &xml, &pos, &size, "<memory type=\"ram\" start=\"0x%x\" length=\"0x%x\"/>\n",
-				ram_start, 0-ram_start);
-		} else
-		{
-			/* a flash chip could be at the very end of the 32 bit address space, in which case
-			ram_start will be precisely 0 */
-		}
-		
-		free(banks);
-		banks = NULL;
-
-		xml_printf(&retval, &xml, &pos, &size, "</memory-map>\n");
-
-		if (retval != ERROR_OK)
+		if ((retval = gdb_generate_memory_map(connection, target)) != ERROR_OK)
 		{
 			gdb_send_error(connection, retval);
 			return retval;
 		}
 
-		if (offset + length > pos)
-		{
-			length = pos - offset;
-		}
-
-		char *t = malloc(length + 1);
-		t[0] = 'l';
-		memcpy(t + 1, xml + offset, length);
-		gdb_put_packet(connection, t, length + 1);
-
-		free(t);
-		free(xml);
-		return ERROR_OK;
+		return gdb_xfer_reply(connection, gdb_con->memory_map, gdb_con->memory_map_len, offset, length);
 	}
 	else if (strstr(packet, "qXfer:features:read:"))
 	{
-		char *xml = NULL;
-		int size = 0;
-		int pos = 0;
-		int retval = ERROR_OK;
-
 		int offset;
 		unsigned int length;
 		char *annex;
@@ -1657,31 +2441,100 @@ int gdb_query_packet(connection_t *connection, target_t *target, char *packet, i
 			return ERROR_OK;
 		}
 
-		if (strcmp(annex, "target.xml") != 0)
+		if ((strcmp(annex, "target.xml") != 0)
+			|| (gdb_generate_target_description(connection, target) != ERROR_OK))
 		{
 			gdb_send_error(connection, 01);
 			return ERROR_OK;
 		}
 
-		xml_printf(&retval, &xml, &pos, &size, \
-			"l<target version=\"1.0\">\n<architecture>arm</architecture>\n</target>\n");
+		/* from now on gdb lays out the g packet by this description */
+		gdb_con->skip_fpa = gdb_con->tdesc_m_profile;
 
-		if (retval != ERROR_OK)
+		return gdb_xfer_reply(connection, gdb_con->tdesc, gdb_con->tdesc_len, offset, length);
+	}
+
+	gdb_put_packet(connection, "", 0);
+	return ERROR_OK;
+}
+
+/* Program the buffered vFlashWrite data. Unless all is set nothing happens
+ * before GDB_VFLASH_CHUNK_SIZE bytes are buffered, then only whole sectors
+ * are written, the rest stays buffered until more data arrives. */
+int gdb_vflash_flush(connection_t *connection, target_t *target, int all)
+{
+	gdb_connection_t *gdb_connection = connection->priv;
+	u32 address = gdb_connection->vflash_address;
+	u32 size = gdb_connection->vflash_size;
+	u32 written;
+	image_t image;
+	int retval;
+
+	if (size == 0)
+		return ERROR_OK;
+
+	if (!all)
+	{
+		flash_bank_t *bank;
+		u32 end = 0;
+		int i;
+
+		if (size < GDB_VFLASH_CHUNK_SIZE)
+			return ERROR_OK;
+
+		/* not flash, leave it to vFlashDone to report that */
+		if ((bank = get_flash_bank_by_addr(target, address)) == NULL)
+			return ERROR_OK;
+
+		/* find the last sector boundary within the buffered data */
+		for (i = 0; i < bank->num_sectors; i++)
 		{
-			gdb_send_error(connection, retval);
-			return retval;
+			u32 sector_end = bank->base + bank->sectors[i].offset + bank->sectors[i].size;
+			if ((sector_end > address) && (sector_end <= address + size))
+				end = sector_end;
 		}
 
-		gdb_put_packet(connection, xml, strlen(xml));
+		if (end == 0)
+			return ERROR_OK;
 
-		free(xml);
-		return ERROR_OK;
+		size = end - address;
 	}
 
-	gdb_put_packet(connection, "", 0);
+	image_open(&image, "", "build");
+	image_add_section(&image, address, size, 0x0, gdb_connection->vflash_buffer);
+
+	/* no need to erase as GDB always issues a vFlashErase first. */
+	retval = flash_write(target, &image, &written, 0);
+
+	image_close(&image);
+
+	if (retval != ERROR_OK)
+	{
+		gdb_connection->vflash_size = 0;
+		return retval;
+	}
+
+	gdb_connection->vflash_written += written;
+
+	memmove(gdb_connection->vflash_buffer, gdb_connection->vflash_buffer + size, gdb_connection->vflash_size - size);
+	gdb_connection->vflash_address += size;
+	gdb_connection->vflash_size -= size;
+
 	return ERROR_OK;
 }
 
+void gdb_vflash_error(connection_t *connection, int retval)
+{
+	gdb_connection_t *gdb_connection = connection->priv;
+
+	gdb_connection->vflash_error = ERROR_OK;
+
+	if (retval == ERROR_FLASH_DST_OUT_OF_BANK)
+		gdb_put_packet(connection, "E.memtype", 9);
+	else
+		gdb_send_error(connection, EIO);
+}
+
 int gdb_v_packet(connection_t *connection, target_t *target, char *packet, int packet_size)
 {
 	gdb_connection_t *gdb_connection = connection->priv;
@@ -1724,6 +2577,14 @@ int gdb_v_packet(connection_t *connection, target_t *target, char *packet, int p
 			return ERROR_SERVER_REMOTE_CLOSED;
 		}
 
+		/* data still buffered from an earlier vFlashWrite goes out first */
+		if (((result = gdb_connection->vflash_error) != ERROR_OK)
+			|| ((result = gdb_vflash_flush(connection, gdb_service->target, 1)) != ERROR_OK))
+		{
+			gdb_vflash_error(connection, result);
+			return ERROR_OK;
+		}
+
 		/* assume all sectors need erasing - stops any problems
 		 * when flash_write is called multiple times */
 		flash_set_dirty();
@@ -1765,43 +2626,67 @@ int gdb_v_packet(connection_t *connection, target_t *target, char *packet, int p
 		}
 		length = packet_size - (parse - packet);
 
-		/* create a new image if there isn't already one */
-		if (gdb_connection->vflash_image == NULL)
+		/* an earlier chunk failed to program, the rest of the load is refused */
+		if (gdb_connection->vflash_error != ERROR_OK)
 		{
-			gdb_connection->vflash_image = malloc(sizeof(image_t));
-			image_open(gdb_connection->vflash_image, "", "build");
+			gdb_vflash_error(connection, gdb_connection->vflash_error);
+			return ERROR_OK;
 		}
 
-		/* create new section with content from packet buffer */
-		image_add_section(gdb_connection->vflash_image, addr, length, 0x0, (u8*)parse);
+		/* a gap in the data, program what we have so far */
+		if ((gdb_connection->vflash_size > 0)
+			&& (addr != gdb_connection->vflash_address + gdb_connection->vflash_size))
+		{
+			if ((result = gdb_vflash_flush(connection, gdb_service->target, 1)) != ERROR_OK)
+			{
+				gdb_vflash_error(connection, result);
+				return ERROR_OK;
+			}
+		}
 
+		if (gdb_connection->vflash_size == 0)
+			gdb_connection->vflash_address = addr;
+
+		if (gdb_connection->vflash_size + length > gdb_connection->vflash_buffer_size)
+		{
+			u8 *buffer = realloc(gdb_connection->vflash_buffer, gdb_connection->vflash_size + length);
+			if (buffer == NULL)
+			{
+				gdb_send_error(connection, ENOMEM);
+				return ERROR_OK;
+			}
+			gdb_connection->vflash_buffer = buffer;
+			gdb_connection->vflash_buffer_size = gdb_connection->vflash_size + length;
+		}
+
+		memcpy(gdb_connection->vflash_buffer + gdb_connection->vflash_size, parse, length);
+		gdb_connection->vflash_size += length;
+
+		/* acknowledge first, gdb sends the next packet while we program */
 		gdb_put_packet(connection, "OK", 2);
+		gdb_flush(connection);
+
+		/* program the complete sectors, a failure is reported by the next vFlash packet */
+		gdb_connection->vflash_error = gdb_vflash_flush(connection, gdb_service->target, 0);
 
 		return ERROR_OK;
 	}
 
 	if (!strcmp(packet, "vFlashDone"))
 	{
-		u32 written;
-
-		/* process the flashing buffer. No need to erase as GDB
-		 * always issues a vFlashErase first. */
-		if ((result = flash_write(gdb_service->target, gdb_connection->vflash_image, &written, 0)) != ERROR_OK)
+		/* program what is still buffered */
+		if (((result = gdb_connection->vflash_error) != ERROR_OK)
+			|| ((result = gdb_vflash_flush(connection, gdb_service->target, 1)) != ERROR_OK))
 		{
-			if (result == ERROR_FLASH_DST_OUT_OF_BANK)
-				gdb_put_packet(connection, "E.memtype", 9);
-			else
-				gdb_send_error(connection, EIO);
-			}
+			gdb_vflash_error(connection, result);
+		}
 		else
 		{
-			LOG_DEBUG("wrote %u bytes from vFlash image to flash", written);
+			LOG_DEBUG("wrote %u bytes from vFlash data to flash", gdb_connection->vflash_written);
 			gdb_put_packet(connection, "OK", 2);
 		}
 
-		image_close(gdb_connection->vflash_image);
-		free(gdb_connection->vflash_image);
-		gdb_connection->vflash_image = NULL;
+		gdb_connection->vflash_written = 0;
 
 		return ERROR_OK;
 	}
@@ -1850,36 +2735,77 @@ static void gdb_log_callback(void *priv, const char *file, int line,
 	gdb_output_con(connection, string);
 }
 
-/* Do not allocate this on the stack */
-char gdb_packet_buffer[GDB_BUFFER_SIZE];
+/* packets that can reset or flash any target, e.g. through monitor
+ * commands or the gdb program event, wait until no operation yields */
+static int gdb_packet_deferred(char *packet, int packet_size)
+{
+	return (packet_size > 0)
+		&& ((packet[0] == 'R') || !strncmp(packet, "qRcmd,", 6) || !strncmp(packet, "vFlash", 6));
+}
 
 int gdb_input_inner(connection_t *connection)
 {
 	gdb_service_t *gdb_service = connection->service->priv;
 	target_t *target = gdb_service->target;
-	char *packet=gdb_packet_buffer;
+	gdb_connection_t *gdb_con = connection->priv;
+	char *packet = gdb_con->packet_buffer;
 	int packet_size;
+	long long span;
 	int retval;
-	gdb_connection_t *gdb_con = connection->priv;
-	static int extended_protocol = 0;
 
 	/* drain input buffer */
 	do
 	{
-		packet_size = GDB_BUFFER_SIZE-1;
-		if ((retval = gdb_get_packet(connection, packet, &packet_size)) != ERROR_OK)
+		if (gdb_con->deferred_size > 0)
 		{
-			return retval;
+			if (gdb_yield_serving)
+				return ERROR_OK;
+
+			/* still in packet_buffer */
+			packet_size = gdb_con->deferred_size;
+			gdb_con->deferred_size = 0;
+			connection->input_pending = (gdb_con->buf_cnt > 0);
 		}
+		else
+		{
+			packet_size = GDB_BUFFER_SIZE-1;
+			if ((retval = gdb_get_packet(connection, packet, &packet_size)) != ERROR_OK)
+			{
+				return retval;
+			}
 
-		/* terminate with zero */
-		packet[packet_size] = 0;
+			/* terminate with zero */
+			packet[packet_size] = 0;
 
-		LOG_DEBUG("received packet: '%s'", packet);
+			LOG_DEBUG("received packet: '%s'", packet);
+
+			if (gdb_yield_serving && gdb_packet_deferred(packet, packet_size))
+			{
+				gdb_con->deferred_size = packet_size;
+				connection->input_pending = 1;
+				return ERROR_OK;
+			}
+		}
 
 		if (packet_size > 0)
 		{
+			/* everything else sees the memory as written so far */
+			if (packet[0] != 'X')
+			{
+				gdb_write_flush(connection, target);
+				if (gdb_con->write_error != ERROR_OK)
+				{
+					/* the packet is dropped, gdb stops on the error of the earlier write */
+					retval = gdb_con->write_error;
+					gdb_con->write_error = ERROR_OK;
+					if ((retval = gdb_error(connection, retval)) != ERROR_OK)
+						return retval;
+					continue;
+				}
+			}
+
 			retval = ERROR_OK;
+			span = span_begin();
 			switch (packet[0])
 			{
 				case 'H':
@@ -1888,6 +2814,7 @@ int gdb_input_inner(connection_t *connection)
 					gdb_put_packet(connection, NULL, 0);
 					break;
 				case 'q':
+				case 'Q':
 					retval = gdb_query_packet(connection, target, packet, packet_size);
 					break;
 				case 'g':
@@ -1903,6 +2830,7 @@ int gdb_input_inner(connection_t *connection)
 					retval = gdb_set_register_packet(connection, target, packet, packet_size);
 					break;
 				case 'm':
+				case 'x':
 					retval = gdb_read_memory_packet(connection, target, packet, packet_size);
 					break;
 				case 'M':
@@ -1934,29 +2862,40 @@ int gdb_input_inner(connection_t *connection)
 							gdb_connection_t *gdb_con = connection->priv;
 							gdb_con->frontend_state = TARGET_RUNNING;
 							log_add_callback(gdb_log_callback, connection);
+							/* in non-stop mode the stop is a notification of its own */
+							if (gdb_con->non_stop)
+								gdb_put_packet(connection, "OK", 2);
 							gdb_step_continue_packet(connection, target, packet, packet_size);
 						}
 					}
 					break;
 				case 'v':
-					retval = gdb_v_packet(connection, target, packet, packet_size);
+					if (!strncmp(packet, "vCont", 5))
+						retval = gdb_vcont_packet(connection, target, packet, packet_size);
+					else if (!strcmp(packet, "vStopped"))
+					{
+						/* there's only one thread, its stop was the notification itself */
+						gdb_put_packet(connection, "OK", 2);
+					}
+					else
+						retval = gdb_v_packet(connection, target, packet, packet_size);
 					break;
 				case 'D':
 					retval = gdb_detach(connection, target);
-					extended_protocol = 0;
+					gdb_con->extended_protocol = 0;
 					break;
 				case 'X':
 					if ((retval = gdb_write_memory_binary_packet(connection, target, packet, packet_size)) != ERROR_OK)
 						return retval;
 					break;
 				case 'k':
-					if (extended_protocol != 0)
+					if (gdb_con->extended_protocol != 0)
 						break;
 					gdb_put_packet(connection, "OK", 2);
 					return ERROR_SERVER_REMOTE_CLOSED;
 				case '!':
 					/* handle extended remote protocol */
-					extended_protocol = 1;
+					gdb_con->extended_protocol = 1;
 					gdb_put_packet(connection, "OK", 2);
 					break;
 				case 'R':
@@ -1970,6 +2909,8 @@ int gdb_input_inner(connection_t *connection)
 					break;
 			}
 
+			span_end_text(span, "gdb_packet", packet, packet_size);
+
 			/* if a packet handler returned an error, exit input loop */
 			if (retval != ERROR_OK)
 				return retval;
@@ -2004,6 +2945,48 @@ int gdb_input(connection_t *connection)
 	return ERROR_OK;
 }
 
+/* target of the connection whose operation yields, NULL if none does */
+static target_t *gdb_busy_target(void)
+{
+	connection_t *busy = server_busy_connection();
+
+	if (busy == NULL)
+		return NULL;
+
+	if (busy->service->type == CONNECTION_GDB)
+	{
+		gdb_service_t *gdb_service = busy->service->priv;
+		return gdb_service->target;
+	}
+
+	return get_target_by_num(busy->cmd_ctx->current_target);
+}
+
+/* Input that arrived while another operation yields. The connection that
+ * yields only has its ^C picked up, which ends a long memory read. Other
+ * connections to the busy target wait. Connections to other targets are
+ * served, except for packets that could reset or flash the busy target. */
+int gdb_yield_input(connection_t *connection)
+{
+	gdb_service_t *gdb_service = connection->service->priv;
+	int retval;
+
+	if (connection == server_busy_connection())
+	{
+		gdb_poll_ctrl_c(connection);
+		return ERROR_OK;
+	}
+
+	if (gdb_service->target == gdb_busy_target())
+		return ERROR_OK;
+
+	gdb_yield_serving = 1;
+	retval = gdb_input(connection);
+	gdb_yield_serving = 0;
+
+	return retval;
+}
+
 int gdb_init()
 {
 	gdb_service_t *gdb_service;
@@ -2030,8 +3013,9 @@ int gdb_init()
 
 		gdb_service = malloc(sizeof(gdb_service_t));
 		gdb_service->target = target;
+		gdb_service->target_num = i;
 
-		add_service("gdb", CONNECTION_GDB, gdb_port + i, 1, gdb_new_connection, gdb_input, gdb_connection_closed, gdb_service);
+		add_service(service_name, CONNECTION_GDB, gdb_port + i, 1, gdb_new_connection, gdb_input, gdb_connection_closed, gdb_connection_sync, gdb_yield_input, gdb_service);
 
 		LOG_DEBUG("gdb service for target %s at port %i", target->type->name, gdb_port + i);
 
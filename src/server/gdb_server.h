@@ -24,7 +24,20 @@
 #include "server.h"
 #include "image.h"
 
-#define GDB_BUFFER_SIZE	16384
+#define GDB_BUFFER_SIZE	65536
+
+/* ms to wait for a range stepping breakpoint before halting the target */
+#define GDB_RANGE_STEP_TIMEOUT	1000
+
+/* large memory reads are done in chunks of this size, target polling goes on in between */
+#define GDB_YIELD_CHUNK_SIZE	4096
+
+/* vFlashWrite data is programmed once this much is buffered, so the flash
+ * algorithm isn't set up again for every sector */
+#define GDB_VFLASH_CHUNK_SIZE	(64 * 1024)
+
+/* contiguous X packet data is collected up to this size before it is written */
+#define GDB_WRITE_COALESCE_SIZE	(64 * 1024)
 
 typedef struct gdb_connection_s
 {
@@ -33,14 +46,54 @@ typedef struct gdb_connection_s
 	int buf_cnt;
 	int ctrl_c;
 	enum target_state frontend_state;
-	image_t *vflash_image;
+	/* vFlashWrite data not yet programmed, starting at vflash_address */
+	u32 vflash_address;
+	u8 *vflash_buffer;
+	u32 vflash_size;
+	u32 vflash_buffer_size;
+	u32 vflash_written;
+	/* programming failed after the vFlashWrite was acknowledged, reported
+	 * by the next vFlash packet */
+	int vflash_error;
 	int closed;
 	int busy;
+	int noack_mode;
+	int range_stepping;
+	/* QNonStop: resume packets are answered at once, stops are sent as %Stop notifications */
+	int non_stop;
+	int halt_requested;
+	int extended_protocol;
+	/* reused by memory read packets */
+	u8 *read_buffer;
+	int read_buffer_size;
+	char *reply_buffer;
+	int reply_buffer_size;
+	/* generated once, served by offset for qXfer reads */
+	char *memory_map;
+	int memory_map_len;
+	u32 memory_map_signature;
+	char *tdesc;
+	int tdesc_len;
+	int tdesc_m_profile;
+	/* gdb read an M-profile description, g/G packets leave out f0-f7 and fps */
+	int skip_fpa;
+	/* X packet data acknowledged but not yet written, starting at write_address */
+	u32 write_address;
+	u8 *write_buffer;
+	u32 write_size;
+	int write_buffer_size;
+	int write_error;
+	/* size of a packet in packet_buffer that was put off while another
+	 * connection's operation yielded, 0 if there is none */
+	int deferred_size;
+	/* the packet being handled */
+	char packet_buffer[GDB_BUFFER_SIZE];
 } gdb_connection_t;
 
 typedef struct gdb_service_s
 {
 	struct target_s *target;
+	int target_num;
 } gdb_service_t;
 
 extern int gdb_init();
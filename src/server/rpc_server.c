@@ -0,0 +1,420 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by the OpenOCD developers                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "replacements.h"
+
+#include "rpc_server.h"
+
+#include "server.h"
+#include "log.h"
+#include "command.h"
+#include "target.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+static unsigned short rpc_port = 0;
+
+int handle_rpc_port_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
+
+static u32 rpc_get_u32(const u8 *buf)
+{
+	return (buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+}
+
+static int rpc_write_u32(connection_t *connection, u32 value)
+{
+	u8 buf[4];
+
+	buf[0] = value >> 24;
+	buf[1] = value >> 16;
+	buf[2] = value >> 8;
+	buf[3] = value;
+
+	return connection_write(connection, buf, 4);
+}
+
+static void rpc_append_output(rpc_connection_t *r_con, const char *string, int len)
+{
+	if (len > RPC_MAX_REQUEST - r_con->output_len)
+		len = RPC_MAX_REQUEST - r_con->output_len;
+	if (len <= 0)
+		return;
+
+	if (r_con->output_len + len > r_con->output_size)
+	{
+		int size = r_con->output_size ? r_con->output_size : 256;
+		char *t;
+
+		while (size < r_con->output_len + len)
+			size *= 2;
+
+		if ((t = realloc(r_con->output, size)) == NULL)
+			return;
+
+		r_con->output = t;
+		r_con->output_size = size;
+	}
+
+	memcpy(r_con->output + r_con->output_len, string, len);
+	r_con->output_len += len;
+}
+
+int rpc_output(struct command_context_s *cmd_ctx, char* line)
+{
+	connection_t *connection = cmd_ctx->output_handler_priv;
+	rpc_connection_t *r_con = connection->priv;
+
+	if (r_con->output_len >= 0)
+		rpc_append_output(r_con, line, strlen(line));
+
+	return ERROR_OK;
+}
+
+/* log messages are part of the output of the command that caused them,
+ * anything logged between batches is not sent */
+void rpc_log_callback(void *priv, const char *file, int line,
+		const char *function, const char *string)
+{
+	connection_t *connection = priv;
+	rpc_connection_t *r_con = connection->priv;
+
+	if (r_con->output_len >= 0)
+		rpc_append_output(r_con, string, strlen(string));
+}
+
+static int rpc_read_memory(connection_t *connection, char **args, int argc, u8 **data, u32 *data_len)
+{
+	target_t *target = get_current_target(connection->cmd_ctx);
+	u32 address, count;
+	int retval;
+
+	if (argc != 2)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	address = strtoul(args[0], NULL, 0);
+	count = strtoul(args[1], NULL, 0);
+
+	if (count > RPC_MAX_REQUEST)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if ((*data = malloc(count ? count : 1)) == NULL)
+		return ERROR_FAIL;
+
+	if ((retval = target_read_buffer(target, address, count, *data)) != ERROR_OK)
+		return retval;
+
+	*data_len = count;
+
+	return ERROR_OK;
+}
+
+static int rpc_write_memory(connection_t *connection, char **args, int argc)
+{
+	target_t *target = get_current_target(connection->cmd_ctx);
+	u32 address, count, i;
+	u8 *buffer;
+	int retval;
+
+	if ((argc != 2) || (strlen(args[1]) % 2))
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	address = strtoul(args[0], NULL, 0);
+	count = strlen(args[1]) / 2;
+
+	if ((buffer = malloc(count ? count : 1)) == NULL)
+		return ERROR_FAIL;
+
+	for (i = 0; i < count; i++)
+	{
+		int tmp;
+		if (sscanf(args[1] + 2 * i, "%02x", &tmp) != 1)
+		{
+			free(buffer);
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		}
+		buffer[i] = tmp;
+	}
+
+	retval = target_write_buffer(target, address, count, buffer);
+	free(buffer);
+
+	return retval;
+}
+
+/* the memory access commands are handled here, they are not regular
+ * commands because their data doesn't go through command_print() */
+static int rpc_run_builtin(connection_t *connection, char *line, u8 **data, u32 *data_len)
+{
+	char *args[3];
+	int argc = 0;
+	char *p = line + 1;
+	char *cmd;
+
+	cmd = strsep(&p, " \t");
+	while (p && (argc < 3))
+	{
+		char *arg = strsep(&p, " \t");
+		if (*arg)
+			args[argc++] = arg;
+	}
+
+	if (strcmp(cmd, "read_memory") == 0)
+		return rpc_read_memory(connection, args, argc, data, data_len);
+	else if (strcmp(cmd, "write_memory") == 0)
+		return rpc_write_memory(connection, args, argc);
+
+	LOG_USER("unknown rpc command '%s'", cmd);
+	return ERROR_COMMAND_SYNTAX_ERROR;
+}
+
+static int rpc_run_batch(connection_t *connection, char *batch, int len)
+{
+	rpc_connection_t *r_con = connection->priv;
+	int results = 0;
+	int reply_len = 4;
+	char *line, *p;
+	int i;
+
+	struct rpc_result
+	{
+		int status;
+		char *output;
+		int output_len;
+		u8 *data;
+		u32 data_len;
+	} *result = NULL;
+	int result_size = 0;
+
+	batch[len] = 0;
+	p = batch;
+
+	while ((line = strsep(&p, "\n")) != NULL)
+	{
+		struct rpc_result *res;
+		int l = strlen(line);
+
+		if ((l > 0) && (line[l - 1] == '\r'))
+			line[--l] = 0;
+		/* a trailing newline doesn't start another command */
+		if ((l == 0) && (p == NULL))
+			break;
+		/* leave room for the largest result a command can have */
+		if (reply_len > RPC_MAX_REPLY - (12 + 2 * RPC_MAX_REQUEST))
+		{
+			LOG_WARNING("rpc response exceeds %i bytes, remaining commands not executed", RPC_MAX_REPLY);
+			break;
+		}
+
+		if (results == result_size)
+		{
+			struct rpc_result *t;
+			result_size = result_size ? result_size * 2 : 16;
+			if ((t = realloc(result, result_size * sizeof(*result))) == NULL)
+				break;
+			result = t;
+		}
+		res = &result[results++];
+		res->data = NULL;
+		res->data_len = 0;
+
+		r_con->output = NULL;
+		r_con->output_size = 0;
+		r_con->output_len = 0;
+
+		if (line[0] == '@')
+			res->status = rpc_run_builtin(connection, line, &res->data, &res->data_len);
+		else
+			res->status = command_run_line(connection->cmd_ctx, line);
+
+		if (res->status == ERROR_COMMAND_CLOSE_CONNECTION)
+			r_con->closed = 1;
+
+		res->output = r_con->output;
+		res->output_len = r_con->output_len;
+		r_con->output = NULL;
+		r_con->output_len = -1;
+
+		reply_len += 12 + res->output_len + res->data_len;
+
+		if (r_con->closed)
+			break;
+	}
+
+	rpc_write_u32(connection, reply_len);
+	rpc_write_u32(connection, results);
+	for (i = 0; i < results; i++)
+	{
+		rpc_write_u32(connection, result[i].status);
+		rpc_write_u32(connection, result[i].output_len);
+		if (result[i].output_len)
+			connection_write(connection, result[i].output, result[i].output_len);
+		rpc_write_u32(connection, result[i].data_len);
+		if (result[i].data_len)
+			connection_write(connection, result[i].data, result[i].data_len);
+
+		free(result[i].output);
+		free(result[i].data);
+	}
+	free(result);
+
+	return connection_flush(connection);
+}
+
+int rpc_input(connection_t *connection)
+{
+	rpc_connection_t *r_con = connection->priv;
+	int bytes_read;
+	u32 len;
+
+	if (r_con->request_size - r_con->request_len < 4096)
+	{
+		int size = r_con->request_size ? r_con->request_size * 2 : 8192;
+		u8 *t;
+
+		if ((t = realloc(r_con->request, size + 1)) == NULL)
+			return ERROR_SERVER_REMOTE_CLOSED;
+		r_con->request = t;
+		r_con->request_size = size;
+	}
+
+	bytes_read = read_socket(connection->fd, r_con->request + r_con->request_len,
+		r_con->request_size - r_con->request_len);
+
+	if (bytes_read == 0)
+		return ERROR_SERVER_REMOTE_CLOSED;
+	else if (bytes_read == -1)
+	{
+		LOG_ERROR("error during read: %s", strerror(errno));
+		return ERROR_SERVER_REMOTE_CLOSED;
+	}
+
+	r_con->request_len += bytes_read;
+
+	/* run every complete request in the buffer */
+	while (r_con->request_len >= 4)
+	{
+		len = rpc_get_u32(r_con->request);
+
+		if (len > RPC_MAX_REQUEST)
+		{
+			LOG_ERROR("rpc request of %u bytes exceeds the maximum of %u bytes", len, RPC_MAX_REQUEST);
+			return ERROR_SERVER_REMOTE_CLOSED;
+		}
+
+		if (r_con->request_len < (int)len + 4)
+		{
+			/* make room for the rest of it */
+			if (r_con->request_size < (int)len + 4)
+			{
+				u8 *t;
+				if ((t = realloc(r_con->request, len + 4 + 1)) == NULL)
+					return ERROR_SERVER_REMOTE_CLOSED;
+				r_con->request = t;
+				r_con->request_size = len + 4;
+			}
+			break;
+		}
+
+		rpc_run_batch(connection, (char *)r_con->request + 4, len);
+
+		if (r_con->closed)
+			return ERROR_SERVER_REMOTE_CLOSED;
+
+		r_con->request_len -= len + 4;
+		memmove(r_con->request, r_con->request + len + 4, r_con->request_len);
+	}
+
+	return ERROR_OK;
+}
+
+int rpc_new_connection(connection_t *connection)
+{
+	rpc_connection_t *r_con = malloc(sizeof(rpc_connection_t));
+
+	connection->priv = r_con;
+
+	r_con->request = NULL;
+	r_con->request_size = 0;
+	r_con->request_len = 0;
+	r_con->output = NULL;
+	r_con->output_size = 0;
+	r_con->output_len = -1;
+	r_con->closed = 0;
+
+	command_set_output_handler(connection->cmd_ctx, rpc_output, connection);
+
+	log_add_callback(rpc_log_callback, connection);
+
+	return ERROR_OK;
+}
+
+int rpc_connection_closed(connection_t *connection)
+{
+	rpc_connection_t *r_con = connection->priv;
+
+	log_remove_callback(rpc_log_callback, connection);
+
+	if (r_con)
+	{
+		free(r_con->request);
+		free(r_con->output);
+		free(r_con);
+		connection->priv = NULL;
+	}
+
+	return ERROR_OK;
+}
+
+int rpc_init(void)
+{
+	if (rpc_port == 0)
+	{
+		LOG_DEBUG("no rpc port specified, rpc service disabled");
+		return ERROR_OK;
+	}
+
+	add_service("rpc", CONNECTION_RPC, rpc_port, 1, rpc_new_connection, rpc_input, rpc_connection_closed, NULL, NULL, NULL);
+
+	return ERROR_OK;
+}
+
+int rpc_register_commands(command_context_t *command_context)
+{
+	register_command(command_context, NULL, "rpc_port", handle_rpc_port_command,
+					 COMMAND_CONFIG, "port for batched commands from scripts, disabled by default");
+
+	return ERROR_OK;
+}
+
+/* daemon configuration command rpc_port */
+int handle_rpc_port_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
+{
+	if (argc == 0)
+		return ERROR_OK;
+
+	rpc_port = strtoul(args[0], NULL, 0);
+
+	return ERROR_OK;
+}
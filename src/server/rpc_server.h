@@ -0,0 +1,64 @@
+/***************************************************************************
+ *   Copyright (C) 2008 by the OpenOCD developers                          *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************/
+#ifndef RPC_SERVER_H
+#define RPC_SERVER_H
+
+#include "server.h"
+
+/* Batch command port for scripts, disabled unless "rpc_port" is configured.
+ *
+ * A request is a 32 bit big-endian length followed by that many bytes of
+ * commands, one per line. All commands of a request are executed in order
+ * and answered with a single response:
+ *
+ *	u32 length of the rest of the response
+ *	u32 number of results
+ *	per command:
+ *		u32 status (the command's ERROR_* code)
+ *		u32 length, output (command output and log messages)
+ *		u32 length, data (binary payload)
+ *
+ * Besides ordinary commands a batch may contain
+ *	@read_memory <address> <count>		data is the memory contents
+ *	@write_memory <address> <hex bytes>
+ * which access the current target without hex dumps in the output.
+ *
+ * Output beyond RPC_MAX_REQUEST bytes per command is dropped. Once a response
+ * is near RPC_MAX_REPLY bytes the remaining commands of the batch are not
+ * executed, the number of results tells which commands ran.
+ */
+#define RPC_MAX_REQUEST		(1024 * 1024)
+#define RPC_MAX_REPLY		(64 * 1024 * 1024)
+
+typedef struct rpc_connection_s
+{
+	u8 *request;
+	int request_size;
+	int request_len;
+	/* output of the command being executed, NULL between batches */
+	char *output;
+	int output_size;
+	int output_len;
+	int closed;
+} rpc_connection_t;
+
+extern int rpc_init(void);
+extern int rpc_register_commands(command_context_t *command_context);
+
+#endif /* RPC_SERVER_H */
@@ -28,6 +28,8 @@
 #include "log.h"
 #include "telnet_server.h"
 #include "target.h"
+#include "jtag.h"
+#include "time_support.h"
 
 #include <command.h>
 #include <string.h>
@@ -39,13 +41,43 @@
 #include <signal.h>
 #ifndef _WIN32
 #include <netinet/tcp.h>
+#include <sys/uio.h>
 #endif
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_SYS_TIMERFD_H)
+#define SERVER_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
+/* the loop never sleeps for less than this, timer callbacks asking for more
+ * frequent calls are run at this interval */
+#define SERVER_MIN_SLEEP_MS	10
 
 service_t *services = NULL;
 
 /* shutdown_openocd == 1: exit the main event loop, and quit the debugger */
 static int shutdown_openocd = 0;
 int handle_shutdown_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
+int handle_server_output_buffer_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
+
+/* connection output is collected up to this many bytes, 0 writes through */
+static int server_output_highwater = 16 * 1024;
+
+int handle_server_stats_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
+
+/* event loop statistics */
+static long long server_stats_start = 0;
+static long long server_wakeups = 0;
+static long long server_io_wakeups = 0;
+static long long server_timer_wakeups = 0;
+
+#ifdef SERVER_EPOLL
+/* epoll backend, -1 if not in use and select() is used */
+static int server_epoll_fd = -1;
+static int server_timer_fd = -1;
+static int handle_server_backend_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
+static int server_use_epoll = 1;
+#endif
 
 int add_connection(service_t *service, command_context_t *cmd_ctx)
 {
@@ -60,6 +92,9 @@ int add_connection(service_t *service, command_context_t *cmd_ctx)
 	c->cmd_ctx = copy_command_context(cmd_ctx);
 	c->service = service;
 	c->input_pending = 0;
+	c->out_buffer = NULL;
+	c->out_size = 0;
+	c->out_len = 0;
 	c->priv = NULL;
 	c->next = NULL;
 
@@ -93,6 +128,18 @@ int add_connection(service_t *service, command_context_t *cmd_ctx)
 	
 	service->max_connections--;
 	
+#ifdef SERVER_EPOLL
+	if (server_epoll_fd != -1)
+	{
+		struct epoll_event event;
+		
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN;
+		event.data.fd = c->fd;
+		epoll_ctl(server_epoll_fd, EPOLL_CTL_ADD, c->fd, &event);
+	}
+#endif
+	
 	return ERROR_OK;
 }
 
@@ -107,8 +154,10 @@ int remove_connection(service_t *service, connection_t *connection)
 		if (c->fd == connection->fd)
 		{	
 			service->connection_closed(c);
+			connection_flush(c);
 			close_socket(c->fd);
 			command_done(c->cmd_ctx);
+			free(c->out_buffer);
 			
 			/* delete connection */
 			*p = c->next;
@@ -125,7 +174,115 @@ int remove_connection(service_t *service, connection_t *connection)
 	return ERROR_OK;
 }
 
-int add_service(char *name, enum connection_type type, unsigned short port, int max_connections, new_connection_handler_t new_connection_handler, input_handler_t input_handler, connection_closed_handler_t connection_closed_handler, void *priv)
+/* write all of data, buffered output first. Both go out with a single
+ * writev() where available. */
+static int connection_write_out(connection_t *connection, const void *data, int len)
+{
+	const char *buffer = connection->out_buffer;
+	int buffered = connection->out_len;
+	int written;
+
+	connection->out_len = 0;
+
+	while (buffered + len > 0)
+	{
+#ifndef _WIN32
+		struct iovec iov[2];
+		int iovcnt = 0;
+
+		if (buffered > 0)
+		{
+			iov[iovcnt].iov_base = (void *)buffer;
+			iov[iovcnt++].iov_len = buffered;
+		}
+		if (len > 0)
+		{
+			iov[iovcnt].iov_base = (void *)data;
+			iov[iovcnt++].iov_len = len;
+		}
+
+		written = writev(connection->fd, iov, iovcnt);
+		if ((written == -1) && (errno == EINTR))
+			continue;
+#else
+		if (buffered > 0)
+			written = write_socket(connection->fd, buffer, buffered);
+		else
+			written = write_socket(connection->fd, data, len);
+#endif
+		if (written <= 0)
+			return ERROR_SERVER_REMOTE_CLOSED;
+
+		if (written >= buffered)
+		{
+			written -= buffered;
+			buffered = 0;
+			data = (const char *)data + written;
+			len -= written;
+		}
+		else
+		{
+			buffer += written;
+			buffered -= written;
+		}
+	}
+
+	return ERROR_OK;
+}
+
+/* queue output for the connection. It is written once it exceeds the high-water
+ * mark, by connection_flush(), or before the server waits for input. */
+int connection_write(connection_t *connection, const void *data, int len)
+{
+	if (connection->out_len + len > server_output_highwater)
+		return connection_write_out(connection, data, len);
+
+	if (connection->out_len + len > connection->out_size)
+	{
+		int size = connection->out_size ? connection->out_size : 1024;
+		char *t;
+
+		while (size < connection->out_len + len)
+			size *= 2;
+
+		if ((t = realloc(connection->out_buffer, size)) == NULL)
+			return connection_write_out(connection, data, len);
+
+		connection->out_buffer = t;
+		connection->out_size = size;
+	}
+
+	memcpy(connection->out_buffer + connection->out_len, data, len);
+	connection->out_len += len;
+
+	return ERROR_OK;
+}
+
+int connection_flush(connection_t *connection)
+{
+	if (connection->out_len == 0)
+		return ERROR_OK;
+
+	return connection_write_out(connection, NULL, 0);
+}
+
+/* output of all connections goes out before the server sleeps */
+static void server_flush_connections(void)
+{
+	service_t *service;
+	connection_t *c;
+
+	for (service = services; service; service = service->next)
+	{
+		for (c = service->connections; c; c = c->next)
+		{
+			/* write errors show up as closed sockets on the next read */
+			connection_flush(c);
+		}
+	}
+}
+
+int add_service(char *name, enum connection_type type, unsigned short port, int max_connections, new_connection_handler_t new_connection_handler, input_handler_t input_handler, connection_closed_handler_t connection_closed_handler, connection_sync_handler_t sync_handler, yield_input_handler_t yield_input_handler, void *priv)
 {
 	service_t *c, **p;
 	int so_reuseaddr_option = 1;
@@ -141,6 +298,8 @@ int add_service(char *name, enum connection_type type, unsigned short port, int
 	c->new_connection = new_connection_handler;
 	c->input = input_handler;
 	c->connection_closed = connection_closed_handler;
+	c->sync = sync_handler;
+	c->yield_input = yield_input_handler;
 	c->priv = priv;
 	c->next = NULL;
 	
@@ -249,6 +408,219 @@ int remove_services()
 extern void lockBigLock();
 extern void unlockBigLock();
 
+#ifdef SERVER_EPOLL
+static int server_epoll_add(int fd)
+{
+	struct epoll_event event;
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = fd;
+
+	return epoll_ctl(server_epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+/* set up epoll with all listeners and connections, and a timerfd that is
+ * armed for the next target timer callback */
+static int server_epoll_init(void)
+{
+	service_t *service;
+	connection_t *c;
+
+	if ((server_epoll_fd = epoll_create(16)) == -1)
+		return ERROR_FAIL;
+
+	if (((server_timer_fd = timerfd_create(CLOCK_MONOTONIC, 0)) == -1)
+		|| (server_epoll_add(server_timer_fd) == -1))
+	{
+		LOG_WARNING("couldn't create timerfd: %s", strerror(errno));
+		if (server_timer_fd != -1)
+			close(server_timer_fd);
+		close(server_epoll_fd);
+		server_epoll_fd = server_timer_fd = -1;
+		return ERROR_FAIL;
+	}
+
+	for (service = services; service; service = service->next)
+	{
+		if (service->fd != -1)
+			server_epoll_add(service->fd);
+
+		for (c = service->connections; c; c = c->next)
+			server_epoll_add(c->fd);
+	}
+
+#ifndef BUILD_ECOSBOARD
+	/* fails for regular files and /dev/null, which never have input anyway */
+	server_epoll_add(fileno(stdin));
+#endif
+
+	return ERROR_OK;
+}
+
+static void server_epoll_quit(void)
+{
+	if (server_epoll_fd == -1)
+		return;
+
+	close(server_timer_fd);
+	close(server_epoll_fd);
+	server_epoll_fd = server_timer_fd = -1;
+}
+
+/* wait for activity or the next timer callback, ready fds are returned in
+ * read_fds as select() would */
+static int server_epoll_wait(fd_set *read_fds, int immediate)
+{
+	struct epoll_event events[16];
+	struct itimerspec timer;
+	int next_ms;
+	int retval;
+	int i;
+
+	FD_ZERO(read_fds);
+
+	memset(&timer, 0, sizeof(timer));
+	next_ms = target_timer_callbacks_next_ms();
+	if (next_ms >= 0)
+	{
+		if (next_ms < SERVER_MIN_SLEEP_MS)
+			next_ms = SERVER_MIN_SLEEP_MS;
+		timer.it_value.tv_sec = next_ms / 1000;
+		timer.it_value.tv_nsec = (next_ms % 1000) * 1000000;
+	}
+	timerfd_settime(server_timer_fd, 0, &timer, NULL);
+
+	// Only while we're sleeping we'll let others run
+	unlockBigLock();
+	retval = epoll_wait(server_epoll_fd, events, 16, immediate ? 0 : -1);
+	lockBigLock();
+
+	if (retval == -1)
+		return -1;
+
+	for (i = 0; i < retval; i++)
+	{
+		if (events[i].data.fd == server_timer_fd)
+		{
+			u8 expirations[8];
+			read(server_timer_fd, expirations, sizeof(expirations));
+			server_timer_wakeups++;
+		}
+		else
+		{
+			FD_SET(events[i].data.fd, read_fds);
+			server_io_wakeups++;
+		}
+	}
+
+	return retval;
+}
+#endif
+
+/* monitor all listeners, connections and stdin for activity */
+static int server_select_wait(fd_set *read_fds, struct timeval *tv)
+{
+	service_t *service;
+	int fd_max = 0;
+	int retval;
+
+	FD_ZERO(read_fds);
+
+	/* add service and connection fds to read_fds */
+	for (service = services; service; service = service->next)
+	{
+		if (service->fd != -1)
+		{
+			/* listen for new connections */
+			FD_SET(service->fd, read_fds);
+
+			if (service->fd > fd_max)
+				fd_max = service->fd;
+		}
+		
+		if (service->connections)
+		{
+			connection_t *c;
+			
+			for (c = service->connections; c; c = c->next)
+			{
+				/* check for activity on the connection */
+				FD_SET(c->fd, read_fds);
+				if (c->fd > fd_max)
+					fd_max = c->fd;
+			}
+		}
+	}
+	
+#ifndef _WIN32
+#ifndef BUILD_ECOSBOARD
+	/* add STDIN to read_fds */
+	FD_SET(fileno(stdin), read_fds);
+#endif
+#endif
+
+	// Only while we're sleeping we'll let others run
+	unlockBigLock();
+	retval = select(fd_max + 1, read_fds, NULL, NULL, tv);
+	lockBigLock();
+
+	if (retval > 0)
+		server_io_wakeups++;
+
+	return retval;
+}
+
+/* the connection whose input is being handled, its operations may yield */
+static connection_t *server_busy = NULL;
+
+connection_t *server_busy_connection(void)
+{
+	return server_busy;
+}
+
+/* Before a connection's input is handled, all other connections complete
+ * what they have acknowledged already, e.g. gdb memory writes. Any command
+ * could read that memory, reset or resume the target. The busy connection
+ * is left alone, it is in the middle of an operation. */
+static void server_sync_connections(connection_t *connection)
+{
+	service_t *service;
+	connection_t *c;
+
+	for (service = services; service; service = service->next)
+	{
+		if (!service->sync)
+			continue;
+
+		for (c = service->connections; c; c = c->next)
+		{
+			if ((c != connection) && (c != server_busy))
+				service->sync(c);
+		}
+	}
+}
+
+#ifdef SERVER_EPOLL
+/* connections with buffered input are served without waiting */
+static int server_input_pending(void)
+{
+	service_t *service;
+	connection_t *c;
+
+	for (service = services; service; service = service->next)
+	{
+		for (c = service->connections; c; c = c->next)
+		{
+			if (c->input_pending)
+				return 1;
+		}
+	}
+
+	return 0;
+}
+#endif
+
 int server_loop(command_context_t *command_context)
 {
 	service_t *service;
@@ -256,7 +628,6 @@ int server_loop(command_context_t *command_context)
 	/* used in select() */
 	fd_set read_fds;
 	struct timeval tv;
-	int fd_max;
 	
 	/* used in accept() */
 	int retval;
@@ -273,53 +644,28 @@ int server_loop(command_context_t *command_context)
 		lockBigLock();
 	}
 	
+	server_stats_start = timeval_ms();
+	
+#ifdef SERVER_EPOLL
+	if (server_use_epoll && (server_epoll_fd == -1) && (server_epoll_init() != ERROR_OK))
+		LOG_WARNING("epoll not available, using select()");
+#endif
+	
 	/* do regular tasks after at most 10ms */
 	tv.tv_sec = 0;
 	tv.tv_usec = 10000;
 	
 	while(!shutdown_openocd)
 	{
-		/* monitor sockets for acitvity */
-		fd_max = 0;
-		FD_ZERO(&read_fds);
-
-		/* add service and connection fds to read_fds */
-		for (service = services; service; service = service->next)
-		{
-			if (service->fd != -1)
-			{
-				/* listen for new connections */
-				FD_SET(service->fd, &read_fds);
+		server_flush_connections();
 
-				if (service->fd > fd_max)
-					fd_max = service->fd;
-			}
-			
-			if (service->connections)
-			{
-				connection_t *c;
-				
-				for (c = service->connections; c; c = c->next)
-				{
-					/* check for activity on the connection */
-					FD_SET(c->fd, &read_fds);
-					if (c->fd > fd_max)
-						fd_max = c->fd;
-				}
-			}
-		}
-		
-#ifndef _WIN32
-#ifndef BUILD_ECOSBOARD
-		/* add STDIN to read_fds */
-		FD_SET(fileno(stdin), &read_fds);
-#endif
+#ifdef SERVER_EPOLL
+		if (server_epoll_fd != -1)
+			retval = server_epoll_wait(&read_fds, server_input_pending());
+		else
 #endif
-
-		// Only while we're sleeping we'll let others run
-		unlockBigLock();
-		retval = select(fd_max + 1, &read_fds, NULL, NULL, &tv);
-		lockBigLock();
+			retval = server_select_wait(&read_fds, &tv);
+		server_wakeups++;
 
 		if (retval == -1)
 		{
@@ -352,7 +698,7 @@ int server_loop(command_context_t *command_context)
 
 		if (retval == 0)
 		{
-			/* do regular tasks after at most 100ms */
+			/* do regular tasks after at most 10ms */
 			tv.tv_sec = 0;
 			tv.tv_usec = 10000;
 			FD_ZERO(&read_fds); /* eCos leaves read_fds unchanged in this case!  */
@@ -388,7 +734,15 @@ int server_loop(command_context_t *command_context)
 				{
 					if ((FD_ISSET(c->fd, &read_fds)) || c->input_pending)
 					{
-						if (service->input(c) != ERROR_OK)
+						/* a client is active, make target state changes show up quickly */
+						target_poll_activity();
+						
+						server_sync_connections(c);
+						server_busy = c;
+						retval = service->input(c);
+						server_busy = NULL;
+
+						if (retval != ERROR_OK)
 						{
 							connection_t *next = c->next;
 							remove_connection(service, c);
@@ -421,6 +775,10 @@ int server_loop(command_context_t *command_context)
 		}
 #endif
 	}
+#ifdef SERVER_EPOLL
+	server_epoll_quit();
+#endif
+
 	if (--lockCount==0)
 	{
 		unlockBigLock();
@@ -429,6 +787,109 @@ int server_loop(command_context_t *command_context)
 	return ERROR_OK;
 }
 
+/* Input that arrived while an operation yields goes to the services'
+ * yield_input handlers, which serve what can't disturb the operation.
+ * Services without one keep their input queued. */
+static void server_yield_input(void)
+{
+	service_t *service;
+	fd_set read_fds;
+	struct timeval tv;
+	int fd_max = -1;
+
+	FD_ZERO(&read_fds);
+
+	for (service = services; service; service = service->next)
+	{
+		connection_t *c;
+
+		if (!service->yield_input)
+			continue;
+
+		for (c = service->connections; c; c = c->next)
+		{
+			FD_SET(c->fd, &read_fds);
+			if (c->fd > fd_max)
+				fd_max = c->fd;
+		}
+	}
+
+	if (fd_max == -1)
+		return;
+
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+	if (select(fd_max + 1, &read_fds, NULL, NULL, &tv) < 0)
+		FD_ZERO(&read_fds);
+
+	for (service = services; service; service = service->next)
+	{
+		connection_t *c;
+
+		if (!service->yield_input)
+			continue;
+
+		for (c = service->connections; c;)
+		{
+			if (FD_ISSET(c->fd, &read_fds) || c->input_pending)
+			{
+				if (c == server_busy)
+				{
+					/* the handler only looks for an interrupt, e.g. gdb's ^C */
+					service->yield_input(c);
+				}
+				else
+				{
+					server_sync_connections(c);
+					if (service->yield_input(c) != ERROR_OK)
+					{
+						connection_t *next = c->next;
+						remove_connection(service, c);
+						LOG_INFO("dropped '%s' connection", service->name);
+						c = next;
+						continue;
+					}
+				}
+			}
+			c = c->next;
+		}
+	}
+}
+
+/* Called via command_yield() from long running operations, e.g. large gdb
+ * memory reads or flash programming. The target timer callbacks run, so
+ * halts of other targets are reported, output collected so far is sent
+ * and gdb connections are served as far as it is safe, see
+ * gdb_yield_input(). Telnet and rpc input stays queued until the operation
+ * has finished: their commands can reset, resume or flash any target,
+ * including the busy one.
+ */
+void server_yield(void)
+{
+	static int yielding = 0;
+	static long long last_yield = 0;
+
+	/* nested yields would run the timer callbacks recursively */
+	if (yielding)
+		return;
+
+	/* no need to check more often than the main loop does */
+	if (timeval_ms() - last_yield < 10)
+		return;
+
+	yielding = 1;
+
+	target_call_timer_callbacks();
+
+	server_yield_input();
+
+	/* e.g. progress messages of the operation that yielded */
+	server_flush_connections();
+
+	last_yield = timeval_ms();
+	yielding = 0;
+}
+
 #ifdef _WIN32
 BOOL WINAPI ControlHandler(DWORD dwCtrlType)
 {
@@ -463,6 +924,9 @@ int server_init()
 	signal(SIGABRT, sig_handler);
 #endif
 
+	command_set_yield_handler(server_yield);
+	/* replies and log output reach the clients while the JTAG worker is busy */
+	jtag_set_wait_handler(server_flush_connections);
 	
 	return ERROR_OK;
 }
@@ -483,6 +947,14 @@ int server_register_commands(command_context_t *context)
 {
 	register_command(context, NULL, "shutdown", handle_shutdown_command,
 					 COMMAND_ANY, "shut the server down");
+	register_command(context, NULL, "server_output_buffer", handle_server_output_buffer_command,
+					 COMMAND_ANY, "bytes of connection output collected before writing [bytes], 0 writes through");
+	register_command(context, NULL, "server_stats", handle_server_stats_command,
+					 COMMAND_ANY, "show event loop wakeups");
+#ifdef SERVER_EPOLL
+	register_command(context, NULL, "server_backend", handle_server_backend_command,
+					 COMMAND_CONFIG, "event loop backend <epoll|select>");
+#endif
 	
 	return ERROR_OK;
 }
@@ -495,4 +967,58 @@ int handle_shutdown_command(struct command_context_s *cmd_ctx, char *cmd, char *
 	return ERROR_COMMAND_CLOSE_CONNECTION;
 }
 
+int handle_server_output_buffer_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
+{
+	if (argc > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (argc == 1)
+		server_output_highwater = strtoul(args[0], NULL, 0);
+
+	command_print(cmd_ctx, "server output buffer: %i bytes", server_output_highwater);
+
+	return ERROR_OK;
+}
+
+int handle_server_stats_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
+{
+	long long elapsed = timeval_ms() - server_stats_start;
+	char *backend = "select";
+
+#ifdef SERVER_EPOLL
+	if (server_epoll_fd != -1)
+		backend = "epoll";
+#endif
+
+	if (elapsed <= 0)
+		elapsed = 1;
+
+	command_print(cmd_ctx, "%s loop: %lld wakeups in %lld ms, %.1f/s (%lld with input, %lld for timers)",
+		backend, server_wakeups, elapsed, server_wakeups * 1000.0 / elapsed,
+		server_io_wakeups, server_timer_wakeups);
+
+	if ((argc == 1) && !strcmp(args[0], "reset"))
+	{
+		server_stats_start = timeval_ms();
+		server_wakeups = server_io_wakeups = server_timer_wakeups = 0;
+	}
+
+	return ERROR_OK;
+}
+
+#ifdef SERVER_EPOLL
+static int handle_server_backend_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
+{
+	if (argc != 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+
+	if (!strcmp(args[0], "epoll"))
+		server_use_epoll = 1;
+	else if (!strcmp(args[0], "select"))
+		server_use_epoll = 0;
+	else
+		return ERROR_COMMAND_SYNTAX_ERROR;
 
+	return ERROR_OK;
+}
+#endif
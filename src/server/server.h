@@ -30,6 +30,7 @@ enum connection_type
 {
 	CONNECTION_GDB,
 	CONNECTION_TELNET,
+	CONNECTION_RPC,
 };
 
 typedef struct connection_s
@@ -39,6 +40,10 @@ typedef struct connection_s
 	command_context_t *cmd_ctx;
 	struct service_s *service;
 	int input_pending;
+	/* output collected until connection_flush() */
+	char *out_buffer;
+	int out_size;
+	int out_len;
 	void *priv;
 	struct connection_s *next;
 } connection_t;
@@ -46,6 +51,10 @@ typedef struct connection_s
 typedef int (*new_connection_handler_t)(connection_t *connection);
 typedef int (*input_handler_t)(connection_t *connection);
 typedef int (*connection_closed_handler_t)(connection_t *connection);
+/* completes work a connection has acknowledged but not done yet */
+typedef int (*connection_sync_handler_t)(connection_t *connection);
+/* serves what is safe to serve while another connection's operation yields */
+typedef int (*yield_input_handler_t)(connection_t *connection);
 
 typedef struct service_s
 {
@@ -59,14 +68,20 @@ typedef struct service_s
 	new_connection_handler_t new_connection;
 	input_handler_t input;
 	connection_closed_handler_t connection_closed;
+	connection_sync_handler_t sync;
+	yield_input_handler_t yield_input;
 	void *priv;
 	struct service_s *next;
 } service_t;
 
-extern int add_service(char *name, enum connection_type type, unsigned short port, int max_connections, new_connection_handler_t new_connection_handler, input_handler_t input_handler, connection_closed_handler_t connection_closed_handler, void *priv);
+extern int add_service(char *name, enum connection_type type, unsigned short port, int max_connections, new_connection_handler_t new_connection_handler, input_handler_t input_handler, connection_closed_handler_t connection_closed_handler, connection_sync_handler_t sync_handler, yield_input_handler_t yield_input_handler, void *priv);
 extern int server_init();
 extern int server_quit();
 extern int server_loop(command_context_t *command_context);
+extern void server_yield(void);
+extern connection_t *server_busy_connection(void);
+extern int connection_write(connection_t *connection, const void *data, int len);
+extern int connection_flush(connection_t *connection);
 extern int server_register_commands(command_context_t *context);
 
 #define ERROR_SERVER_REMOTE_CLOSED	(-400)
@@ -60,7 +60,9 @@ int telnet_write(connection_t *connection, const void *data, int len)
 	if (t_con->closed)
 		return ERROR_SERVER_REMOTE_CLOSED;
 
-	if (write_socket(connection->fd, data, len) == len)
+	/* collected by the server, written at the end of the command, when a long
+	 * operation yields or when the buffer fills */
+	if (connection_write(connection, data, len) == ERROR_OK)
 	{
 		return ERROR_OK;
 	}
@@ -627,7 +629,7 @@ int telnet_init(char *banner)
 
 	telnet_service->banner = banner;
 
-	add_service("telnet", CONNECTION_TELNET, telnet_port, 1, telnet_new_connection, telnet_input, telnet_connection_closed, telnet_service);
+	add_service("telnet", CONNECTION_TELNET, telnet_port, 1, telnet_new_connection, telnet_input, telnet_connection_closed, NULL, NULL, telnet_service);
 
 	return ERROR_OK;
 }
@@ -24,6 +24,7 @@
 #include "arm11.h"
 #include "jtag.h"
 #include "log.h"
+#include "time_support.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -81,6 +82,7 @@ target_type_t arm11_target =
     ARM11_HANDLER(bulk_write_memory),
 	
     ARM11_HANDLER(checksum_memory),
+    ARM11_HANDLER(checksum_memory_blocks),
 
     ARM11_HANDLER(add_breakpoint),
     ARM11_HANDLER(remove_breakpoint),
@@ -1255,15 +1257,315 @@ int arm11_bulk_write_memory(struct target_s *target, u32 address, u32 count, u8
 	return ERROR_TARGET_NOT_HALTED;
     }
 
-    return arm11_write_memory(target, address, 4, count, buffer);
+    if (!arm11_config_memwrite_burst)
+	return arm11_write_memory(target, address, 4, count, buffer);
+
+    LOG_DEBUG("ADDR %08x  COUNT %08x", address, count);
+
+    arm11_common_t * arm11 = target->arch_info;
+
+    arm11_run_instr_data_prepare(arm11);
+
+    /* MRC p14,0,r0,c0,c5,0 */
+    arm11_run_instr_data_to_core1(arm11, 0xee100e15, address);
+
+    /* stream the words through DTR, one JTAG queue execution per chunk;
+     * each chunk is copied to words[] as buffer needn't be word aligned */
+    int retval = ERROR_OK;
+    u32 done = 0;
+    u32 words[ARM11_BULK_WRITE_CHUNK];
+
+    while ((done < count) && (retval == ERROR_OK))
+    {
+	u32 chunk = count - done;
+
+	if (chunk > ARM11_BULK_WRITE_CHUNK)
+	    chunk = ARM11_BULK_WRITE_CHUNK;
+
+	memcpy(words, buffer + 4 * done, 4 * chunk);
+
+	/* STC p14,c5,[R0],#4 */
+	retval = arm11_run_instr_data_to_core_noack(arm11, 0xeca05e01, words, chunk);
+
+	done += chunk;
+    }
+
+    u32 r0;
+
+    /* MCR p14,0,R0,c0,c5,0 */
+    arm11_run_instr_data_from_core(arm11, 0xEE000E15, &r0, 1);
+
+    arm11_run_instr_data_finish(arm11);
+
+    if ((retval == ERROR_OK) && (address + 4 * count == r0))
+	return ERROR_OK;
+
+    LOG_WARNING("Burst transfer failed (%d), retrying with handshake", (r0 - address) - 4 * count);
+
+    arm11_run_instr_data_prepare(arm11);
+
+    /* MRC p14,0,r0,c0,c5,0 */
+    arm11_run_instr_data_to_core1(arm11, 0xee100e15, address);
+
+    /* STC p14,c5,[R0],#4 */
+    arm11_run_instr_data_to_core(arm11, 0xeca05e01, (u32 *)buffer, count);
+
+    /* MCR p14,0,R0,c0,c5,0 */
+    arm11_run_instr_data_from_core(arm11, 0xEE000E15, &r0, 1);
+
+    arm11_run_instr_data_finish(arm11);
+
+    if (address + 4 * count != r0)
+    {
+	LOG_ERROR("Data transfer failed. (%d)", (r0 - address) - 4 * count);
+	return ERROR_FAIL;
+    }
+
+    return ERROR_OK;
 }
 
 
 int arm11_checksum_memory(struct target_s *target, u32 address, u32 count, u32* checksum)
 {
-    FNC_INFO_NOTIMPLEMENTED;
+    FNC_INFO;
 
-    return ERROR_OK;
+    /* same bit-serial CRC32 as arm7_9_checksum_memory() */
+    static const u32 arm11_crc_code[] =
+    {
+	0xE1A02000,		/* mov		r2, r0 */
+	0xE3E00000,		/* mov		r0, #0xffffffff */
+	0xE1A03001,		/* mov		r3, r1 */
+	0xE3A04000,		/* mov		r4, #0 */
+	0xEA00000B,		/* b		ncomp */
+				/* nbyte: */
+	0xE7D21004,		/* ldrb		r1, [r2, r4] */
+	0xE59F7030,		/* ldr		r7, CRC32XOR */
+	0xE0200C01,		/* eor		r0, r0, r1, asl 24 */
+	0xE3A05000,		/* mov		r5, #0 */
+				/* loop: */
+	0xE3500000,		/* cmp		r0, #0 */
+	0xE1A06080,		/* mov		r6, r0, asl #1 */
+	0xE2855001,		/* add		r5, r5, #1 */
+	0xE1A00006,		/* mov		r0, r6 */
+	0xB0260007,		/* eorlt	r0, r6, r7 */
+	0xE3550008,		/* cmp		r5, #8 */
+	0x1AFFFFF8,		/* bne		loop */
+	0xE2844001,		/* add		r4, r4, #1 */
+				/* ncomp: */
+	0xE1540003,		/* cmp		r4, r3 */
+	0x1AFFFFF1,		/* bne		nbyte */
+				/* end: */
+	0xEAFFFFFE,		/* b		end */
+	0x04C11DB7		/* CRC32XOR:	.word 0x04C11DB7 */
+    };
+
+    /* same table driven CRC32 as arm7_9_checksum_memory(), r2 points to the table */
+    static const u32 arm11_crc_table_code[] =
+    {
+	0xE1A03000,		/* mov		r3, r0 */
+	0xE3E00000,		/* mvn		r0, #0 */
+	0xE0831001,		/* add		r1, r3, r1 */
+	0xEA000003,		/* b		ncomp */
+				/* nbyte: */
+	0xE4D34001,		/* ldrb		r4, [r3], #1 */
+	0xE0244C20,		/* eor		r4, r4, r0, lsr #24 */
+	0xE7924104,		/* ldr		r4, [r2, r4, lsl #2] */
+	0xE0240400,		/* eor		r0, r4, r0, lsl #8 */
+				/* ncomp: */
+	0xE1530001,		/* cmp		r3, r1 */
+	0x1AFFFFF9,		/* bne		nbyte */
+				/* end: */
+	0xEAFFFFFE		/* b		end */
+    };
+
+    working_area_t *	crc_algorithm;
+    working_area_t *	crc_table = NULL;
+    reg_param_t		reg_params[3];
+    u8			code[sizeof(arm11_crc_code)];
+    int			retval;
+
+    if (target->state != TARGET_HALTED)
+    {
+	LOG_WARNING("target was not halted");
+	return ERROR_TARGET_NOT_HALTED;
+    }
+
+    const u32 *	crc_code		= arm11_crc_code;
+    size_t	crc_code_count		= asizeof(arm11_crc_code);
+    u32		exit_point_offset	= sizeof(arm11_crc_code) - 8;
+
+    /* use the table driven loop if there's room for the 1K table, the bit-serial loop otherwise */
+    if (target_alloc_crc32_table(target, &crc_table) == ERROR_OK)
+    {
+	if (target_alloc_working_area(target, sizeof(arm11_crc_table_code), &crc_algorithm) == ERROR_OK)
+	{
+	    crc_code		= arm11_crc_table_code;
+	    crc_code_count	= asizeof(arm11_crc_table_code);
+	    exit_point_offset	= sizeof(arm11_crc_table_code) - 4;
+	}
+	else
+	{
+	    target_free_working_area(target, crc_table);
+	    crc_table = NULL;
+	}
+    }
+
+    if (!crc_table && (target_alloc_working_area(target, sizeof(arm11_crc_code), &crc_algorithm) != ERROR_OK))
+    {
+	return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+    }
+
+    /* convert the code into a buffer in target endianness */
+    {size_t i;
+    for (i = 0; i < crc_code_count; i++)
+	target_buffer_set_u32(target, code + i * sizeof(u32), crc_code[i]);
+    }
+
+    if ((retval = target_write_buffer(target, crc_algorithm->address, crc_code_count * sizeof(u32), code)) == ERROR_OK)
+    {
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_IN_OUT);
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
+
+	buf_set_u32(reg_params[0].value, 0, 32, address);
+	buf_set_u32(reg_params[1].value, 0, 32, count);
+	buf_set_u32(reg_params[2].value, 0, 32, crc_table ? crc_table->address : 0);
+
+	if ((retval = target->type->run_algorithm(target, 0, NULL, 3, reg_params,
+	    crc_algorithm->address, crc_algorithm->address + exit_point_offset, 20000, NULL)) != ERROR_OK)
+	{
+	    LOG_ERROR("error executing arm11 crc algorithm");
+	}
+	else
+	{
+	    *checksum = buf_get_u32(reg_params[0].value, 0, 32);
+	}
+
+	destroy_reg_param(&reg_params[0]);
+	destroy_reg_param(&reg_params[1]);
+	destroy_reg_param(&reg_params[2]);
+    }
+
+    target_free_working_area(target, crc_algorithm);
+    if (crc_table)
+	target_free_working_area(target, crc_table);
+
+    return retval;
+}
+
+
+int arm11_checksum_memory_blocks(struct target_s *target, u32 address, u32 count, u32 block_size, u32 *checksums)
+{
+    FNC_INFO;
+
+    /* same block CRC32 as arm7_9_checksum_memory_blocks(), r2 points to the table, r4 to the results */
+    static const u32 arm11_crc_blocks_code[] =
+    {
+	0xE0801001,		/* add		r1, r0, r1 */
+				/* block: */
+	0xE3E05000,		/* mvn		r5, #0 */
+	0xE0806003,		/* add		r6, r0, r3 */
+	0xE1560001,		/* cmp		r6, r1 */
+	0x81A06001,		/* movhi	r6, r1 */
+				/* nbyte: */
+	0xE4D07001,		/* ldrb		r7, [r0], #1 */
+	0xE0277C25,		/* eor		r7, r7, r5, lsr #24 */
+	0xE7927107,		/* ldr		r7, [r2, r7, lsl #2] */
+	0xE0275405,		/* eor		r5, r7, r5, lsl #8 */
+	0xE1500006,		/* cmp		r0, r6 */
+	0x1AFFFFF9,		/* bne		nbyte */
+	0xE4845004,		/* str		r5, [r4], #4 */
+	0xE1500001,		/* cmp		r0, r1 */
+	0x1AFFFFF2,		/* bne		block */
+				/* end: */
+	0xEAFFFFFE		/* b		end */
+    };
+
+    working_area_t *	crc_algorithm;
+    working_area_t *	crc_table;
+    working_area_t *	crc_results;
+    reg_param_t		reg_params[5];
+    u8			code[sizeof(arm11_crc_blocks_code)];
+    int			retval;
+
+    if (target->state != TARGET_HALTED)
+    {
+	LOG_WARNING("target was not halted");
+	return ERROR_TARGET_NOT_HALTED;
+    }
+
+    if (count == 0 || block_size == 0)
+	return ERROR_INVALID_ARGUMENTS;
+
+    u32 num_blocks = (count + block_size - 1) / block_size;
+
+    if (target_alloc_crc32_table(target, &crc_table) != ERROR_OK)
+	return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+
+    if (target_alloc_working_area(target, sizeof(arm11_crc_blocks_code), &crc_algorithm) != ERROR_OK)
+    {
+	target_free_working_area(target, crc_table);
+	return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+    }
+
+    if (target_alloc_working_area(target, num_blocks * sizeof(u32), &crc_results) != ERROR_OK)
+    {
+	target_free_working_area(target, crc_algorithm);
+	target_free_working_area(target, crc_table);
+	return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+    }
+
+    /* convert the code into a buffer in target endianness */
+    {size_t i;
+    for (i = 0; i < asizeof(arm11_crc_blocks_code); i++)
+	target_buffer_set_u32(target, code + i * sizeof(u32), arm11_crc_blocks_code[i]);
+    }
+
+    if ((retval = target_write_buffer(target, crc_algorithm->address, sizeof(code), code)) == ERROR_OK)
+    {
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);
+	init_reg_param(&reg_params[4], "r4", 32, PARAM_OUT);
+
+	buf_set_u32(reg_params[0].value, 0, 32, address);
+	buf_set_u32(reg_params[1].value, 0, 32, count);
+	buf_set_u32(reg_params[2].value, 0, 32, crc_table->address);
+	buf_set_u32(reg_params[3].value, 0, 32, block_size);
+	buf_set_u32(reg_params[4].value, 0, 32, crc_results->address);
+
+	if ((retval = target->type->run_algorithm(target, 0, NULL, 5, reg_params,
+	    crc_algorithm->address, crc_algorithm->address + sizeof(arm11_crc_blocks_code) - 4, 20000, NULL)) != ERROR_OK)
+	{
+	    LOG_ERROR("error executing arm11 crc algorithm");
+	}
+	else
+	{
+	    u8 * results = malloc(num_blocks * sizeof(u32));
+
+	    if ((retval = target_read_buffer(target, crc_results->address, num_blocks * sizeof(u32), results)) == ERROR_OK)
+	    {
+		{size_t i;
+		for (i = 0; i < num_blocks; i++)
+		    checksums[i] = target_buffer_get_u32(target, results + i * sizeof(u32));
+		}
+	    }
+
+	    free(results);
+	}
+
+	{size_t i;
+	for (i = 0; i < asizeof(reg_params); i++)
+	    destroy_reg_param(&reg_params[i]);
+	}
+    }
+
+    target_free_working_area(target, crc_results);
+    target_free_working_area(target, crc_algorithm);
+    target_free_working_area(target, crc_table);
+
+    return retval;
 }
 
 
@@ -1328,11 +1630,162 @@ int arm11_remove_watchpoint(struct target_s *target, watchpoint_t *watchpoint)
 
 
 /* target algorithm support */
-int arm11_run_algorithm(struct target_s *target, int num_mem_params, mem_param_t *mem_params, int num_reg_params, reg_param_t *reg_param, u32 entry_point, u32 exit_point, int timeout_ms, void *arch_info)
+int arm11_run_algorithm(struct target_s *target, int num_mem_params, mem_param_t *mem_params, int num_reg_params, reg_param_t *reg_params, u32 entry_point, u32 exit_point, int timeout_ms, void *arch_info)
 {
-    FNC_INFO_NOTIMPLEMENTED;
+    FNC_INFO;
 
-    return ERROR_OK;
+    arm11_common_t * arm11 = target->arch_info;
+
+    if (target->state != TARGET_HALTED)
+    {
+	LOG_WARNING("target was not halted");
+	return ERROR_TARGET_NOT_HALTED;
+    }
+
+    /* save context, the algorithm may use any of r0 - r15 */
+    u32 context[16];
+    u32 cpsr = R(CPSR);
+    enum target_debug_reason debug_reason = target->debug_reason;
+    int retval = ERROR_OK;
+
+    {size_t i;
+    for (i = 0; i < asizeof(context); i++)
+	context[i] = R(RX + i);
+    }
+
+    {int i;
+    for (i = 0; i < num_mem_params; i++)
+    {
+	target_write_buffer(target, mem_params[i].address, mem_params[i].size, mem_params[i].value);
+    }}
+
+    {int i;
+    for (i = 0; i < num_reg_params; i++)
+    {
+	reg_t *reg = register_get_by_name(target->reg_cache, reg_params[i].reg_name, 0);
+
+	if (!reg)
+	{
+	    LOG_ERROR("BUG: register '%s' not found", reg_params[i].reg_name);
+	    exit(-1);
+	}
+
+	if (reg->size != reg_params[i].size)
+	{
+	    LOG_ERROR("BUG: register '%s' size doesn't match reg_params[i].size", reg_params[i].reg_name);
+	    exit(-1);
+	}
+
+	arm11_set_reg(reg, reg_params[i].value);
+    }}
+
+    /* algorithms are always executed in ARM state */
+    R(CPSR) &= ~(ARM11_CPSR_T | ARM11_CPSR_J);
+    R(PC) = entry_point;
+
+    /* the exit breakpoint replaces all other break-/watchpoints while the algorithm runs */
+    arm11_sc7_clear_vbw(arm11);
+
+    arm11_sc7_action_t	brp[2];
+
+    brp[0].write	= 1;
+    brp[0].address	= ARM11_SC7_BVR0;
+    brp[0].value	= exit_point;
+    brp[1].write	= 1;
+    brp[1].address	= ARM11_SC7_BCR0;
+    brp[1].value	= 0x1 | (3 << 1) | (0x0F << 5) | (0 << 14) | (0 << 16) | (0 << 20) | (0 << 21);
+
+    arm11_sc7_run(arm11, brp, asizeof(brp));
+
+    arm11_leave_debug_state(arm11);
+
+    arm11_add_IR(arm11, ARM11_RESTART, TAP_RTI);
+
+    jtag_execute_queue();
+
+    target->state = TARGET_DEBUG_RUNNING;
+
+    deadline_t deadline;
+
+    deadline_start(&deadline, timeout_ms);
+
+    while (1)
+    {
+	u32 dscr = arm11_read_DSCR(arm11);
+
+	if ((dscr & (ARM11_DSCR_CORE_RESTARTED | ARM11_DSCR_CORE_HALTED)) ==
+	    (ARM11_DSCR_CORE_RESTARTED | ARM11_DSCR_CORE_HALTED))
+	    break;
+
+	if (deadline_wait(&deadline))
+	    continue;
+
+	if (retval != ERROR_OK)
+	{
+	    /* the core is still running, its context can't be restored */
+	    LOG_ERROR("target didn't halt after the algorithm timed out");
+
+	    target->state = TARGET_UNKNOWN;
+
+	    return ERROR_TARGET_TIMEOUT;
+	}
+
+	LOG_ERROR("timeout waiting for algorithm to complete, trying to halt target");
+
+	arm11_add_IR(arm11, ARM11_HALT, TAP_RTI);
+
+	jtag_execute_queue();
+
+	retval = ERROR_TARGET_TIMEOUT;
+
+	/* give the halt request a second */
+	deadline_start(&deadline, 1000);
+    }
+
+    arm11_on_enter_debug_state(arm11);
+
+    arm11_sc7_clear_vbw(arm11);
+
+    target->state		= TARGET_HALTED;
+    target->debug_reason	= debug_reason;
+
+    if ((retval == ERROR_OK) && (R(PC) != exit_point))
+    {
+	LOG_WARNING("target reentered debug state, but not at the desired exit point: 0x%08x", R(PC));
+    }
+
+    {int i;
+    for (i = 0; i < num_mem_params; i++)
+    {
+	if (mem_params[i].direction != PARAM_OUT)
+	    target_read_buffer(target, mem_params[i].address, mem_params[i].size, mem_params[i].value);
+    }}
+
+    {int i;
+    for (i = 0; i < num_reg_params; i++)
+    {
+	if (reg_params[i].direction != PARAM_OUT)
+	{
+	    reg_t *reg = register_get_by_name(target->reg_cache, reg_params[i].reg_name, 0);
+
+	    buf_set_u32(reg_params[i].value, 0, 32, buf_get_u32(reg->value, 0, 32));
+	}
+    }}
+
+    /* restore context, written back on the next resume */
+    {size_t i;
+    for (i = 0; i < asizeof(context); i++)
+    {
+	R(RX + i) = context[i];
+	arm11->reg_list[ARM11_RC_RX + i].valid = 1;
+	arm11->reg_list[ARM11_RC_RX + i].dirty = 1;
+    }}
+
+    R(CPSR) = cpsr;
+    arm11->reg_list[ARM11_RC_CPSR].valid = 1;
+    arm11->reg_list[ARM11_RC_CPSR].dirty = 1;
+
+    return retval;
 }
 
 int arm11_target_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc, struct target_s *target)
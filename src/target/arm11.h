@@ -42,6 +42,9 @@
 #endif
 
 
+/* words streamed through DTR per JTAG queue execution in arm11_bulk_write_memory() */
+#define ARM11_BULK_WRITE_CHUNK		1024
+
 #define ARM11_REGCACHE_MODEREGS		0
 #define ARM11_REGCACHE_FREGS		0
 
@@ -208,6 +211,7 @@ int arm11_write_memory(struct target_s *target, u32 address, u32 size, u32 count
 int arm11_bulk_write_memory(struct target_s *target, u32 address, u32 count, u8 *buffer);
 
 int arm11_checksum_memory(struct target_s *target, u32 address, u32 count, u32* checksum);
+int arm11_checksum_memory_blocks(struct target_s *target, u32 address, u32 count, u32 block_size, u32 *checksums);
 
 /* target break-/watchpoint control 
 * rw: 0 = write, 1 = read, 2 = access
@@ -228,6 +232,8 @@ int arm11_quit(void);
 
 /* helpers */
 void arm11_build_reg_cache(target_t *target);
+int arm11_get_reg(reg_t *reg);
+int arm11_set_reg(reg_t *reg, u8 *buf);
 
 void arm11_record_register_history(arm11_common_t * arm11);
 void arm11_dump_reg_changes(arm11_common_t * arm11);
@@ -249,7 +255,7 @@ void arm11_run_instr_data_finish		(arm11_common_t * arm11);
 void arm11_run_instr_no_data			(arm11_common_t * arm11, u32 * opcode, size_t count);
 void arm11_run_instr_no_data1			(arm11_common_t * arm11, u32 opcode);
 void arm11_run_instr_data_to_core		(arm11_common_t * arm11, u32 opcode, u32 * data, size_t count);
-void arm11_run_instr_data_to_core_noack		(arm11_common_t * arm11, u32 opcode, u32 * data, size_t count);
+int  arm11_run_instr_data_to_core_noack		(arm11_common_t * arm11, u32 opcode, u32 * data, size_t count);
 void arm11_run_instr_data_to_core1		(arm11_common_t * arm11, u32 opcode, u32 data);
 void arm11_run_instr_data_from_core		(arm11_common_t * arm11, u32 opcode, u32 * data, size_t count);
 void arm11_run_instr_data_from_core_via_r0	(arm11_common_t * arm11, u32 opcode, u32 * data);
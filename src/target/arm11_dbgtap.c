@@ -474,7 +474,8 @@ enum tap_state arm11_MOVE_PD_RTI_PD_with_delay[] =
 /** Execute one instruction via ITR repeatedly while
  *  passing data to the core via DTR on each execution.
  *
- *  No Ready check during transmission.
+ *  No Ready check during transmission. All words are queued
+ *  and the JTAG queue is executed only once at the end.
  *
  *  The executed instruction \em must read data from DTR.
  *
@@ -485,8 +486,10 @@ enum tap_state arm11_MOVE_PD_RTI_PD_with_delay[] =
  * \param data		Pointer to the data words to be passed to the core
  * \param count		Number of data words and instruction repetitions
  *
+ * \return ERROR_OK if the core was ready for every word
+ *
  */
-void arm11_run_instr_data_to_core_noack(arm11_common_t * arm11, u32 opcode, u32 * data, size_t count)
+int arm11_run_instr_data_to_core_noack(arm11_common_t * arm11, u32 opcode, u32 * data, size_t count)
 {
     arm11_add_IR(arm11, ARM11_ITRSEL, -1);
 
@@ -541,7 +544,12 @@ void arm11_run_instr_data_to_core_noack(arm11_common_t * arm11, u32 opcode, u32
     }}
 
     if (error_count)
+    {
 	LOG_ERROR("Transfer errors " ZU, error_count);
+	return ERROR_FAIL;
+    }
+
+    return ERROR_OK;
 }
 
 
@@ -32,6 +32,7 @@
 #include "log.h"
 #include "arm7_9_common.h"
 #include "breakpoints.h"
+#include "time_support.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -639,6 +640,7 @@ int arm7_9_target_request_data(target_t *target, u32 size, u8 *buffer)
 int arm7_9_handle_target_request(void *priv)
 {
 	target_t *target = priv;
+	target_reschedule_timer_callback(arm7_9_handle_target_request, target, target_request_poll_interval(target));
 	if (!target->type->examined)
 		return ERROR_OK;
 	armv4_5_common_t *armv4_5 = target->arch_info;
@@ -2074,6 +2076,7 @@ int arm7_9_bulk_write_memory(target_t *target, u32 address, u32 count, u8 *buffe
 	u32 r0 = buf_get_u32(armv4_5->core_cache->reg_list[0].value, 0, 32);
 	u32 r1 = buf_get_u32(armv4_5->core_cache->reg_list[1].value, 0, 32);
 	u32 pc = buf_get_u32(armv4_5->core_cache->reg_list[15].value, 0, 32);
+	deadline_t timeout;
 	int i;
 	
 	if (!arm7_9->dcc_downloads)
@@ -2150,17 +2153,17 @@ int arm7_9_bulk_write_memory(target_t *target, u32 address, u32 count, u8 *buffe
 	
 	target_halt(target);
 	
-	for (i=0; i<100; i++)
+	deadline_start(&timeout, 100);
+	for (;;)
 	{
 		target_poll(target);
 		if (target->state == TARGET_HALTED)
 			break;
-		usleep(1000); /* sleep 1ms */
-	}
-	if (i == 100)
-	{
-		LOG_ERROR("bulk write timed out, target not halted");
-		return ERROR_TARGET_TIMEOUT;
+		if (!deadline_wait(&timeout))
+		{
+			LOG_ERROR("bulk write timed out, target not halted");
+			return ERROR_TARGET_TIMEOUT;
+		}
 	}
 	
 	/* restore target state */
@@ -2181,8 +2184,9 @@ int arm7_9_bulk_write_memory(target_t *target, u32 address, u32 count, u8 *buffe
 int arm7_9_checksum_memory(struct target_s *target, u32 address, u32 count, u32* checksum)
 {
 	working_area_t *crc_algorithm;
+	working_area_t *crc_table = NULL;
 	armv4_5_algorithm_t armv4_5_info;
-	reg_param_t reg_params[2];
+	reg_param_t reg_params[3];
 	int retval;
 	
 	u32 arm7_9_crc_code[] = {
@@ -2213,16 +2217,53 @@ int arm7_9_checksum_memory(struct target_s *target, u32 address, u32 count, u32*
 		0x04C11DB7				/* CRC32XOR:	.word 0x04C11DB7 */
 	};
 	
+	/* r2 points to the lookup table uploaded by target_alloc_crc32_table() */
+	u32 arm7_9_crc_table_code[] = {
+		0xE1A03000,				/* mov		r3, r0 */
+		0xE3E00000,				/* mvn		r0, #0 */
+		0xE0831001,				/* add		r1, r3, r1 */
+		0xEA000003,				/* b		ncomp */
+								/* nbyte: */
+		0xE4D34001,				/* ldrb	r4, [r3], #1 */
+		0xE0244C20,				/* eor		r4, r4, r0, lsr #24 */
+		0xE7924104,				/* ldr		r4, [r2, r4, lsl #2] */
+		0xE0240400,				/* eor		r0, r4, r0, lsl #8 */
+								/* ncomp: */
+		0xE1530001,				/* cmp		r3, r1 */
+		0x1AFFFFF9,				/* bne		nbyte */
+								/* end: */
+		0xEAFFFFFE				/* b		end */
+	};
+	
+	u32 *crc_code = arm7_9_crc_code;
+	int crc_code_size = sizeof(arm7_9_crc_code);
+	u32 exit_point_offset = sizeof(arm7_9_crc_code) - 8;
 	int i;
 	
-	if (target_alloc_working_area(target, sizeof(arm7_9_crc_code), &crc_algorithm) != ERROR_OK)
+	/* use the table driven loop if there's room for the 1K table, the bit-serial loop otherwise */
+	if (target_alloc_crc32_table(target, &crc_table) == ERROR_OK)
+	{
+		if (target_alloc_working_area(target, sizeof(arm7_9_crc_table_code), &crc_algorithm) == ERROR_OK)
+		{
+			crc_code = arm7_9_crc_table_code;
+			crc_code_size = sizeof(arm7_9_crc_table_code);
+			exit_point_offset = sizeof(arm7_9_crc_table_code) - 4;
+		}
+		else
+		{
+			target_free_working_area(target, crc_table);
+			crc_table = NULL;
+		}
+	}
+	
+	if (!crc_table && (target_alloc_working_area(target, crc_code_size, &crc_algorithm) != ERROR_OK))
 	{
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	}
 	
 	/* convert flash writing code into a buffer in target endianness */
-	for (i = 0; i < (sizeof(arm7_9_crc_code)/sizeof(u32)); i++)
-		target_write_u32(target, crc_algorithm->address + i*sizeof(u32), arm7_9_crc_code[i]);
+	for (i = 0; i < (crc_code_size/sizeof(u32)); i++)
+		target_write_u32(target, crc_algorithm->address + i*sizeof(u32), crc_code[i]);
 	
 	armv4_5_info.common_magic = ARMV4_5_COMMON_MAGIC;
 	armv4_5_info.core_mode = ARMV4_5_MODE_SVC;
@@ -2230,28 +2271,131 @@ int arm7_9_checksum_memory(struct target_s *target, u32 address, u32 count, u32*
 	
 	init_reg_param(&reg_params[0], "r0", 32, PARAM_IN_OUT);
 	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
 	
 	buf_set_u32(reg_params[0].value, 0, 32, address);
 	buf_set_u32(reg_params[1].value, 0, 32, count);
+	buf_set_u32(reg_params[2].value, 0, 32, crc_table ? crc_table->address : 0);
 		
-	if ((retval = target->type->run_algorithm(target, 0, NULL, 2, reg_params,
-		crc_algorithm->address, crc_algorithm->address + (sizeof(arm7_9_crc_code) - 8), 20000, &armv4_5_info)) != ERROR_OK)
+	if ((retval = target->type->run_algorithm(target, 0, NULL, 3, reg_params,
+		crc_algorithm->address, crc_algorithm->address + exit_point_offset, 20000, &armv4_5_info)) != ERROR_OK)
 	{
 		LOG_ERROR("error executing arm7_9 crc algorithm");
-		destroy_reg_param(&reg_params[0]);
-		destroy_reg_param(&reg_params[1]);
-		target_free_working_area(target, crc_algorithm);
-		return retval;
 	}
-	
-	*checksum = buf_get_u32(reg_params[0].value, 0, 32);
+	else
+	{
+		*checksum = buf_get_u32(reg_params[0].value, 0, 32);
+	}
 	
 	destroy_reg_param(&reg_params[0]);
 	destroy_reg_param(&reg_params[1]);
+	destroy_reg_param(&reg_params[2]);
 	
 	target_free_working_area(target, crc_algorithm);
+	if (crc_table)
+		target_free_working_area(target, crc_table);
 	
-	return ERROR_OK;
+	return retval;
+}
+
+/* checksum count bytes in blocks of block_size bytes with one algorithm run,
+ * the last block may be shorter. Needs room for the CRC32 lookup table. */
+int arm7_9_checksum_memory_blocks(struct target_s *target, u32 address, u32 count, u32 block_size, u32 *checksums)
+{
+	working_area_t *crc_algorithm;
+	working_area_t *crc_table;
+	working_area_t *crc_results;
+	armv4_5_algorithm_t armv4_5_info;
+	reg_param_t reg_params[5];
+	u32 num_blocks = (count + block_size - 1) / block_size;
+	u8 *results;
+	int retval;
+	int i;
+	
+	/* r2 points to the lookup table, r4 to the array of block checksums */
+	u32 arm7_9_crc_blocks_code[] = {
+		0xE0801001,				/* add		r1, r0, r1 */
+								/* block: */
+		0xE3E05000,				/* mvn		r5, #0 */
+		0xE0806003,				/* add		r6, r0, r3 */
+		0xE1560001,				/* cmp		r6, r1 */
+		0x81A06001,				/* movhi	r6, r1 */
+								/* nbyte: */
+		0xE4D07001,				/* ldrb	r7, [r0], #1 */
+		0xE0277C25,				/* eor		r7, r7, r5, lsr #24 */
+		0xE7927107,				/* ldr		r7, [r2, r7, lsl #2] */
+		0xE0275405,				/* eor		r5, r7, r5, lsl #8 */
+		0xE1500006,				/* cmp		r0, r6 */
+		0x1AFFFFF9,				/* bne		nbyte */
+		0xE4845004,				/* str		r5, [r4], #4 */
+		0xE1500001,				/* cmp		r0, r1 */
+		0x1AFFFFF2,				/* bne		block */
+								/* end: */
+		0xEAFFFFFE				/* b		end */
+	};
+	
+	if ((count == 0) || (block_size == 0))
+		return ERROR_INVALID_ARGUMENTS;
+	
+	if (target_alloc_crc32_table(target, &crc_table) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	
+	if (target_alloc_working_area(target, sizeof(arm7_9_crc_blocks_code), &crc_algorithm) != ERROR_OK)
+	{
+		target_free_working_area(target, crc_table);
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+	
+	if (target_alloc_working_area(target, num_blocks * sizeof(u32), &crc_results) != ERROR_OK)
+	{
+		target_free_working_area(target, crc_algorithm);
+		target_free_working_area(target, crc_table);
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+	
+	for (i = 0; i < (sizeof(arm7_9_crc_blocks_code)/sizeof(u32)); i++)
+		target_write_u32(target, crc_algorithm->address + i*sizeof(u32), arm7_9_crc_blocks_code[i]);
+	
+	armv4_5_info.common_magic = ARMV4_5_COMMON_MAGIC;
+	armv4_5_info.core_mode = ARMV4_5_MODE_SVC;
+	armv4_5_info.core_state = ARMV4_5_STATE_ARM;
+	
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);
+	init_reg_param(&reg_params[4], "r4", 32, PARAM_OUT);
+	
+	buf_set_u32(reg_params[0].value, 0, 32, address);
+	buf_set_u32(reg_params[1].value, 0, 32, count);
+	buf_set_u32(reg_params[2].value, 0, 32, crc_table->address);
+	buf_set_u32(reg_params[3].value, 0, 32, block_size);
+	buf_set_u32(reg_params[4].value, 0, 32, crc_results->address);
+	
+	if ((retval = target->type->run_algorithm(target, 0, NULL, 5, reg_params,
+		crc_algorithm->address, crc_algorithm->address + (sizeof(arm7_9_crc_blocks_code) - 4), 20000, &armv4_5_info)) != ERROR_OK)
+	{
+		LOG_ERROR("error executing arm7_9 crc algorithm");
+	}
+	else
+	{
+		results = malloc(num_blocks * sizeof(u32));
+		if ((retval = target_read_buffer(target, crc_results->address, num_blocks * sizeof(u32), results)) == ERROR_OK)
+		{
+			for (i = 0; i < num_blocks; i++)
+				checksums[i] = target_buffer_get_u32(target, &results[i * sizeof(u32)]);
+		}
+		free(results);
+	}
+	
+	for (i = 0; i < 5; i++)
+		destroy_reg_param(&reg_params[i]);
+	
+	target_free_working_area(target, crc_results);
+	target_free_working_area(target, crc_algorithm);
+	target_free_working_area(target, crc_table);
+	
+	return retval;
 }
 
 int arm7_9_register_commands(struct command_context_s *cmd_ctx)
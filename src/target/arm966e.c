@@ -70,6 +70,7 @@ target_type_t arm966e_target =
 	.write_memory = arm7_9_write_memory,
 	.bulk_write_memory = arm7_9_bulk_write_memory,
 	.checksum_memory = arm7_9_checksum_memory,
+	.checksum_memory_blocks = arm7_9_checksum_memory_blocks,
 	
 	.run_algorithm = armv4_5_run_algorithm,
 	
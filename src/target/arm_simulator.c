@@ -707,3 +707,80 @@ int arm_simulate_step(target_t *target, u32 *dry_run_pc)
 	}
 	
 }
+
+/* find the first instruction between the current pc and limit that might
+ * change the control flow (branches, writes to the pc, exceptions), so the
+ * straight-line code in between can run up to a breakpoint at *branch_pc
+ * instead of being single-stepped. *branch_pc is limit if there's none.
+ */
+int arm_simulate_next_branch(target_t *target, u32 limit, u32 *branch_pc)
+{
+	armv4_5_common_t *armv4_5 = target->arch_info;
+	u32 address = buf_get_u32(armv4_5->core_cache->reg_list[15].value, 0, 32);
+	arm_instruction_t instruction;
+	int retval;
+	
+	for (; address < limit; address += (armv4_5->core_state == ARMV4_5_STATE_ARM) ? 4 : 2)
+	{
+		if (armv4_5->core_state == ARMV4_5_STATE_ARM)
+		{
+			u32 opcode;
+			
+			if ((retval = target_read_u32(target, address, &opcode)) != ERROR_OK)
+				return retval;
+			arm_evaluate_opcode(opcode, address, &instruction);
+			
+			if ((instruction.type >= ARM_AND) && (instruction.type <= ARM_MVN)
+				&& ((instruction.type < ARM_TST) || (instruction.type > ARM_CMN)))
+			{
+				if (instruction.info.data_proc.Rd == 15)
+					break;
+				continue;
+			}
+			
+			if ((instruction.type >= ARM_LDR) && (instruction.type <= ARM_LDRSH))
+			{
+				if (instruction.info.load_store.Rd == 15)
+					break;
+				continue;
+			}
+			
+			if (instruction.type == ARM_LDM)
+			{
+				if (instruction.info.load_store_multiple.register_list & (1 << 15))
+					break;
+				continue;
+			}
+		}
+		else
+		{
+			u16 opcode;
+			
+			if ((retval = target_read_u16(target, address, &opcode)) != ERROR_OK)
+				return retval;
+			thumb_evaluate_opcode(opcode, address, &instruction);
+			
+			/* conditional and unconditional branches, BL/BLX halves, SWI */
+			if (((opcode & 0xf000) == 0xd000) || ((opcode & 0xe000) == 0xe000))
+				break;
+			
+			/* high register ADD/MOV with pc as destination, BX/BLX */
+			if (((opcode & 0xfc00) == 0x4400) && (((opcode & 0x87) == 0x87) || ((opcode & 0x0300) == 0x0300)))
+				break;
+			
+			/* POP {.., pc} */
+			if ((opcode & 0xff00) == 0xbd00)
+				break;
+		}
+		
+		/* everything not known to leave the pc alone */
+		if ((instruction.type == ARM_UNKNOWN_INSTUCTION) || (instruction.type == ARM_UNDEFINED_INSTRUCTION)
+			|| ((instruction.type >= ARM_B) && (instruction.type <= ARM_BLX))
+			|| (instruction.type == ARM_BKPT) || (instruction.type == ARM_SWI))
+			break;
+	}
+	
+	*branch_pc = (address < limit) ? address : limit;
+	
+	return ERROR_OK;
+}
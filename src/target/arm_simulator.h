@@ -24,6 +24,7 @@
 #include "types.h"
 
 extern int arm_simulate_step(target_t *target, u32 *dry_run_pc);
+extern int arm_simulate_next_branch(target_t *target, u32 limit, u32 *branch_pc);
 
 
 #define ERROR_ARM_SIMULATOR_NOT_IMPLEMENTED	(-700)
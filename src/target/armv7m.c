@@ -212,6 +212,61 @@ int armv7m_read_core_reg(struct target_s *target, int num)
 	return ERROR_OK;	
 }
 
+/* bring all invalid registers in [first, last) into the cache, in one
+ * batch if the core supports it */
+int armv7m_read_core_regs(struct target_s *target, int first, int last)
+{
+	armv7m_common_t *armv7m = target->arch_info;
+	enum armv7m_regtype types[ARMV7NUMCOREREGS];
+	u32 nums[ARMV7NUMCOREREGS];
+	u32 values[ARMV7NUMCOREREGS];
+	int regs[ARMV7NUMCOREREGS];
+	int count = 0;
+	int retval;
+	int i;
+
+	if ((first < 0) || (last > ARMV7NUMCOREREGS))
+		return ERROR_INVALID_ARGUMENTS;
+
+	for (i = first; i < last; i++)
+	{
+		armv7m_core_reg_t *armv7m_core_reg = armv7m->core_cache->reg_list[i].arch_info;
+
+		if (armv7m->core_cache->reg_list[i].valid)
+			continue;
+
+		regs[count] = i;
+		types[count] = armv7m_core_reg->type;
+		nums[count] = armv7m_core_reg->num;
+		count++;
+	}
+
+	if (count == 0)
+		return ERROR_OK;
+
+	if (!armv7m->load_core_regs_u32)
+	{
+		for (i = 0; i < count; i++)
+		{
+			if ((retval = armv7m->read_core_reg(target, regs[i])) != ERROR_OK)
+				return retval;
+		}
+		return ERROR_OK;
+	}
+
+	if ((retval = armv7m->load_core_regs_u32(target, types, nums, values, count)) != ERROR_OK)
+		return retval;
+
+	for (i = 0; i < count; i++)
+	{
+		buf_set_u32(armv7m->core_cache->reg_list[regs[i]].value, 0, 32, values[i]);
+		armv7m->core_cache->reg_list[regs[i]].valid = 1;
+		armv7m->core_cache->reg_list[regs[i]].dirty = 0;
+	}
+
+	return ERROR_OK;
+}
+
 int armv7m_write_core_reg(struct target_s *target, int num)
 {
 	int retval;
@@ -261,6 +316,10 @@ int armv7m_get_gdb_reg_list(target_t *target, reg_t **reg_list[], int *reg_list_
 	armv7m_common_t *armv7m = target->arch_info;
 	int i;
 	
+	/* gdb is about to read (some of) them, fetch all in one go */
+	if (target->state == TARGET_HALTED)
+		armv7m_read_core_regs(target, 0, ARMV7NUMCOREREGS);
+	
 	*reg_list_size = 26;
 	*reg_list = malloc(sizeof(reg_t*) * (*reg_list_size));
 	
@@ -509,6 +568,7 @@ int armv7m_init_arch_info(target_t *target, armv7m_common_t *armv7m)
 	target->arch_info = armv7m;
 	armv7m->read_core_reg = armv7m_read_core_reg;
 	armv7m->write_core_reg = armv7m_write_core_reg;
+	armv7m->load_core_regs_u32 = NULL;
 	
 	return ERROR_OK;
 }
@@ -521,8 +581,9 @@ int armv7m_register_commands(struct command_context_s *cmd_ctx)
 int armv7m_checksum_memory(struct target_s *target, u32 address, u32 count, u32* checksum)
 {
 	working_area_t *crc_algorithm;
+	working_area_t *crc_table = NULL;
 	armv7m_algorithm_t armv7m_info;
-	reg_param_t reg_params[2];
+	reg_param_t reg_params[3];
 	int retval;
 	
 	u16 cortex_m3_crc_code[] = {	    
@@ -555,45 +616,185 @@ int armv7m_checksum_memory(struct target_s *target, u32 address, u32 count, u32*
 		0xE7FE,					/* b	end */
 		0x1DB7, 0x04C1			/* CRC32XOR:	.word 0x04C11DB7 */
 	};
-
+	
+	/* r2 points to the lookup table uploaded by target_alloc_crc32_table() */
+	u16 cortex_m3_crc_table_code[] = {
+		0x4603,					/* mov	r3, r0 */
+		0xF04F, 0x30FF,			/* mov	r0, #0xffffffff */
+		0x4419,					/* add	r1, r3 */
+		0xE007,					/* b	ncomp */
+								/* nbyte: */
+		0xF813, 0x4B01,			/* ldrb	r4, [r3], #1 */
+		0xEA84, 0x6410,			/* eor	r4, r4, r0, lsr #24 */
+		0xF852, 0x4024,			/* ldr	r4, [r2, r4, lsl #2] */
+		0xEA84, 0x2000,			/* eor	r0, r4, r0, lsl #8 */
+								/* ncomp: */
+		0x428B,					/* cmp	r3, r1 */
+		0xD1F5,					/* bne	nbyte */
+								/* end: */
+		0xE7FE					/* b	end */
+	};
+	
+	u16 *crc_code = cortex_m3_crc_code;
+	int crc_code_size = sizeof(cortex_m3_crc_code);
+	u32 exit_point_offset = sizeof(cortex_m3_crc_code) - 6;
 	int i;
 	
-	if (target_alloc_working_area(target, sizeof(cortex_m3_crc_code), &crc_algorithm) != ERROR_OK)
+	/* use the table driven loop if there's room for the 1K table, the bit-serial loop otherwise */
+	if (target_alloc_crc32_table(target, &crc_table) == ERROR_OK)
+	{
+		if (target_alloc_working_area(target, sizeof(cortex_m3_crc_table_code), &crc_algorithm) == ERROR_OK)
+		{
+			crc_code = cortex_m3_crc_table_code;
+			crc_code_size = sizeof(cortex_m3_crc_table_code);
+			exit_point_offset = sizeof(cortex_m3_crc_table_code) - 2;
+		}
+		else
+		{
+			target_free_working_area(target, crc_table);
+			crc_table = NULL;
+		}
+	}
+	
+	if (!crc_table && (target_alloc_working_area(target, crc_code_size, &crc_algorithm) != ERROR_OK))
 	{
 		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
 	}
 	
 	/* convert flash writing code into a buffer in target endianness */
-	for (i = 0; i < (sizeof(cortex_m3_crc_code)/sizeof(u16)); i++)
-		target_write_u16(target, crc_algorithm->address + i*sizeof(u16), cortex_m3_crc_code[i]);
+	for (i = 0; i < (crc_code_size/sizeof(u16)); i++)
+		target_write_u16(target, crc_algorithm->address + i*sizeof(u16), crc_code[i]);
 	
 	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
 	armv7m_info.core_mode = ARMV7M_MODE_ANY;
 	
 	init_reg_param(&reg_params[0], "r0", 32, PARAM_IN_OUT);
 	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
 	
 	buf_set_u32(reg_params[0].value, 0, 32, address);
 	buf_set_u32(reg_params[1].value, 0, 32, count);
+	buf_set_u32(reg_params[2].value, 0, 32, crc_table ? crc_table->address : 0);
 		
-	if ((retval = target->type->run_algorithm(target, 0, NULL, 2, reg_params,
-		crc_algorithm->address, crc_algorithm->address + (sizeof(cortex_m3_crc_code)-6), 20000, &armv7m_info)) != ERROR_OK)
+	if ((retval = target->type->run_algorithm(target, 0, NULL, 3, reg_params,
+		crc_algorithm->address, crc_algorithm->address + exit_point_offset, 20000, &armv7m_info)) != ERROR_OK)
 	{
 		LOG_ERROR("error executing cortex_m3 crc algorithm");
-		destroy_reg_param(&reg_params[0]);
-		destroy_reg_param(&reg_params[1]);
-		target_free_working_area(target, crc_algorithm);
-		return retval;
 	}
-	
-	*checksum = buf_get_u32(reg_params[0].value, 0, 32);
+	else
+	{
+		*checksum = buf_get_u32(reg_params[0].value, 0, 32);
+	}
 	
 	destroy_reg_param(&reg_params[0]);
 	destroy_reg_param(&reg_params[1]);
+	destroy_reg_param(&reg_params[2]);
 	
 	target_free_working_area(target, crc_algorithm);
+	if (crc_table)
+		target_free_working_area(target, crc_table);
 	
-	return ERROR_OK;
+	return retval;
+}
+
+/* checksum count bytes in blocks of block_size bytes with one algorithm run,
+ * the last block may be shorter. Needs room for the CRC32 lookup table. */
+int armv7m_checksum_memory_blocks(struct target_s *target, u32 address, u32 count, u32 block_size, u32 *checksums)
+{
+	working_area_t *crc_algorithm;
+	working_area_t *crc_table;
+	working_area_t *crc_results;
+	armv7m_algorithm_t armv7m_info;
+	reg_param_t reg_params[5];
+	u32 num_blocks = (count + block_size - 1) / block_size;
+	u8 *results;
+	int retval;
+	int i;
+	
+	/* r2 points to the lookup table, r4 to the array of block checksums */
+	u16 cortex_m3_crc_blocks_code[] = {
+		0x4401,					/* add	r1, r0 */
+								/* block: */
+		0xF04F, 0x35FF,			/* mov	r5, #0xffffffff */
+		0x18C6,					/* adds	r6, r0, r3 */
+		0x428E,					/* cmp	r6, r1 */
+		0xBF88,					/* it	hi */
+		0x460E,					/* movhi	r6, r1 */
+								/* nbyte: */
+		0xF810, 0x7B01,			/* ldrb	r7, [r0], #1 */
+		0xEA87, 0x6715,			/* eor	r7, r7, r5, lsr #24 */
+		0xF852, 0x7027,			/* ldr	r7, [r2, r7, lsl #2] */
+		0xEA87, 0x2505,			/* eor	r5, r7, r5, lsl #8 */
+		0x42B0,					/* cmp	r0, r6 */
+		0xD1F5,					/* bne	nbyte */
+		0xF844, 0x5B04,			/* str	r5, [r4], #4 */
+		0x4288,					/* cmp	r0, r1 */
+		0xD1EB,					/* bne	block */
+								/* end: */
+		0xE7FE					/* b	end */
+	};
+	
+	if ((count == 0) || (block_size == 0))
+		return ERROR_INVALID_ARGUMENTS;
+	
+	if (target_alloc_crc32_table(target, &crc_table) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	
+	if (target_alloc_working_area(target, sizeof(cortex_m3_crc_blocks_code), &crc_algorithm) != ERROR_OK)
+	{
+		target_free_working_area(target, crc_table);
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+	
+	if (target_alloc_working_area(target, num_blocks * sizeof(u32), &crc_results) != ERROR_OK)
+	{
+		target_free_working_area(target, crc_algorithm);
+		target_free_working_area(target, crc_table);
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+	
+	for (i = 0; i < (sizeof(cortex_m3_crc_blocks_code)/sizeof(u16)); i++)
+		target_write_u16(target, crc_algorithm->address + i*sizeof(u16), cortex_m3_crc_blocks_code[i]);
+	
+	armv7m_info.common_magic = ARMV7M_COMMON_MAGIC;
+	armv7m_info.core_mode = ARMV7M_MODE_ANY;
+	
+	init_reg_param(&reg_params[0], "r0", 32, PARAM_OUT);
+	init_reg_param(&reg_params[1], "r1", 32, PARAM_OUT);
+	init_reg_param(&reg_params[2], "r2", 32, PARAM_OUT);
+	init_reg_param(&reg_params[3], "r3", 32, PARAM_OUT);
+	init_reg_param(&reg_params[4], "r4", 32, PARAM_OUT);
+	
+	buf_set_u32(reg_params[0].value, 0, 32, address);
+	buf_set_u32(reg_params[1].value, 0, 32, count);
+	buf_set_u32(reg_params[2].value, 0, 32, crc_table->address);
+	buf_set_u32(reg_params[3].value, 0, 32, block_size);
+	buf_set_u32(reg_params[4].value, 0, 32, crc_results->address);
+	
+	if ((retval = target->type->run_algorithm(target, 0, NULL, 5, reg_params,
+		crc_algorithm->address, crc_algorithm->address + (sizeof(cortex_m3_crc_blocks_code) - 2), 20000, &armv7m_info)) != ERROR_OK)
+	{
+		LOG_ERROR("error executing cortex_m3 crc algorithm");
+	}
+	else
+	{
+		results = malloc(num_blocks * sizeof(u32));
+		if ((retval = target_read_buffer(target, crc_results->address, num_blocks * sizeof(u32), results)) == ERROR_OK)
+		{
+			for (i = 0; i < num_blocks; i++)
+				checksums[i] = target_buffer_get_u32(target, &results[i * sizeof(u32)]);
+		}
+		free(results);
+	}
+	
+	for (i = 0; i < 5; i++)
+		destroy_reg_param(&reg_params[i]);
+	
+	target_free_working_area(target, crc_results);
+	target_free_working_area(target, crc_algorithm);
+	target_free_working_area(target, crc_table);
+	
+	return retval;
 }
 
 
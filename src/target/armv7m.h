@@ -79,6 +79,8 @@ typedef struct armv7m_common_s
 	/* Direct processor core register read and writes */
 	int (*load_core_reg_u32)(struct target_s *target, enum armv7m_regtype type, u32 num, u32 *value);
 	int (*store_core_reg_u32)(struct target_s *target, enum armv7m_regtype type, u32 num, u32 value);
+	/* optional, reads several registers with a single JTAG flush */
+	int (*load_core_regs_u32)(struct target_s *target, enum armv7m_regtype *types, u32 *nums, u32 *values, int count);
 	/* register cache to processor synchronization */
 	int (*read_core_reg)(struct target_s *target, int num);
 	int (*write_core_reg)(struct target_s *target, int num);
@@ -125,10 +127,12 @@ extern int armv7m_init_arch_info(target_t *target, armv7m_common_t *armv7m);
 extern int armv7m_run_algorithm(struct target_s *target, int num_mem_params, mem_param_t *mem_params, int num_reg_params, reg_param_t *reg_params, u32 entry_point, u32 exit_point, int timeout_ms, void *arch_info);
 
 extern int armv7m_invalidate_core_regs(target_t *target);
+extern int armv7m_read_core_regs(struct target_s *target, int first, int last);
 
 extern int armv7m_restore_context(target_t *target);
 
 extern int armv7m_checksum_memory(struct target_s *target, u32 address, u32 count, u32* checksum);
+extern int armv7m_checksum_memory_blocks(struct target_s *target, u32 address, u32 count, u32 block_size, u32 *checksums);
 
 /* Thumb mode instructions
  */
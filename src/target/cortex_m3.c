@@ -49,6 +49,7 @@ int cortex_m3_target_command(struct command_context_s *cmd_ctx, char *cmd, char
 int cortex_m3_init_target(struct command_context_s *cmd_ctx, struct target_s *target);
 int cortex_m3_quit();
 int cortex_m3_load_core_reg_u32(target_t *target, enum armv7m_regtype type, u32 num, u32 *value);
+int cortex_m3_load_core_regs_u32(target_t *target, enum armv7m_regtype *types, u32 *nums, u32 *values, int count);
 int cortex_m3_store_core_reg_u32(target_t *target, enum armv7m_regtype type, u32 num, u32 value);
 int cortex_m3_target_request_data(target_t *target, u32 size, u8 *buffer);
 int cortex_m3_examine(struct command_context_s *cmd_ctx, struct target_s *target);
@@ -81,6 +82,7 @@ target_type_t cortexm3_target =
 	.write_memory = cortex_m3_write_memory,
 	.bulk_write_memory = cortex_m3_bulk_write_memory,
 	.checksum_memory = armv7m_checksum_memory,
+	.checksum_memory_blocks = armv7m_checksum_memory_blocks,
 	
 	.run_algorithm = armv7m_run_algorithm,
 	
@@ -290,7 +292,6 @@ int cortex_m3_examine_exception_reason(target_t *target)
 
 int cortex_m3_debug_entry(target_t *target)
 {
-	int i;
 	u32 xPSR;
 	int retval;
 
@@ -311,11 +312,7 @@ int cortex_m3_debug_entry(target_t *target)
 
 	/* Examine target state and mode */
 	/* First load register acessible through core debug port*/
-	for (i = 0; i < ARMV7M_PRIMASK; i++)
-	{
-		if (!armv7m->core_cache->reg_list[i].valid)
-			armv7m->read_core_reg(target, i);
-	}
+	armv7m_read_core_regs(target, 0, ARMV7M_PRIMASK);
 
 	xPSR = buf_get_u32(armv7m->core_cache->reg_list[ARMV7M_xPSR].value, 0, 32);
 
@@ -335,11 +332,7 @@ int cortex_m3_debug_entry(target_t *target)
 	}
 
 	/* Now we can load SP core registers */
-	for (i = ARMV7M_PRIMASK; i < ARMV7NUMCOREREGS; i++)
-	{
-		if (!armv7m->core_cache->reg_list[i].valid)
-			armv7m->read_core_reg(target, i);
-	}
+	armv7m_read_core_regs(target, ARMV7M_PRIMASK, ARMV7NUMCOREREGS);
 
 	/* Are we in an exception handler */
 	if (xPSR & 0x1FF)
@@ -1157,6 +1150,70 @@ int cortex_m3_load_core_reg_u32(struct target_s *target, enum armv7m_regtype typ
 	return ERROR_OK;
 }
 
+/* like cortex_m3_load_core_reg_u32, but with one JTAG flush for all registers */
+int cortex_m3_load_core_regs_u32(struct target_s *target, enum armv7m_regtype *types, u32 *nums, u32 *values, int count)
+{
+	int retval;
+	/* get pointers to arch-specific information */
+	armv7m_common_t *armv7m = target->arch_info;
+	cortex_m3_common_t *cortex_m3 = armv7m->arch_info;
+	swjdp_common_t *swjdp = &cortex_m3->swjdp_info;
+	int regsel[ARMV7NUMCOREREGS];
+	u32 regval[ARMV7NUMCOREREGS];
+	int special = -1;
+	int num_regsel = 0;
+	int i;
+	
+	if (count > ARMV7NUMCOREREGS)
+		return ERROR_INVALID_ARGUMENTS;
+	
+	/* primask, basepri, faultmask and control share special register 20 */
+	for (i = 0; i < count; i++)
+	{
+		if ((types[i] == ARMV7M_REGISTER_CORE_GP) && (nums[i] <= ARMV7M_PSP))
+		{
+			regsel[num_regsel++] = nums[i];
+		}
+		else if (types[i] == ARMV7M_REGISTER_CORE_SP)
+		{
+			if (special == -1)
+			{
+				special = num_regsel;
+				regsel[num_regsel++] = 20;
+			}
+		}
+		else
+		{
+			return ERROR_INVALID_ARGUMENTS;
+		}
+	}
+	
+	retval = ahbap_read_coreregisters_u32(swjdp, regval, regsel, num_regsel);
+	if (retval != ERROR_OK)
+	{
+		LOG_ERROR("JTAG failure %i",retval);
+		return ERROR_JTAG_DEVICE_ERROR;
+	}
+	
+	for (i = 0, num_regsel = 0; i < count; i++)
+	{
+		if (types[i] == ARMV7M_REGISTER_CORE_GP)
+		{
+			if (num_regsel == special)
+				num_regsel++;
+			values[i] = regval[num_regsel++];
+			LOG_DEBUG("load from core reg %i  value 0x%x", nums[i], values[i]);
+		}
+		else
+		{
+			values[i] = (regval[special] >> ((nums[i] - 19) * 8)) & 0xff;
+			LOG_DEBUG("load from special reg %i value 0x%x", nums[i], values[i]);
+		}
+	}
+	
+	return ERROR_OK;
+}
+
 int cortex_m3_store_core_reg_u32(struct target_s *target, enum armv7m_regtype type, u32 num, u32 value)
 {
 	int retval;
@@ -1274,7 +1331,11 @@ int cortex_m3_write_memory(struct target_s *target, u32 address, u32 size, u32 c
 	switch (size)
 	{
 		case 4:
-			retval = ahbap_write_buf_u32(swjdp, buffer, 4 * count, address);
+			/* unaligned words are better served by packed byte transfers */
+			if ((address & 0x3) && swjdp->packed_transfers)
+				retval = ahbap_write_buf_u8(swjdp, buffer, 4 * count, address);
+			else
+				retval = ahbap_write_buf_u32(swjdp, buffer, 4 * count, address);
 			break;
 		case 2:
 			retval = ahbap_write_buf_u16(swjdp, buffer, 2 * count, address);
@@ -1415,6 +1476,7 @@ int cortex_m3_target_request_data(target_t *target, u32 size, u8 *buffer)
 int cortex_m3_handle_target_request(void *priv)
 {
 	target_t *target = priv;
+	target_reschedule_timer_callback(cortex_m3_handle_target_request, target, target_request_poll_interval(target));
 	if (!target->type->examined)
 		return ERROR_OK;
 	armv7m_common_t *armv7m = target->arch_info;
@@ -1463,6 +1525,8 @@ int cortex_m3_init_arch_info(target_t *target, cortex_m3_common_t *cortex_m3, in
 	cortex_m3->swjdp_info.dp_select_value = -1;
 	cortex_m3->swjdp_info.ap_csw_value = -1;
 	cortex_m3->swjdp_info.ap_tar_value = -1;
+	cortex_m3->swjdp_info.tar_autoincr_block = TAR_AUTOINCR_BLOCK_MIN;
+	cortex_m3->swjdp_info.packed_transfers = 0;
 	cortex_m3->swjdp_info.jtag_info = &cortex_m3->jtag_info;
 
 	/* initialize arch-specific breakpoint handling */
@@ -1491,6 +1555,7 @@ int cortex_m3_init_arch_info(target_t *target, cortex_m3_common_t *cortex_m3, in
 	armv7m_init_arch_info(target, armv7m);	
 	armv7m->arch_info = cortex_m3;
 	armv7m->load_core_reg_u32 = cortex_m3_load_core_reg_u32;
+	armv7m->load_core_regs_u32 = cortex_m3_load_core_regs_u32;
 	armv7m->store_core_reg_u32 = cortex_m3_store_core_reg_u32;
 	
 	target_register_timer_callback(cortex_m3_handle_target_request, 1, 1, target);
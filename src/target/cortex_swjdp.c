@@ -423,12 +423,12 @@ int ahbap_write_buf_u32(swjdp_common_t *swjdp, u8 *buffer, int count, u32 addres
 	
 	while (wcount > 0)
 	{
-		/* Adjust to write blocks within 4K aligned boundaries */
-		blocksize = (0x1000 - (0xFFF & address)) >> 2;
+		/* Adjust to write blocks within the TAR autoincrement block */
+		blocksize = (swjdp->tar_autoincr_block - ((swjdp->tar_autoincr_block - 1) & address)) >> 2;
 		if (wcount < blocksize)
 			blocksize = wcount;
 		
-		/* handle unaligned data at 4k boundary */
+		/* handle unaligned data at block boundary */
 		if (blocksize == 0)
 			blocksize = 1;
 			
@@ -460,190 +460,90 @@ int ahbap_write_buf_u32(swjdp_common_t *swjdp, u8 *buffer, int count, u32 addres
 	return retval;
 }
 
-int ahbap_write_buf_packed_u16(swjdp_common_t *swjdp, u8 *buffer, int count, u32 address)
+/*****************************************************************************
+*                                                                            *
+* ahbap_write_buf_subword(swjdp_common_t *swjdp, u8 *buffer, int count,      *
+*                         u32 address, u32 csw_size, int access_size)        *
+*                                                                            *
+* Write bytes or halfwords from a buffer in target order. When the AP        *
+* supports it each DRW write carries a full word of packed transfers, the    *
+* rest use single transfers. Every TAR block is checked only once.           *
+*                                                                            *
+*****************************************************************************/
+int ahbap_write_buf_subword(swjdp_common_t *swjdp, u8 *buffer, int count, u32 address, u32 csw_size, int access_size)
 {
 	u32 outvalue;
-	int retval = ERROR_OK;
-	int wcount, blocksize, writecount, i;
+	int blocksize, packedcount, writecount, i, errorcount = 0;
 	
 	swjdp->trans_mode = TRANS_MODE_COMPOSITE;
-		
-	wcount = count >> 1;
 	
-	while (wcount > 0)
+	while (count > 0)
 	{
-		int nbytes;
-		
-		/* Adjust to read within 4K block boundaries */
-		blocksize = (0x1000 - (0xFFF & address)) >> 1;
-		
-		if (wcount < blocksize)
-			blocksize = wcount;
-		
-		/* handle unaligned data at 4k boundary */
-		if (blocksize == 0)
-			blocksize = 1;
+		/* Adjust to write within the TAR autoincrement block */
+		blocksize = swjdp->tar_autoincr_block - ((swjdp->tar_autoincr_block - 1) & address);
+		if (count < blocksize)
+			blocksize = count;
 		
-		ahbap_setup_accessport(swjdp, CSW_16BIT | CSW_ADDRINC_PACKED, address);
-		writecount = blocksize;
+		packedcount = 0;
+		if (swjdp->packed_transfers)
+			packedcount = blocksize & ~0x3;
 		
-		do
+		if (packedcount > 0)
 		{
-			nbytes = MIN((writecount << 1), 4);
+			ahbap_setup_accessport(swjdp, csw_size | CSW_ADDRINC_PACKED, address);
 			
-			if (nbytes < 4 )
-			{
-				if (ahbap_write_buf_u16(swjdp, buffer, nbytes, address) != ERROR_OK)
-				{
-					LOG_WARNING("Block read error address 0x%x, count 0x%x", address, count);
-					return ERROR_JTAG_DEVICE_ERROR;
-				}
-				
-				address += nbytes >> 1;
-			}
-			else
+			for (writecount = 0; writecount < packedcount; writecount += 4)
 			{
-				outvalue = *((u32*)buffer);
-				
-				for (i = 0; i < nbytes; i++ )
-				{
-					*((u8*)buffer + (address & 0x3)) = outvalue;
-					outvalue >>= 8;
-					address++;
-				}
-				
-				outvalue = *((u32*)buffer);
+				/* every byte goes on the lane selected by its own address */
+				outvalue = 0;
+				for (i = 0; i < 4; i++)
+					outvalue |= (u32)buffer[writecount + i] << 8 * ((address + writecount + i) & 0x3);
 				ahbap_write_reg_u32(swjdp, AHBAP_DRW, outvalue);
-				if (swjdp_transaction_endcheck(swjdp) != ERROR_OK)
-				{
-					LOG_WARNING("Block read error address 0x%x, count 0x%x", address, count);
-					return ERROR_JTAG_DEVICE_ERROR;
-				}
 			}
-			
-			buffer += nbytes >> 1;
-			writecount -= nbytes >> 1;
-			
-		} while (writecount);
-		wcount -= blocksize;
-	}
-	
-	return retval;
-}
-
-int ahbap_write_buf_u16(swjdp_common_t *swjdp, u8 *buffer, int count, u32 address)
-{
-	u32 outvalue;
-	int retval = ERROR_OK;
-	
-	if (count >= 4)
-		return ahbap_write_buf_packed_u16(swjdp, buffer, count, address);
-		
-	swjdp->trans_mode = TRANS_MODE_COMPOSITE;
-	
-	while (count > 0)
-	{
-		ahbap_setup_accessport(swjdp, CSW_16BIT | CSW_ADDRINC_SINGLE, address);
-		outvalue = *((u16*)buffer) << 8 * (address & 0x3);
-		ahbap_write_reg_u32(swjdp, AHBAP_DRW, outvalue );
-		retval = swjdp_transaction_endcheck(swjdp);
-		count -= 2;
-		address += 2;
-		buffer += 2;
-	}
-
-	return retval;
-}
-
-int ahbap_write_buf_packed_u8(swjdp_common_t *swjdp, u8 *buffer, int count, u32 address)
-{
-	u32 outvalue;
-	int retval = ERROR_OK;
-	int wcount, blocksize, writecount, i;
-	
-	swjdp->trans_mode = TRANS_MODE_COMPOSITE;
-	
-	wcount = count;
-	
-	while (wcount > 0)
-	{
-		int nbytes;
-		
-		/* Adjust to read within 4K block boundaries */
-		blocksize = (0x1000 - (0xFFF & address));
-		
-		if (wcount < blocksize)
-			blocksize = wcount;
-				
-		ahbap_setup_accessport(swjdp, CSW_8BIT | CSW_ADDRINC_PACKED, address);
-		writecount = blocksize;
+		}
 		
-		do
+		if (packedcount < blocksize)
 		{
-			nbytes = MIN(writecount, 4);
+			ahbap_setup_accessport(swjdp, csw_size | CSW_ADDRINC_SINGLE, address + packedcount);
 			
-			if (nbytes < 4 )
-			{
-				if (ahbap_write_buf_u8(swjdp, buffer, nbytes, address) != ERROR_OK)
-				{
-					LOG_WARNING("Block read error address 0x%x, count 0x%x", address, count);
-					return ERROR_JTAG_DEVICE_ERROR;
-				}
-				
-				address += nbytes;
-			}
-			else
+			for (writecount = packedcount; writecount < blocksize; writecount += access_size)
 			{
-				outvalue = *((u32*)buffer);
-				
-				for (i = 0; i < nbytes; i++ )
-				{
-					*((u8*)buffer + (address & 0x3)) = outvalue;
-					outvalue >>= 8;
-					address++;
-				}
-				
-				outvalue = *((u32*)buffer);
+				outvalue = 0;
+				for (i = 0; i < access_size; i++)
+					outvalue |= (u32)buffer[writecount + i] << 8 * ((address + writecount + i) & 0x3);
 				ahbap_write_reg_u32(swjdp, AHBAP_DRW, outvalue);
-				if (swjdp_transaction_endcheck(swjdp) != ERROR_OK)
-				{
-					LOG_WARNING("Block read error address 0x%x, count 0x%x", address, count);
-					return ERROR_JTAG_DEVICE_ERROR;
-				}
 			}
-			
-			buffer += nbytes;
-			writecount -= nbytes;
-			
-		} while (writecount);
-		wcount -= blocksize;
+		}
+		
+		if (swjdp_transaction_endcheck(swjdp) == ERROR_OK)
+		{
+			count -= blocksize;
+			address += blocksize;
+			buffer += blocksize;
+		}
+		else
+		{
+			errorcount++;
+		}
+		
+		if (errorcount > 1)
+		{
+			LOG_WARNING("Block write error address 0x%x, count 0x%x", address, count);
+			return ERROR_JTAG_DEVICE_ERROR;
+		}
 	}
 	
-	return retval;
+	return ERROR_OK;
+}
+
+int ahbap_write_buf_u16(swjdp_common_t *swjdp, u8 *buffer, int count, u32 address)
+{
+	return ahbap_write_buf_subword(swjdp, buffer, count, address, CSW_16BIT, 2);
 }
 
 int ahbap_write_buf_u8(swjdp_common_t *swjdp, u8 *buffer, int count, u32 address)
 {
-	u32 outvalue;
-	int retval = ERROR_OK;
-	
-	if (count >= 4)
-		return ahbap_write_buf_packed_u8(swjdp, buffer, count, address);
-		
-	swjdp->trans_mode = TRANS_MODE_COMPOSITE;
-	
-	while (count > 0)
-	{
-		ahbap_setup_accessport(swjdp, CSW_8BIT | CSW_ADDRINC_SINGLE, address);
-		outvalue = *((u8*)buffer) << 8 * (address & 0x3);
-		ahbap_write_reg_u32(swjdp, AHBAP_DRW, outvalue );
-		retval = swjdp_transaction_endcheck(swjdp);
-		count--;
-		address++;
-		buffer++;
-	}
-	
-	return retval;
+	return ahbap_write_buf_subword(swjdp, buffer, count, address, CSW_8BIT, 1);
 }
 
 /*********************************************************************************
@@ -666,12 +566,12 @@ int ahbap_read_buf_u32(swjdp_common_t *swjdp, u8 *buffer, int count, u32 address
 	
 	while (wcount > 0)
 	{
-		/* Adjust to read within 4K block boundaries */
-		blocksize = (0x1000 - (0xFFF & address)) >> 2;
+		/* Adjust to read within the TAR autoincrement block */
+		blocksize = (swjdp->tar_autoincr_block - ((swjdp->tar_autoincr_block - 1) & address)) >> 2;
 		if (wcount < blocksize)
 			blocksize = wcount;
 		
-		/* handle unaligned data at 4k boundary */
+		/* handle unaligned data at block boundary */
 		if (blocksize == 0)
 			blocksize = 1;
 		
@@ -739,14 +639,14 @@ int ahbap_read_buf_packed_u16(swjdp_common_t *swjdp, u8 *buffer, int count, u32
 	{
 		int nbytes;
 		
-		/* Adjust to read within 4K block boundaries */
-		blocksize = (0x1000 - (0xFFF & address)) >> 1;
+		/* Adjust to read within the TAR autoincrement block */
+		blocksize = (swjdp->tar_autoincr_block - ((swjdp->tar_autoincr_block - 1) & address)) >> 1;
 		if (wcount < blocksize)
 			blocksize = wcount;
 				
 		ahbap_setup_accessport(swjdp, CSW_16BIT | CSW_ADDRINC_PACKED, address);
 		
-		/* handle unaligned data at 4k boundary */
+		/* handle unaligned data at block boundary */
 		if (blocksize == 0)
 			blocksize = 1;
 		readcount = blocksize;
@@ -782,7 +682,7 @@ int ahbap_read_buf_u16(swjdp_common_t *swjdp, u8 *buffer, int count, u32 address
 	u32 invalue, i;
 	int retval = ERROR_OK;
 	
-	if (count >= 4)
+	if ((count >= 4) && swjdp->packed_transfers)
 		return ahbap_read_buf_packed_u16(swjdp, buffer, count, address);
 	
 	swjdp->trans_mode = TRANS_MODE_COMPOSITE;
@@ -827,8 +727,8 @@ int ahbap_read_buf_packed_u8(swjdp_common_t *swjdp, u8 *buffer, int count, u32 a
 	{
 		int nbytes;
 		
-		/* Adjust to read within 4K block boundaries */
-		blocksize = (0x1000 - (0xFFF & address));
+		/* Adjust to read within the TAR autoincrement block */
+		blocksize = swjdp->tar_autoincr_block - ((swjdp->tar_autoincr_block - 1) & address);
 		
 		if (wcount < blocksize)
 			blocksize = wcount;
@@ -867,7 +767,7 @@ int ahbap_read_buf_u8(swjdp_common_t *swjdp, u8 *buffer, int count, u32 address)
 	u32 invalue;
 	int retval = ERROR_OK;
 	
-	if (count >= 4)
+	if ((count >= 4) && swjdp->packed_transfers)
 		return ahbap_read_buf_packed_u8(swjdp, buffer, count, address);
 	
 	swjdp->trans_mode = TRANS_MODE_COMPOSITE;
@@ -911,6 +811,32 @@ int ahbap_read_coreregister_u32(swjdp_common_t *swjdp, u32 *value, int regnum)
 	return retval;
 }
 
+/* read several core registers with a single transaction check, the
+ * DCRSR/DCRDR accesses for all of them are queued back to back */
+int ahbap_read_coreregisters_u32(swjdp_common_t *swjdp, u32 *values, int *regnums, int count)
+{
+	int retval;
+	u32 dcrdr;
+	int i;
+	
+	/* DCB_DCRDR is saved/restored as for a single register read */
+	ahbap_read_system_u32(swjdp, DCB_DCRDR, &dcrdr);
+	
+	for (i = 0; i < count; i++)
+	{
+		ahbap_setup_accessport(swjdp, CSW_32BIT | CSW_ADDRINC_OFF, DCB_DCRSR & 0xFFFFFFF0);
+		ahbap_write_reg_u32(swjdp, AHBAP_BD0 | (DCB_DCRSR & 0xC), regnums[i] );
+		
+		ahbap_setup_accessport(swjdp, CSW_32BIT | CSW_ADDRINC_OFF, DCB_DCRDR & 0xFFFFFFF0);
+		ahbap_read_reg_u32(swjdp, AHBAP_BD0 | (DCB_DCRDR & 0xC), &values[i] );
+	}
+	
+	if ((retval = swjdp_transaction_endcheck(swjdp)) != ERROR_OK)
+		return retval;
+	
+	return ahbap_write_system_atomic_u32(swjdp, DCB_DCRDR, dcrdr);
+}
+
 int ahbap_write_coreregister_u32(swjdp_common_t *swjdp, u32 value, int regnum)
 {
 	int retval;
@@ -936,6 +862,33 @@ int ahbap_write_coreregister_u32(swjdp_common_t *swjdp, u32 value, int regnum)
 	return retval;
 }
 
+int ahbap_probe_accessport(swjdp_common_t *swjdp, u32 idreg)
+{
+	u32 csw;
+	int retval;
+	
+	swjdp->ap_idr = idreg;
+	
+	/* Packed transfers are optional, without them the AddrInc field does not read back as packed */
+	ahbap_write_reg_u32(swjdp, AHBAP_CSW, CSW_8BIT | CSW_ADDRINC_PACKED | CSW_DBGSWENABLE | CSW_MASTER_DEBUG | CSW_HPROT);
+	ahbap_read_reg_u32(swjdp, AHBAP_CSW, &csw);
+	if ((retval = jtag_execute_queue()) != ERROR_OK)
+		return retval;
+	swjdp->ap_csw_value = -1;
+	
+	swjdp->packed_transfers = ((csw & CSW_ADDRINC_MASK) == CSW_ADDRINC_PACKED);
+	
+	if ((idreg & IDR_ARM_AHBAP_MASK) == IDR_ARM_AHBAP)
+		swjdp->tar_autoincr_block = TAR_AUTOINCR_BLOCK_ARM;
+	else
+		swjdp->tar_autoincr_block = TAR_AUTOINCR_BLOCK_MIN;
+	
+	LOG_DEBUG("AHB-AP packed transfers %s, TAR autoincrement block 0x%x",
+		swjdp->packed_transfers ? "supported" : "not supported", swjdp->tar_autoincr_block);
+	
+	return ERROR_OK;
+}
+
 int ahbap_debugport_init(swjdp_common_t *swjdp)
 {
 	u32 idreg, romaddr, dummy;
@@ -984,10 +937,10 @@ int ahbap_debugport_init(swjdp_common_t *swjdp)
 	swjdp_write_dpacc(swjdp, swjdp->dp_ctrl_stat, DP_CTRL_STAT);
 	swjdp_read_dpacc(swjdp, &dummy, DP_CTRL_STAT);
 	
-	ahbap_read_reg_u32(swjdp, 0xFC, &idreg);
-	ahbap_read_reg_u32(swjdp, 0xF8, &romaddr);
+	ahbap_read_reg_u32(swjdp, AHBAP_IDR, &idreg);
+	ahbap_read_reg_u32(swjdp, AHBAP_DBGROMA, &romaddr);
 	
 	LOG_DEBUG("AHB-AP ID Register 0x%x, Debug ROM Address 0x%x", idreg, romaddr);
 	
-	return ERROR_OK;
+	return ahbap_probe_accessport(swjdp, idreg);
 }
@@ -66,6 +66,14 @@
 #define CSW_MASTER_DEBUG	(1<<29)
 #define CSW_DBGSWENABLE		(1<<31)
 
+/* ARM designed AHB-AP, JEP106 code 0x23B, MEM-AP class, AHB type */
+#define IDR_ARM_AHBAP_MASK	0x0FFE000F
+#define IDR_ARM_AHBAP		0x04760001
+
+/* TAR autoincrement is only guaranteed inside 1K, the ARM AHB-AP wraps at 4K */
+#define TAR_AUTOINCR_BLOCK_MIN	(1<<10)
+#define TAR_AUTOINCR_BLOCK_ARM	(1<<12)
+
 /* transaction mode */
 #define TRANS_MODE_NONE			0
 /* Transaction waits for previous to complete */
@@ -88,6 +96,10 @@ typedef struct swjdp_common_s
 	u32 dp_select_value;
 	u32 ap_csw_value;
 	u32 ap_tar_value;
+	/* AP capabilities, probed in ahbap_debugport_init() */
+	u32 ap_idr;
+	u32 tar_autoincr_block;
+	u8  packed_transfers;
 	/* information about current pending SWjDP-AHBAP transaction */
 	u8  trans_mode;
 	u8  trans_rw;
@@ -114,6 +126,7 @@ extern int ahbap_write_system_atomic_u32(swjdp_common_t *swjdp, u32 address, u32
 
 /* Host endian word transfers of processor core registers */
 extern int ahbap_read_coreregister_u32(swjdp_common_t *swjdp, u32 *value, int regnum);
+extern int ahbap_read_coreregisters_u32(swjdp_common_t *swjdp, u32 *values, int *regnums, int count);
 extern int ahbap_write_coreregister_u32(swjdp_common_t *swjdp, u32 value, int regnum);
 
 extern int ahbap_read_buf_u8(swjdp_common_t *swjdp, u8 *buffer, int count, u32 address);
@@ -33,6 +33,7 @@
 #include "target.h"
 #include "register.h"
 #include "jtag.h"
+#include "time_support.h"
 
 #include <stdlib.h>
 
@@ -482,8 +483,7 @@ int embeddedice_handshake(arm_jtag_t *jtag_info, int hsbit, u32 timeout)
 	u8 field2_out[1];
 	int retval;
 	int hsact;
-	struct timeval lap;
-	struct timeval now;
+	deadline_t deadline;
 
 	if (hsbit == EICE_COMM_CTRL_WBIT)
 		hsact = 1;
@@ -529,7 +529,8 @@ int embeddedice_handshake(arm_jtag_t *jtag_info, int hsbit, u32 timeout)
 	fields[2].in_handler_priv = NULL;
 
 	jtag_add_dr_scan(3, fields, -1);
-	gettimeofday(&lap, NULL);
+	deadline_start(&deadline, timeout);
+	/* every poll is a JTAG round trip already, don't sleep in between */
 	do
 	{
 		jtag_add_dr_scan(3, fields, -1);
@@ -538,10 +539,8 @@ int embeddedice_handshake(arm_jtag_t *jtag_info, int hsbit, u32 timeout)
 
 		if (buf_get_u32(field0_in, hsbit, 1) == hsact)
 			return ERROR_OK;
-
-		gettimeofday(&now, NULL);
 	}
-	while ((now.tv_sec-lap.tv_sec)*1000 + (now.tv_usec-lap.tv_usec)/1000 <= timeout);
+	while (!deadline_expired(&deadline));
 
 	return ERROR_TARGET_TIMEOUT;
 }
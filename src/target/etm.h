@@ -205,6 +205,7 @@ extern int etm_setup(target_t *target);
 
 int etm_register_commands(struct command_context_s *cmd_ctx);
 int etm_register_user_commands(struct command_context_s *cmd_ctx);
+extern int etmv1_next_packet(etm_context_t *ctx, u8 *packet, int apo);
 extern etm_context_t* etm_create_context(etm_portmode_t portmode, char *capture_driver_name);
 
 #define ERROR_ETM_INVALID_DRIVER	(-1300)
@@ -34,6 +34,7 @@
 #include "log.h"
 
 #include "fileio.h"
+#include "crc32.h"
 #include "target.h"
 
 /* convert ELF header field to host endianness */
@@ -981,33 +982,13 @@ int image_close(image_t *image)
 	return ERROR_OK;
 }
 
-static u32 crc32_table[256] = {0, 0};
-
 int image_calculate_checksum(u8* buffer, u32 nbytes, u32* checksum)
 {
-	u32 crc = 0xffffffff;
-	
-	if (!crc32_table[1])
-	{
-		/* Initialize the CRC table and the decoding table.  */
-		int i, j;
-		unsigned int c;
-		for (i = 0; i < 256; i++)
-		{
-			/* as per gdb */
-			for (c = i << 24, j = 8; j > 0; --j)
-				c = c & 0x80000000 ? (c << 1) ^ 0x04c11db7 : (c << 1);
-			crc32_table[i] = c;
-		}
-	}
+	u32 crc = crc32_init();
 	
-	while (nbytes--)
-	{
-		/* as per gdb */
-		crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ *buffer++) & 255];
-	}
+	crc = crc32_update(crc, buffer, nbytes);
 	
-	*checksum = crc;
+	*checksum = crc32_final(crc);
 	return ERROR_OK;
 }
 
@@ -29,6 +29,7 @@
 #include "configuration.h"
 #include "binarybuffer.h"
 #include "jtag.h"
+#include "span.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -42,10 +43,15 @@
 #include <sys/time.h>
 #include <time.h>
 
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
 #include <time_support.h>
 
 #include <fileio.h>
 #include <image.h>
+#include <crc32.h>
 
 int cli_target_callback_event_handler(struct target_s *target, enum target_event event, void *priv);
 
@@ -59,6 +65,8 @@ int handle_working_area_command(struct command_context_s *cmd_ctx, char *cmd, ch
 
 int handle_reg_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
 int handle_poll_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
+int handle_poll_interval_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
+static int target_poll_event_handler(struct target_s *target, enum target_event event, void *priv);
 int handle_halt_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
 int handle_wait_halt_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
 int handle_reset_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
@@ -70,6 +78,7 @@ int handle_mw_command(struct command_context_s *cmd_ctx, char *cmd, char **args,
 int handle_load_image_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
 int handle_dump_image_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
 int handle_verify_image_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
+int handle_verify_chunk_size_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
 int handle_bp_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
 int handle_rbp_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
 int handle_wp_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc);
@@ -133,6 +142,18 @@ char *target_endianess_strings[] =
 
 static int target_continous_poll = 1;
 
+/* handle_target polls every poll_min_ms for poll_window_ms after host or target
+ * activity, then doubles the interval up to poll_max_ms while nothing happens */
+static int poll_min_ms = 10;
+static int poll_max_ms = 100;
+static int poll_window_ms = 1000;
+static int poll_interval_ms = 100;
+static long long poll_fast_until = 0;
+
+/* verify_image compares checksums of blocks this size, and reads back mismatching blocks only */
+static u32 verify_chunk_size = 4096;
+#define VERIFY_MAX_RANGES	32
+
 /* read a u32 from a buffer in target memory endianness */
 u32 target_buffer_get_u32(target_t *target, u8 *buffer)
 {
@@ -291,8 +312,9 @@ int target_process_reset(struct command_context_s *cmd_ctx)
 {
 	int retval = ERROR_OK;
 	target_t *target;
-	struct timeval timeout, now;
+	deadline_t timeout;
 
+	jtag_worker_sync();
 	jtag->speed(jtag_speed);
 
 	if ((retval = jtag_init_reset(cmd_ctx)) != ERROR_OK)
@@ -410,11 +432,10 @@ int target_process_reset(struct command_context_s *cmd_ctx)
 	LOG_DEBUG("Waiting for halted stated as approperiate");
 	
 	/* Wait for reset to complete, maximum 5 seconds. */	
-	gettimeofday(&timeout, NULL);
-	timeval_add_time(&timeout, 5, 0);
+	deadline_start(&timeout, 5000);
 	for(;;)
 	{
-		gettimeofday(&now, NULL);
+		int expired = deadline_expired(&timeout);
 		
 		target_call_timer_callbacks_now();
 		
@@ -430,7 +451,7 @@ int target_process_reset(struct command_context_s *cmd_ctx)
 			{
 				if (target->state != TARGET_HALTED)
 				{
-					if ((now.tv_sec > timeout.tv_sec) || ((now.tv_sec == timeout.tv_sec) && (now.tv_usec >= timeout.tv_usec)))
+					if (expired)
 					{
 						LOG_USER("Timed out waiting for halt after reset");
 						goto done;
@@ -464,6 +485,7 @@ int target_process_reset(struct command_context_s *cmd_ctx)
 	target_unregister_event_callback(target_init_handler, cmd_ctx);
 				
 	
+	jtag_worker_sync();
 	jtag->speed(jtag_speed_post_reset);
 	
 	return retval;
@@ -538,12 +560,20 @@ static int target_soft_reset_halt_imp(struct target_s *target)
 
 static int target_run_algorithm_imp(struct target_s *target, int num_mem_params, mem_param_t *mem_params, int num_reg_params, reg_param_t *reg_param, u32 entry_point, u32 exit_point, int timeout_ms, void *arch_info)
 {
+	long long span;
+	int retval;
+
 	if (!target->type->examined)
 	{
 		LOG_ERROR("Target not examined yet");
 		return ERROR_FAIL;
 	}
-	return target->type->run_algorithm_imp(target, num_mem_params, mem_params, num_reg_params, reg_param, entry_point, exit_point, timeout_ms, arch_info);
+
+	span = span_begin();
+	retval = target->type->run_algorithm_imp(target, num_mem_params, mem_params, num_reg_params, reg_param, entry_point, exit_point, timeout_ms, arch_info);
+	span_end(span, "target_run_algorithm");
+
+	return retval;
 }
 
 int target_init(struct command_context_s *cmd_ctx)
@@ -593,7 +623,8 @@ int target_init(struct command_context_s *cmd_ctx)
 	if (targets)
 	{
 		target_register_user_commands(cmd_ctx);
-		target_register_timer_callback(handle_target, 100, 1, NULL);
+		target_register_timer_callback(handle_target, poll_interval_ms, 1, NULL);
+		target_register_event_callback(target_poll_event_handler, NULL);
 	}
 		
 	return ERROR_OK;
@@ -623,10 +654,86 @@ int target_register_event_callback(int (*callback)(struct target_s *target, enum
 	return ERROR_OK;
 }
 
+/* pending timer callbacks ordered by due time, timer_heap[0] is due first */
+static target_timer_callback_t **timer_heap = NULL;
+static int timer_heap_count = 0;
+static int timer_heap_size = 0;
+
+static void timer_heap_set(int i, target_timer_callback_t *callback)
+{
+	timer_heap[i] = callback;
+	callback->heap_index = i;
+}
+
+static void timer_heap_up(int i)
+{
+	target_timer_callback_t *callback = timer_heap[i];
+
+	while (i > 0)
+	{
+		int parent = (i - 1) / 2;
+		if (timer_heap[parent]->when <= callback->when)
+			break;
+		timer_heap_set(i, timer_heap[parent]);
+		i = parent;
+	}
+	timer_heap_set(i, callback);
+}
+
+static void timer_heap_down(int i)
+{
+	target_timer_callback_t *callback = timer_heap[i];
+
+	for (;;)
+	{
+		int child = 2 * i + 1;
+		if (child >= timer_heap_count)
+			break;
+		if ((child + 1 < timer_heap_count) && (timer_heap[child + 1]->when < timer_heap[child]->when))
+			child++;
+		if (callback->when <= timer_heap[child]->when)
+			break;
+		timer_heap_set(i, timer_heap[child]);
+		i = child;
+	}
+	timer_heap_set(i, callback);
+}
+
+static int timer_heap_insert(target_timer_callback_t *callback)
+{
+	if (timer_heap_count == timer_heap_size)
+	{
+		int size = timer_heap_size ? timer_heap_size * 2 : 16;
+		target_timer_callback_t **heap = realloc(timer_heap, size * sizeof(target_timer_callback_t *));
+		if (heap == NULL)
+			return ERROR_FAIL;
+		timer_heap = heap;
+		timer_heap_size = size;
+	}
+
+	timer_heap_set(timer_heap_count++, callback);
+	timer_heap_up(callback->heap_index);
+
+	return ERROR_OK;
+}
+
+static void timer_heap_remove(target_timer_callback_t *callback)
+{
+	int i = callback->heap_index;
+
+	callback->heap_index = -1;
+	if (--timer_heap_count == i)
+		return;
+
+	timer_heap_set(i, timer_heap[timer_heap_count]);
+	timer_heap_up(i);
+	timer_heap_down(timer_heap[i]->heap_index);
+}
+
 int target_register_timer_callback(int (*callback)(void *priv), int time_ms, int periodic, void *priv)
 {
 	target_timer_callback_t **callbacks_p = &target_timer_callbacks;
-	struct timeval now;
+	target_timer_callback_t *c;
 	
 	if (callback == NULL)
 	{
@@ -640,27 +747,50 @@ int target_register_timer_callback(int (*callback)(void *priv), int time_ms, int
 		callbacks_p = &((*callbacks_p)->next);
 	}
 	
-	(*callbacks_p) = malloc(sizeof(target_timer_callback_t));
-	(*callbacks_p)->callback = callback;
-	(*callbacks_p)->periodic = periodic;
-	(*callbacks_p)->time_ms = time_ms;
+	c = malloc(sizeof(target_timer_callback_t));
+	c->callback = callback;
+	c->periodic = periodic;
+	c->time_ms = time_ms;
+	c->when = monotonic_ms() + time_ms;
+	c->heap_index = -1;
+	c->removed = 0;
+	c->priv = priv;
+	c->next = NULL;
 	
-	gettimeofday(&now, NULL);
-	(*callbacks_p)->when.tv_usec = now.tv_usec + (time_ms % 1000) * 1000;
-	time_ms -= (time_ms % 1000);
-	(*callbacks_p)->when.tv_sec = now.tv_sec + (time_ms / 1000);
-	if ((*callbacks_p)->when.tv_usec > 1000000)
+	if (timer_heap_insert(c) != ERROR_OK)
 	{
-		(*callbacks_p)->when.tv_usec = (*callbacks_p)->when.tv_usec - 1000000;
-		(*callbacks_p)->when.tv_sec += 1;
+		free(c);
+		return ERROR_FAIL;
 	}
 	
-	(*callbacks_p)->priv = priv;
-	(*callbacks_p)->next = NULL;
+	(*callbacks_p) = c;
 	
 	return ERROR_OK;
 }
 
+int target_reschedule_timer_callback(int (*callback)(void *priv), void *priv, int time_ms)
+{
+	target_timer_callback_t *c;
+	
+	for (c = target_timer_callbacks; c; c = c->next)
+	{
+		if ((c->callback == callback) && (c->priv == priv))
+		{
+			c->time_ms = time_ms;
+			/* a running callback is rescheduled once it returns */
+			if (c->heap_index >= 0)
+			{
+				c->when = monotonic_ms() + time_ms;
+				timer_heap_up(c->heap_index);
+				timer_heap_down(c->heap_index);
+			}
+			return ERROR_OK;
+		}
+	}
+	
+	return ERROR_INVALID_ARGUMENTS;
+}
+
 int target_unregister_event_callback(int (*callback)(struct target_s *target, enum target_event event, void *priv), void *priv)
 {
 	target_event_callback_t **p = &target_event_callbacks;
@@ -704,7 +834,14 @@ int target_unregister_timer_callback(int (*callback)(void *priv), void *priv)
 		if ((c->callback == callback) && (c->priv == priv))
 		{
 			*p = next;
-			free(c);
+			/* a running callback is freed once it returns */
+			if (c->heap_index >= 0)
+			{
+				timer_heap_remove(c);
+				free(c);
+			}
+			else
+				c->removed = 1;
 			return ERROR_OK;
 		}
 		else
@@ -734,43 +871,68 @@ int target_call_event_callbacks(target_t *target, enum target_event event)
 
 static int target_call_timer_callbacks_check_time(int checktime)
 {
-	target_timer_callback_t *callback = target_timer_callbacks;
-	target_timer_callback_t *next_callback;
-	struct timeval now;
-
-	gettimeofday(&now, NULL);
+	target_timer_callback_t *callback;
+	long long now = monotonic_ms();
+	int i;
 	
-	while (callback)
+	/* periodic callbacks are due right away */
+	if (!checktime)
 	{
-		next_callback = callback->next;
-		
-		if ((!checktime&&callback->periodic)||
-				(((now.tv_sec >= callback->when.tv_sec) && (now.tv_usec >= callback->when.tv_usec))
-						|| (now.tv_sec > callback->when.tv_sec)))
+		for (i = 0; i < timer_heap_count; i++)
 		{
-			callback->callback(callback->priv);
-			if (callback->periodic)
+			if (timer_heap[i]->periodic && (timer_heap[i]->when > now))
 			{
-				int time_ms = callback->time_ms;
-				callback->when.tv_usec = now.tv_usec + (time_ms % 1000) * 1000;
-				time_ms -= (time_ms % 1000);
-				callback->when.tv_sec = now.tv_sec + time_ms / 1000;
-				if (callback->when.tv_usec > 1000000)
-				{
-					callback->when.tv_usec = callback->when.tv_usec - 1000000;
-					callback->when.tv_sec += 1;
-				}
+				timer_heap[i]->when = now;
+				timer_heap_up(i);
 			}
-			else
-				target_unregister_timer_callback(callback->callback, callback->priv);
 		}
-			
-		callback = next_callback;
+	}
+	
+	while ((timer_heap_count > 0) && (timer_heap[0]->when <= now))
+	{
+		callback = timer_heap[0];
+		timer_heap_remove(callback);
+		
+		/* one-shot callbacks are gone before they run, so they may register themselves again */
+		if (!callback->periodic)
+		{
+			target_timer_callback_t **p = &target_timer_callbacks;
+			while (*p != callback)
+				p = &((*p)->next);
+			*p = callback->next;
+			callback->removed = 1;
+		}
+		
+		callback->callback(callback->priv);
+		
+		if (callback->removed)
+		{
+			free(callback);
+		}
+		else
+		{
+			/* a zero period would make this loop spin */
+			callback->when = now + ((callback->time_ms > 0) ? callback->time_ms : 1);
+			timer_heap_insert(callback);
+		}
 	}
 	
 	return ERROR_OK;
 }
 
+/* ms until the next timer callback is due, 0 if one is overdue, -1 if there are none */
+int target_timer_callbacks_next_ms()
+{
+	long long next;
+
+	if (timer_heap_count == 0)
+		return -1;
+
+	next = timer_heap[0]->when - monotonic_ms();
+
+	return (next < 0) ? 0 : next;
+}
+
 int target_call_timer_callbacks()
 {
 	return target_call_timer_callbacks_check_time(1);
@@ -779,7 +941,7 @@ int target_call_timer_callbacks()
 /* invoke periodic callbacks immediately */
 int target_call_timer_callbacks_now()
 {
-	return target_call_timer_callbacks(0);
+	return target_call_timer_callbacks_check_time(0);
 }
 
 
@@ -928,6 +1090,30 @@ int target_free_all_working_areas(struct target_s *target)
 	return target_free_all_working_areas_restore(target, 1); 
 }
 
+/* upload the 1K lookup table for the table driven CRC32 algorithms into a working area */
+int target_alloc_crc32_table(struct target_s *target, working_area_t **area)
+{
+	u8 table[256 * sizeof(u32)];
+	const u32 *table32 = crc32_table();
+	int retval;
+	int i;
+	
+	if (target_alloc_working_area(target, sizeof(table), area) != ERROR_OK)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	
+	for (i = 0; i < 256; i++)
+		target_buffer_set_u32(target, &table[i * sizeof(u32)], table32[i]);
+	
+	if ((retval = target_write_buffer(target, (*area)->address, sizeof(table), table)) != ERROR_OK)
+	{
+		target_free_working_area(target, *area);
+		*area = NULL;
+		return retval;
+	}
+	
+	return ERROR_OK;
+}
+
 int target_register_commands(struct command_context_s *cmd_ctx)
 {
 	register_command(cmd_ctx, NULL, "target", handle_target_command, COMMAND_CONFIG, "target <cpu> [reset_init default - DEPRECATED] <chainpos> <endianness> <variant> [cpu type specifc args]");
@@ -937,6 +1123,8 @@ int target_register_commands(struct command_context_s *cmd_ctx)
 	register_command(cmd_ctx, NULL, "working_area", handle_working_area_command, COMMAND_ANY, "working_area <target#> <address> <size> <'backup'|'nobackup'> [virtual address]");
 	register_command(cmd_ctx, NULL, "virt2phys", handle_virt2phys_command, COMMAND_ANY, "virt2phys <virtual address>");
 	register_command(cmd_ctx, NULL, "profile", handle_profile_command, COMMAND_EXEC, "PRELIMINARY! - profile <seconds> <gmon.out>");
+	register_command(cmd_ctx, NULL, "poll_interval", handle_poll_interval_command, COMMAND_ANY,
+		"background target poll interval [<min ms> <max ms> [fast window ms]]");
 
 	return ERROR_OK;
 }
@@ -1132,6 +1320,53 @@ int target_checksum_memory(struct target_s *target, u32 address, u32 size, u32*
 	return retval;
 }
 
+/* checksum size bytes in blocks of block_size bytes (the last one may be shorter),
+ * running as few on-target algorithms as possible. Returns
+ * ERROR_TARGET_RESOURCE_NOT_AVAILABLE if the target can't checksum blocks,
+ * the caller should then checksum the whole range with target_checksum_memory() */
+int target_checksum_memory_blocks(struct target_s *target, u32 address, u32 size, u32 block_size, u32 *checksums)
+{
+	u32 num_blocks = (size + block_size - 1) / block_size;
+	u32 end = address + size;
+	u32 block = 0;
+	int retval;
+	
+	if (!target->type->examined)
+	{
+		LOG_ERROR("Target not examined yet");
+		return ERROR_FAIL;
+	}
+	
+	if (!target->type->checksum_memory_blocks)
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	
+	/* the on-target loops compare end addresses, none of them may wrap */
+	if ((end < address) || (end + block_size < end))
+	{
+		LOG_DEBUG("0x%8.8x + 0x%x in blocks of 0x%x bytes wraps around", address, size, block_size);
+		return ERROR_TARGET_RESOURCE_NOT_AVAILABLE;
+	}
+	
+	while (block < num_blocks)
+	{
+		u32 batch = num_blocks - block;
+		u32 offset = block * block_size;
+		
+		if (batch > TARGET_CHECKSUM_BLOCKS_BATCH)
+			batch = TARGET_CHECKSUM_BLOCKS_BATCH;
+		
+		retval = target->type->checksum_memory_blocks(target, address + offset,
+			(batch * block_size < size - offset) ? batch * block_size : size - offset,
+			block_size, &checksums[block]);
+		if (retval != ERROR_OK)
+			return retval;
+		
+		block += batch;
+	}
+	
+	return ERROR_OK;
+}
+
 int target_read_u32(struct target_s *target, u32 address, u32 *value)
 {
 	u8 value_buf[4];
@@ -1292,6 +1527,7 @@ int target_register_user_commands(struct command_context_s *cmd_ctx)
 	register_command(cmd_ctx,  NULL, "load_image", handle_load_image_command, COMMAND_EXEC, "load_image <file> <address> ['bin'|'ihex'|'elf'|'s19']");
 	register_command(cmd_ctx,  NULL, "dump_image", handle_dump_image_command, COMMAND_EXEC, "dump_image <file> <address> <size>");
 	register_command(cmd_ctx,  NULL, "verify_image", handle_verify_image_command, COMMAND_EXEC, "verify_image <file> [offset] [type]");
+	register_command(cmd_ctx,  NULL, "verify_chunk_size", handle_verify_chunk_size_command, COMMAND_ANY, "size of the blocks checksummed by verify_image [bytes]");
 	register_command(cmd_ctx,  NULL, "load_binary", handle_load_image_command, COMMAND_EXEC, "[DEPRECATED] load_binary <file> <address>");
 	register_command(cmd_ctx,  NULL, "dump_binary", handle_dump_image_command, COMMAND_EXEC, "[DEPRECATED] dump_binary <file> <address> <size>");
 	
@@ -1577,6 +1813,65 @@ int handle_target(void *priv)
 		target = target->next;
 	}
 	
+	if (monotonic_ms() < poll_fast_until)
+		poll_interval_ms = poll_min_ms;
+	else if (poll_interval_ms < poll_max_ms)
+		poll_interval_ms = (poll_interval_ms * 2 < poll_max_ms) ? poll_interval_ms * 2 : poll_max_ms;
+	
+	target_reschedule_timer_callback(handle_target, NULL, poll_interval_ms);
+	
+	return ERROR_OK;
+}
+
+void target_poll_activity()
+{
+	poll_fast_until = monotonic_ms() + poll_window_ms;
+	
+	if (poll_interval_ms > poll_min_ms)
+	{
+		poll_interval_ms = poll_min_ms;
+		target_reschedule_timer_callback(handle_target, NULL, 0);
+	}
+}
+
+int target_poll_interval()
+{
+	return poll_interval_ms;
+}
+
+static int target_poll_event_handler(struct target_s *target, enum target_event event, void *priv)
+{
+	if ((event == TARGET_EVENT_RESUMED) || (event == TARGET_EVENT_DEBUG_RESUMED))
+		target_poll_activity();
+	
+	return ERROR_OK;
+}
+
+int handle_poll_interval_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
+{
+	if ((argc == 1) || (argc > 3))
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	
+	if (argc >= 2)
+	{
+		int min_ms = strtoul(args[0], NULL, 0);
+		int max_ms = strtoul(args[1], NULL, 0);
+		
+		if ((min_ms <= 0) || (max_ms < min_ms))
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		
+		poll_min_ms = min_ms;
+		poll_max_ms = max_ms;
+		if (argc == 3)
+			poll_window_ms = strtoul(args[2], NULL, 0);
+		
+		poll_interval_ms = poll_max_ms;
+		target_reschedule_timer_callback(handle_target, NULL, poll_interval_ms);
+	}
+	
+	command_print(cmd_ctx, "poll interval %i..%i ms, fast for %i ms after activity, currently %i ms",
+		poll_min_ms, poll_max_ms, poll_window_ms, poll_interval_ms);
+	
 	return ERROR_OK;
 }
 
@@ -1762,10 +2057,9 @@ static void target_process_events(struct command_context_s *cmd_ctx)
 static int wait_state(struct command_context_s *cmd_ctx, char *cmd, enum target_state state, int ms)
 {
 	int retval;
-	struct timeval timeout, now;
+	deadline_t timeout;
 	int once=1;
-	gettimeofday(&timeout, NULL);
-	timeval_add_time(&timeout, 0, ms * 1000);
+	deadline_start(&timeout, ms);
 	
 	target_t *target = get_current_target(cmd_ctx);
 	for (;;)
@@ -1783,8 +2077,7 @@ static int wait_state(struct command_context_s *cmd_ctx, char *cmd, enum target_
 			command_print(cmd_ctx, "waiting for target %s...", target_state_strings[state]);
 		}
 		
-		gettimeofday(&now, NULL);
-		if ((now.tv_sec > timeout.tv_sec) || ((now.tv_sec == timeout.tv_sec) && (now.tv_usec >= timeout.tv_usec)))
+		if (!deadline_wait(&timeout))
 		{
 			LOG_ERROR("timed out while waiting for target %s", target_state_strings[state]);
 			break;
@@ -2116,6 +2409,8 @@ int handle_load_image_command(struct command_context_s *cmd_ctx, char *cmd, char
 		command_print(cmd_ctx, "%u byte written at address 0x%8.8x", buf_cnt, image.sections[i].base_address);
 		
 		free(buffer);
+
+		command_yield();
 	}
 
 	duration_stop_measure(&duration, &duration_text);
@@ -2186,6 +2481,8 @@ int handle_dump_image_command(struct command_context_s *cmd_ctx, char *cmd, char
 		
 		size -= this_run_size;
 		address += this_run_size;
+
+		command_yield();
 	}
 
 	fileio_close(&fileio);
@@ -2200,6 +2497,60 @@ int handle_dump_image_command(struct command_context_s *cmd_ctx, char *cmd, char
 	return ERROR_OK;
 }
 
+typedef struct verify_checksum_job_s
+{
+	u8 *buffer;
+	u32 size;
+	u32 block_size;
+	u32 *checksums;
+} verify_checksum_job_t;
+
+static void *verify_checksum_job_run(void *priv)
+{
+	verify_checksum_job_t *job = priv;
+	u32 offset;
+	int i;
+	
+	for (i = 0, offset = 0; offset < job->size; i++, offset += job->block_size)
+	{
+		u32 size = (job->block_size < job->size - offset) ? job->block_size : job->size - offset;
+		image_calculate_checksum(job->buffer + offset, size, &job->checksums[i]);
+	}
+	
+	return NULL;
+}
+
+/* print one differing address range, returns the updated number of ranges */
+static int verify_report_range(struct command_context_s *cmd_ctx, u32 start, u32 end, int num_ranges)
+{
+	if (num_ranges < VERIFY_MAX_RANGES)
+	{
+		command_print(cmd_ctx, "mismatch at 0x%8.8x - 0x%8.8x (%u bytes)", start, end - 1, end - start);
+	}
+	
+	return num_ranges + 1;
+}
+
+int handle_verify_chunk_size_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
+{
+	if (argc > 1)
+		return ERROR_COMMAND_SYNTAX_ERROR;
+	
+	if (argc == 1)
+	{
+		u32 chunk_size = strtoul(args[0], NULL, 0);
+		
+		if (chunk_size == 0)
+			return ERROR_COMMAND_SYNTAX_ERROR;
+		
+		verify_chunk_size = chunk_size;
+	}
+	
+	command_print(cmd_ctx, "verify_image chunk size: %u bytes", verify_chunk_size);
+	
+	return ERROR_OK;
+}
+
 int handle_verify_image_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
 {
 	u8 *buffer;
@@ -2207,8 +2558,7 @@ int handle_verify_image_command(struct command_context_s *cmd_ctx, char *cmd, ch
 	u32 image_size;
 	int i;
 	int retval;
-	u32 checksum = 0;
-	u32 mem_checksum = 0;
+	int num_ranges = 0;
 
 	image_t image;	
 	
@@ -2252,6 +2602,18 @@ int handle_verify_image_command(struct command_context_s *cmd_ctx, char *cmd, ch
 	retval=ERROR_OK;
 	for (i = 0; i < image.num_sections; i++)
 	{
+		verify_checksum_job_t job;
+		u32 *mem_checksums;
+		u32 chunk_size;
+		u32 num_chunks;
+		u32 chunk;
+		u32 range_start = 0;
+		int in_range = 0;
+#ifdef HAVE_PTHREAD_H
+		pthread_t job_thread;
+		int job_started;
+#endif
+		
 		buffer = malloc(image.sections[i].size);
 		if (buffer == NULL)
 		{
@@ -2264,57 +2626,106 @@ int handle_verify_image_command(struct command_context_s *cmd_ctx, char *cmd, ch
 			break;
 		}
 		
-		/* calculate checksum of image */
-		image_calculate_checksum( buffer, buf_cnt, &checksum );
-		
-		retval = target_checksum_memory(target, image.sections[i].base_address, buf_cnt, &mem_checksum);
-		if( retval != ERROR_OK )
+		if (buf_cnt == 0)
 		{
 			free(buffer);
-			break;
+			continue;
 		}
 		
-		if( checksum != mem_checksum )
+		chunk_size = verify_chunk_size;
+		num_chunks = (buf_cnt + chunk_size - 1) / chunk_size;
+		
+		job.buffer = buffer;
+		job.size = buf_cnt;
+		job.block_size = chunk_size;
+		job.checksums = malloc(num_chunks * sizeof(u32));
+		mem_checksums = malloc(num_chunks * sizeof(u32));
+		
+		/* calculate the checksums of the image while the target works on its own */
+#ifdef HAVE_PTHREAD_H
+		job_started = (pthread_create(&job_thread, NULL, verify_checksum_job_run, &job) == 0);
+		if (!job_started)
+			verify_checksum_job_run(&job);
+#else
+		verify_checksum_job_run(&job);
+#endif
+		
+		retval = target_checksum_memory_blocks(target, image.sections[i].base_address, buf_cnt, chunk_size, mem_checksums);
+		
+#ifdef HAVE_PTHREAD_H
+		if (job_started)
+			pthread_join(job_thread, NULL);
+#endif
+		
+		/* one checksum of the whole section, a mismatch reads back all of it */
+		if (retval == ERROR_TARGET_RESOURCE_NOT_AVAILABLE)
 		{
-			/* failed crc checksum, fall back to a binary compare */
+			chunk_size = buf_cnt;
+			num_chunks = 1;
+			image_calculate_checksum(buffer, buf_cnt, &job.checksums[0]);
+			retval = target_checksum_memory(target, image.sections[i].base_address, buf_cnt, &mem_checksums[0]);
+		}
+		
+		for (chunk = 0; (retval == ERROR_OK) && (chunk < num_chunks); chunk++)
+		{
+			u32 offset = chunk * chunk_size;
+			u32 size = (chunk_size < buf_cnt - offset) ? chunk_size : buf_cnt - offset;
+			u32 address = image.sections[i].base_address + offset;
 			u8 *data;
+			u32 t;
 			
-			command_print(cmd_ctx, "checksum mismatch - attempting binary compare");
-			
-			data = (u8*)malloc(buf_cnt);
-			
-			/* Can we use 32bit word accesses? */
-			int size = 1;
-			int count = buf_cnt;
-			if ((count % 4) == 0)
+			if (job.checksums[chunk] == mem_checksums[chunk])
 			{
-				size *= 4;
-				count /= 4;
+				if (in_range)
+				{
+					num_ranges = verify_report_range(cmd_ctx, range_start, address, num_ranges);
+					in_range = 0;
+				}
+				continue;
 			}
-			retval = target->type->read_memory(target, image.sections[i].base_address, size, count, data);
-			if (retval == ERROR_OK)
+			
+			/* failed crc checksum, read back this chunk only for a binary compare */
+			data = malloc(size);
+			if ((retval = target_read_buffer(target, address, size, data)) == ERROR_OK)
 			{
-				int t;
-				for (t = 0; t < buf_cnt; t++)
+				for (t = 0; t < size; t++)
 				{
-					if (data[t] != buffer[t])
+					if ((data[t] != buffer[offset + t]) && !in_range)
 					{
-						command_print(cmd_ctx, "Verify operation failed address 0x%08x. Was 0x%02x instead of 0x%02x\n", t + image.sections[i].base_address, data[t], buffer[t]);
-						free(data);
-						free(buffer);
-						retval=ERROR_FAIL;
-						goto done;
+						range_start = address + t;
+						in_range = 1;
+					}
+					else if ((data[t] == buffer[offset + t]) && in_range)
+					{
+						num_ranges = verify_report_range(cmd_ctx, range_start, address + t, num_ranges);
+						in_range = 0;
 					}
 				}
 			}
-			
 			free(data);
 		}
 		
+		if (in_range)
+			num_ranges = verify_report_range(cmd_ctx, range_start, image.sections[i].base_address + buf_cnt, num_ranges);
+		
+		free(mem_checksums);
+		free(job.checksums);
 		free(buffer);
+		
+		if (retval != ERROR_OK)
+			break;
+		
 		image_size += buf_cnt;
 	}
-done:	
+	
+	if ((retval == ERROR_OK) && (num_ranges > 0))
+	{
+		if (num_ranges > VERIFY_MAX_RANGES)
+			command_print(cmd_ctx, "... %d more mismatching ranges", num_ranges - VERIFY_MAX_RANGES);
+		command_print(cmd_ctx, "Verify operation failed, %d mismatching ranges", num_ranges);
+		retval = ERROR_FAIL;
+	}
+	
 	duration_stop_measure(&duration, &duration_text);
 	if (retval==ERROR_OK)
 	{
@@ -2602,15 +3013,14 @@ static void writeGmon(u32 *samples, int sampleNum, char *filename)
 int handle_profile_command(struct command_context_s *cmd_ctx, char *cmd, char **args, int argc)
 {
 	target_t *target = get_current_target(cmd_ctx);
-	struct timeval timeout, now;
+	deadline_t timeout;
 	
-	gettimeofday(&timeout, NULL);
 	if (argc!=2)
 	{
 		return ERROR_COMMAND_SYNTAX_ERROR;
 	}
 	char *end;
-	timeval_add_time(&timeout, strtoul(args[0], &end, 0), 0);
+	deadline_start(&timeout, strtoul(args[0], &end, 0) * 1000);
 	if (*end) 
 	{
 		return ERROR_OK;
@@ -2653,8 +3063,7 @@ int handle_profile_command(struct command_context_s *cmd_ctx, char *cmd, char **
 			break;
 		}
 		
-		gettimeofday(&now, NULL);
-		if ((numSamples>=maxSample) || ((now.tv_sec >= timeout.tv_sec) && (now.tv_usec >= timeout.tv_usec)))
+		if ((numSamples>=maxSample) || deadline_expired(&timeout))
 		{
 			command_print(cmd_ctx, "Profiling completed. %d samples.", numSamples);
 			target_poll(target);
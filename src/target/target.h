@@ -160,6 +160,9 @@ typedef struct target_type_s
 	
 	int (*checksum_memory)(struct target_s *target, u32 address, u32 count, u32* checksum);
 	
+	/* optional: one checksum per block_size bytes, computed with a single algorithm run */
+	int (*checksum_memory_blocks)(struct target_s *target, u32 address, u32 count, u32 block_size, u32 *checksums);
+	
 	/* target break-/watchpoint control 
 	* rw: 0 = write, 1 = read, 2 = access
 	*/
@@ -246,7 +249,9 @@ typedef struct target_timer_callback_s
 	int (*callback)(void *priv);
 	int time_ms;
 	int periodic;
-	struct timeval when;
+	long long when;				/* monotonic_ms() the callback is due */
+	int heap_index;				/* position in the timer heap, -1 while the callback runs */
+	int removed;				/* unregistered while running */
 	void *priv;
 	struct target_timer_callback_s *next;
 } target_timer_callback_t;
@@ -270,12 +275,22 @@ extern int target_call_event_callbacks(target_t *target, enum target_event event
  */
 extern int target_register_timer_callback(int (*callback)(void *priv), int time_ms, int periodic, void *priv);
 extern int target_unregister_timer_callback(int (*callback)(void *priv), void *priv);
+/* change the period of a registered callback, the next call is due time_ms from now */
+extern int target_reschedule_timer_callback(int (*callback)(void *priv), void *priv, int time_ms);
 extern int target_call_timer_callbacks();
+extern int target_timer_callbacks_next_ms();
 /* invoke this to ensure that e.g. polling timer callbacks happen before
  * a syncrhonous command completes.
  */
 extern int target_call_timer_callbacks_now();
 
+/* host or target activity: poll the targets right away and keep polling
+ * fast for a while, polling backs off again while nothing happens
+ */
+extern void target_poll_activity();
+/* current interval of the background target poll in ms */
+extern int target_poll_interval();
+
 extern target_t* get_current_target(struct command_context_s *cmd_ctx);
 extern int get_num_by_target(target_t *query_target);
 extern target_t* get_target_by_num(int num);
@@ -283,6 +298,10 @@ extern target_t* get_target_by_num(int num);
 extern int target_write_buffer(struct target_s *target, u32 address, u32 size, u8 *buffer);
 extern int target_read_buffer(struct target_s *target, u32 address, u32 size, u8 *buffer);
 extern int target_checksum_memory(struct target_s *target, u32 address, u32 size, u32* crc);
+extern int target_checksum_memory_blocks(struct target_s *target, u32 address, u32 size, u32 block_size, u32 *checksums);
+
+/* upper limit for the number of block checksums computed by one algorithm run */
+#define TARGET_CHECKSUM_BLOCKS_BATCH	256
 
 /* DANGER!!!!!
  * 
@@ -300,6 +319,7 @@ extern int target_free_working_area(struct target_s *target, working_area_t *are
 extern int target_free_working_area_restore(struct target_s *target, working_area_t *area, int restore);
 extern int target_free_all_working_areas(struct target_s *target);
 extern int target_free_all_working_areas_restore(struct target_s *target, int restore);
+extern int target_alloc_crc32_table(struct target_s *target, working_area_t **area);
 
 
 extern target_t *targets;
@@ -143,6 +143,18 @@ int target_request(target_t *target, u32 request)
 	return ERROR_OK;
 }
 
+/* ms until the side-band channel is polled again: every ms while a
+ * running target has debug message receivers, so its messages don't
+ * back up, the regular target poll interval otherwise
+ */
+int target_request_poll_interval(target_t *target)
+{
+	if (target->dbg_msg_enabled && (target->state == TARGET_RUNNING))
+		return 1;
+	
+	return target_poll_interval();
+}
+
 int add_debug_msg_receiver(struct command_context_s *cmd_ctx, target_t *target)
 {
 	debug_msg_receiver_t **p = &target->dbgmsg;
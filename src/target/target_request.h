@@ -37,6 +37,9 @@ typedef struct debug_msg_receiver_s
 } debug_msg_receiver_t;
 
 extern int target_request(target_t *target, u32 request);
+/* period for a target's DCC poll timer callback: full rate while the target
+ * runs with debug messages enabled, the background poll interval otherwise */
+extern int target_request_poll_interval(target_t *target);
 extern int delete_debug_msg_receiver(struct command_context_s *cmd_ctx, target_t *target);
 extern int target_request_register_commands(struct command_context_s *cmd_ctx);
 